@@ -68,7 +68,8 @@ class conanRecipe(ConanFile):
         copy(self, "CMakeLists.txt", folder, self.export_sources_folder)
         copy(self, "src/*", folder, self.export_sources_folder)
         copy(self, "include/*", folder, self.export_sources_folder)
-        copy(self, "spirv/*", folder, self.export_sources_folder)
+        # Shaders are compiled from src/shaders by CMake, only a bundled glslc comes from spirv/.
+        copy(self, "spirv/glslc", folder, self.export_sources_folder)
         copy(self, "conan/fix_mac_libs.cmake", folder, self.export_sources_folder)
 
     def build(self):
@@ -96,13 +97,6 @@ class conanRecipe(ConanFile):
             os.path.join(self.package_folder, "bin"),
             keep_path=False,
         )
-        copy(
-            self,
-            "spirv/*.spv",
-            self.source_folder,
-            os.path.join(self.package_folder, "spirv"),
-            keep_path=False,
-        )
         copy(
             self,
             "spirv/glslc",
@@ -1,6 +1,10 @@
 #pragma once
+#include <memory>
+#include <string>
 #include "Vertex.h"
 #include "VLogger.h"
+#include "VVMemoryAllocator.h"
+#include "VVSamplerCache.h"
 
 
 namespace Veloxr {
@@ -10,8 +14,117 @@ namespace Veloxr {
         alignas(16) glm::mat4 view;
         alignas(16) glm::mat4 proj;
         alignas(16) glm::vec4 roi;
-        alignas(16) uint32_t hiddenMask;
+        // std140 packs these scalars right after roi.
         alignas(16) float nSplitVal;
+        float worldPerPixel;
+    };
+
+    // Per entity state the vertex shader reads by renderUID (std430, set 0 binding 3). Tile instances stay in
+    // entity space, moving, scaling, cropping or hiding an entity only rewrites its entry.
+    struct EntityData {
+        static constexpr uint32_t HIDDEN = 1u;
+
+        alignas(16) glm::vec4 transform{0.0f, 0.0f, 1.0f, 1.0f}; // Offset x, y and scale x, y: world = offset + local * scale.
+        alignas(16) glm::vec4 crop{0.0f};                         // Entity space minX, minY, maxX, maxY, all zero is no crop.
+        float opacity{1.0f};
+        uint32_t flags{0};
+        float padding[2]{};
+
+        inline bool isHidden() const { return flags & HIDDEN; }
+
+        // World space rect (minX, minY, maxX, maxY) to entity space and back, min and max stay ordered under negative scales.
+        glm::vec4 toLocal(const glm::vec4& rect) const {
+            const glm::vec2 offset(transform.x, transform.y), scale(transform.z, transform.w);
+            const glm::vec2 a = (glm::vec2(rect.x, rect.y) - offset) / scale;
+            const glm::vec2 b = (glm::vec2(rect.z, rect.w) - offset) / scale;
+            return glm::vec4(glm::min(a, b), glm::max(a, b));
+        }
+        glm::vec4 toWorld(const glm::vec4& rect) const {
+            const glm::vec2 offset(transform.x, transform.y), scale(transform.z, transform.w);
+            const glm::vec2 a = offset + glm::vec2(rect.x, rect.y) * scale;
+            const glm::vec2 b = offset + glm::vec2(rect.z, rect.w) * scale;
+            return glm::vec4(glm::min(a, b), glm::max(a, b));
+        }
+    };
+
+    class VVTileUploader;
+    class VVTileCache;
+    class VVDescriptorHeap;
+    class VVVirtualTextureCache;
+    class VVMemoryBudget;
+
+    // Optional device capabilities, resolved once in Device::create and read by every subsystem.
+    struct VVDeviceFeatures {
+        uint32_t apiVersion{VK_API_VERSION_1_0};
+
+        // VK_EXT_host_image_copy
+        bool hostImageCopy{false};
+        bool hostImageCopyToShaderReadOnly{false};
+
+        // VK_EXT_external_memory_host
+        bool externalMemoryHost{false};
+        VkDeviceSize minImportedHostPointerAlignment{0};
+
+        // Integrated / CPU devices where device local memory is also host visible.
+        bool unifiedMemory{false};
+
+        // Compute work can be recorded into the graphics queue's command buffers.
+        bool graphicsQueueCompute{false};
+
+        // BC1-7 sampled formats (mostly desktop GPUs and Apple silicon).
+        bool textureCompressionBC{false};
+
+        // Descriptor indexing (core in 1.2, VK_EXT_descriptor_indexing before): non uniform indexing into a partially
+        // bound, update after bind, variable count sampled image array.
+        bool descriptorIndexing{false};
+
+        // Storage buffer writes from fragment shaders, the virtual texture feedback needs them.
+        bool fragmentStoresAndAtomics{false};
+
+        // Several indirect draws per call, and (VK_KHR_draw_indirect_count) their count read from a buffer, so a
+        // recorded command buffer stays valid while the culled draw list changes.
+        bool multiDrawIndirect{false};
+        bool drawIndirectCount{false};
+        uint32_t maxDrawIndirectCount{1};
+
+        // VK_EXT_memory_budget: per heap usage and budget, including what other processes use.
+        bool memoryBudget{false};
+    };
+
+    // User facing knobs, set on RendererCore before init() and copied into the data packet.
+    struct VVRenderSettings {
+        // Copy tiles straight out of page aligned host memory instead of memcpy'ing into a staging buffer.
+        bool importHostMemory{true};
+        // On unified memory, write tiles into host visible linear images and skip the transfer entirely.
+        bool linearTilesOnUnifiedMemory{true};
+        // Upload RGB tiles packed and expand them to RGBA with a compute shader.
+        bool gpuExpandRGB{true};
+        // Tiles of the same size share one 2D array image and descriptor, the vertex carries the layer.
+        bool packTileArrays{true};
+        // Bind every tile through one persistent descriptor heap when the device has descriptor indexing.
+        bool bindlessDescriptors{true};
+        // Stream opted in entities page by page through a fixed size cache texture. Needs bindless descriptors.
+        bool virtualTextures{false};
+        // Edge of the virtual texture cache in texels (4096 = 256 pages of 256^2).
+        uint32_t virtualTextureCacheSize{4096};
+        // Keep a host copy of every tile so least recently drawn tiles can be evicted under memory pressure.
+        // Needs bindless descriptors, costs host memory equal to the uploaded tiles.
+        bool tileEviction{false};
+        // Device local bytes Veloxr may use, 0 follows the driver budget. Can be changed at runtime through the VVMemoryBudget.
+        VkDeviceSize deviceMemoryBudget{0};
+        // RendererCore::showImage decodes and tiles this many images on each side of the shown one ahead of time.
+        uint32_t prefetchRadius{2};
+        // Decoded pixels and uploaded tiles the prefetcher may hold, the least recently shown images go first.
+        VkDeviceSize prefetchHostBudget{4ull * 1024 * 1024 * 1024};
+        VkDeviceSize prefetchDeviceBudget{2ull * 1024 * 1024 * 1024};
+        // Where block compressed tiles are cached between runs. Empty uses <temp>/veloxr_tile_cache.
+        std::string tileCacheDirectory;
+        // Size cap of the tile cache directory, least recently used entries are removed past it. 0 disables the cap.
+        uint64_t tileCacheMaxBytes{4ull * 1024 * 1024 * 1024};
+        // Drop the decoded pixels and tile host copies once an entity with a pixel source (RenderEntity::setSourcePath)
+        // is uploaded. Evicted or released tiles and edits get them from the source again, block compressed tiles
+        // from the tile cache.
+        bool releaseHostPixels{false};
     };
 
     struct VVDataPacket {
@@ -19,6 +132,16 @@ namespace Veloxr {
         VkPhysicalDevice physicalDevice;
         VkCommandPool commandPool;
         VkQueue graphicsQueue, presentQueue;
+        Veloxr::VVDeviceFeatures features;
+        Veloxr::VVRenderSettings settings;
+        std::string shaderDirectory;
+        std::shared_ptr<Veloxr::VVMemoryAllocator> allocator;
+        std::shared_ptr<Veloxr::VVSamplerCache> samplerCache;
+        std::shared_ptr<Veloxr::VVTileUploader> uploader;
+        std::shared_ptr<Veloxr::VVTileCache> tileCache;
+        std::shared_ptr<Veloxr::VVDescriptorHeap> descriptorHeap; // Only set in bindless mode.
+        std::shared_ptr<Veloxr::VVVirtualTextureCache> virtualTextures; // Only set when virtual textures are enabled and supported.
+        std::shared_ptr<Veloxr::VVMemoryBudget> memoryBudget;
     };
 
     typedef uint64_t v_int;
@@ -1,12 +1,60 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
 #include <vector>
 namespace Veloxr{
 
+    // Pixel storage is aligned and padded to whole pages so it can be imported with VK_EXT_external_memory_host.
+    // 64 KiB covers every minImportedHostPointerAlignment seen in the wild.
+    inline constexpr size_t PIXEL_BUFFER_ALIGNMENT = 64 * 1024;
+
+    template <typename T>
+    struct PageAlignedAllocator {
+        using value_type = T;
+
+        PageAlignedAllocator() noexcept = default;
+        template <typename U> PageAlignedAllocator(const PageAlignedAllocator<U>&) noexcept {}
+
+        T* allocate(size_t n) {
+            size_t bytes = (n * sizeof(T) + PIXEL_BUFFER_ALIGNMENT - 1) / PIXEL_BUFFER_ALIGNMENT * PIXEL_BUFFER_ALIGNMENT;
+            return static_cast<T*>(::operator new(bytes, std::align_val_t(PIXEL_BUFFER_ALIGNMENT)));
+        }
+
+        void deallocate(T* p, size_t) noexcept {
+            ::operator delete(p, std::align_val_t(PIXEL_BUFFER_ALIGNMENT));
+        }
+
+        template <typename U> bool operator==(const PageAlignedAllocator<U>&) const noexcept { return true; }
+        template <typename U> bool operator!=(const PageAlignedAllocator<U>&) const noexcept { return false; }
+    };
+
+    using PixelBuffer = std::vector<unsigned char, PageAlignedAllocator<unsigned char>>;
+
+    // Byte order of 3 and 4 channel buffers. 1 and 2 channel buffers are gray / gray+alpha.
+    enum class ChannelOrder : uint8_t {
+        RGBA,
+        BGRA
+    };
+
+    // Optional lossy tile storage for view-only entities. None keeps lossless tiles.
+    enum class TileCompression : uint8_t {
+        None,
+        BC1, // 4 bpp, opaque, fastest to encode.
+        BC7  // 8 bpp, best quality.
+    };
+
     struct VeloxrBuffer {
-        std::vector<unsigned char> data;
+        Veloxr::PixelBuffer data;
         uint64_t width, height, numChannels, orientation;
+        Veloxr::ChannelOrder channelOrder{Veloxr::ChannelOrder::RGBA};
     };
 
+    // Produces a buffer's pixels again after they were released (VVRenderSettings::releaseHostPixels),
+    // e.g. by decoding the source file. Must give the same pixels every time.
+    using PixelSource = std::function<std::shared_ptr<Veloxr::VeloxrBuffer>()>;
+
 }
@@ -2,6 +2,10 @@
 #include "DataUtils.h"
 #include "RenderEntity.h"
 #include "VVShaderStageData.h"
+#include "VVMemoryBudget.h"
+#include "VVUtils.h"
+#include <algorithm>
+#include <cstring>
 #include <memory>
 
 
@@ -15,7 +19,6 @@ EntityManager::EntityManager(std::shared_ptr<Veloxr::VVDataPacket> dataPacket):
 void EntityManager::initialize() {
     console.logc2(__func__);
     console.logc2("Num of entities: ", _entityMap.size() );
-    _vertices.clear();
     float minX = std::numeric_limits<float>::max();
     float maxX = std::numeric_limits<float>::lowest();
     float minY = std::numeric_limits<float>::max();
@@ -32,31 +35,273 @@ void EntityManager::initialize() {
         _currentDataBuffer.data        = { 255, 255, 255, 255 };
         e->setTextureBuffer(_currentDataBuffer);
 
-    } else {
+    } else if (_entityMap.size() > 1 && _entityMap.count(DEFAULT_PIXEL_ENTITY_NAME)) {
         this->destroyEntity(DEFAULT_PIXEL_ENTITY_NAME);
     }
 
+    std::vector<Veloxr::RenderEntity*> dirty;
     for (auto& [name, entity] : _entityMap) {
+        if (!entity->isTextureDirty()) continue;
         console.debug("Initializing with entity ", name);
-        entity->getVVTexture().tileTexture(entity->getBuffer());
+        dirty.push_back(entity.get());
+    }
+    // Tiled before: frames in flight may still sample the tiles about to be replaced.
+    if (!dirty.empty() && _shaderData->getVersion()) vkDeviceWaitIdle(_data->device);
+    loadEntities(dirty);
 
-        const auto verts = entity->getVertices();
-        _vertices.insert(_vertices.begin(), verts.begin(), verts.end());
+    const size_t loaded = dirty.size();
+    for (auto* entity : dirty) {
+        const glm::vec4 loadedBounds = entity->getEntityData().toWorld(entity->getVVTexture().getBoundingBox());
+        minX = std::min(minX, loadedBounds.x);
+        maxX = std::max(maxX, loadedBounds.z);
+        minY = std::min(minY, loadedBounds.y);
+        maxY = std::max(maxY, loadedBounds.w);
+    }
+    if (!loaded && !_drawListDirty) {
+        console.logc2("No entity changed, keeping the draw list.");
+        return;
+    }
+    console.debug("Loaded ", loaded, " of ", _entityMap.size(), " entities. BoundingBox of the loaded ones: ", minX, ", ", minY, " : ", maxX, ", ", maxY);
+    updateEntities();
+    rebuildDrawList();
+}
 
-        for (const auto& vertex : verts) {
-            minX = std::min(minX, vertex.pos.x);
-            maxX = std::max(maxX, vertex.pos.x);
-            minY = std::min(minY, vertex.pos.y);
-            maxY = std::max(maxY, vertex.pos.y);
+void EntityManager::loadEntity(Veloxr::RenderEntity& entity) {
+    loadEntities({ &entity });
+}
+
+void EntityManager::loadEntities(const std::vector<Veloxr::RenderEntity*>& entities) {
+    std::vector<Veloxr::RenderEntity*> tiled;
+    for (auto* entity : entities) {
+        if (entity->isVirtualTexture() && _data->virtualTextures) {
+            entity->getVVTexture().createVirtualTexture(entity->getBuffer());
+        } else {
+            entity->getVVTexture().destroy();
+            tiled.push_back(entity);
         }
     }
-    console.debug("Vertices initialized, count: ", _vertices.size(), ". BoundingBox: ", minX, ", ", minY, " : ", maxX, ", ", maxY);
+
+    // Decoding, tiling and block compression of every entity at once, a 4-up takes about as long as its largest image.
+    // The Vulkan objects are made and filled on this thread afterwards.
+    Veloxr::VVUtils::parallelFor(tiled.size(), [&](size_t i) {
+        auto* entity = tiled[i];
+        entity->getVVTexture().prepareTiles(entity->getBuffer(), entity->getTileCompression(), entity->hasOverviewTexture());
+    }, tiled.size());
+
+    std::vector<Veloxr::VVTexture*> textures;
+    for (auto* entity : tiled) {
+        // Camera region moved into the entity's own space, where its tile instances live.
+        std::function<glm::vec4()> focus;
+        if (!_focusProviders.empty()) {
+            const auto entityData = entity->getEntityData();
+            focus = [this, entityData]() {
+                const auto regions = getFocusRegions();
+                if (regions.empty()) return glm::vec4(0.0f);
+                glm::vec4 region = regions.front();
+                for (const auto& other : regions) {
+                    region = glm::vec4(std::min(region.x, other.x), std::min(region.y, other.y), std::max(region.z, other.z), std::max(region.w, other.w));
+                }
+                return entityData.toLocal(region);
+            };
+        }
+        entity->getVVTexture().createTiles(focus);
+        textures.push_back(&entity->getVVTexture());
+    }
+    // One set of upload waves for all of them, ordered by what is under the camera. The first one now, so the
+    // draw list has something, uploadPendingTiles() takes a wave per frame from there.
+    Veloxr::VVTexture::uploadWave(textures);
+
+    for (auto* entity : entities) {
+        entity->clearTextureDirty();
+        // Uploaded, from here on the pixels come from the entity's source when needed.
+        if (_data->settings.releaseHostPixels && !entity->getVVTexture().isUploading()) entity->releaseHostPixels();
+    }
+}
+
+void EntityManager::uploadPendingTiles() {
+    uploadPending(false);
+}
+
+void EntityManager::finishUploads() {
+    uploadPending(true);
+}
+
+bool EntityManager::hasPendingUploads() const {
+    return std::any_of(_entityMap.begin(), _entityMap.end(), [](const auto& entry) { return entry.second->getVVTexture().isUploading(); });
+}
+
+void EntityManager::uploadPending(bool all) {
+    std::vector<Veloxr::RenderEntity*> uploading;
+    std::vector<Veloxr::VVTexture*> textures;
+    for (auto& [_, entity] : _entityMap) {
+        if (!entity->getVVTexture().isUploading()) continue;
+        uploading.push_back(entity.get());
+        textures.push_back(&entity->getVVTexture());
+    }
+    if (textures.empty()) return;
+
+    bool changed = true;
+    if (all) Veloxr::VVTexture::uploadTiles(textures);
+    else changed = Veloxr::VVTexture::uploadWave(textures);
+
+    for (auto* entity : uploading) {
+        if (entity->getVVTexture().isUploading()) continue;
+        if (_data->settings.releaseHostPixels) entity->releaseHostPixels();
+    }
+    if (changed) rebuildDrawList();
+}
+
+std::vector<glm::vec4> EntityManager::getFocusRegions() const {
+    std::vector<glm::vec4> regions;
+    for (const auto& [_, provider] : _focusProviders) {
+        const glm::vec4 region = provider();
+        if (region != glm::vec4(0.0f)) regions.push_back(region);
+    }
+    return regions;
+}
+
+void EntityManager::rebuildDrawList() {
     _shaderData->setTextureMap(_entityMap);
     _shaderData->createStageData();
+    _drawListDirty = false;
+    markChanged();
+}
+
+void EntityManager::commitCrop(const glm::vec4& roi) {
+    console.logc2(__func__);
+    vkDeviceWaitIdle(_data->device);
+    // Arrays still uploading have no view to release yet.
+    finishUploads();
+
+    VkDeviceSize freed = 0;
+    for (auto& [_, entity] : _entityMap) {
+        freed += entity->getVVTexture().releaseOutside(entity->getEntityData().toLocal(roi));
+    }
+    if (!freed) return;
+
+    _data->allocator->trim();
+    if (_data->memoryBudget) _data->memoryBudget->update();
+    rebuildDrawList();
+    console.log("Committed crop, released ", freed / 1024 / 1024, " MB. Instances left: ", getInstances().size());
+}
+
+void EntityManager::restoreCrop() {
+    console.logc2(__func__);
+    vkDeviceWaitIdle(_data->device);
+    finishUploads();
+
+    for (auto& [name, entity] : _entityMap) {
+        if (entity->getVVTexture().restoreCropped()) continue;
+        // Released without a host copy, the pixels are still in the entity's buffer.
+        console.debug("Tiling ", name, " again to restore the crop.");
+        loadEntity(*entity);
+    }
+    rebuildDrawList();
+}
+
+void EntityManager::updateResidency() {
+    if (!_data->memoryBudget) return;
+    _data->memoryBudget->update();
+    if (!_data->settings.tileEviction || !_data->descriptorHeap) return;
+
+    const auto regions = getFocusRegions();
+    if (regions.empty()) return;
+    _residencyFrame++;
+
+    bool reload = false;
+    for (auto& [_, entity] : _entityMap) {
+        if (entity->isHidden()) continue;
+        const auto entityData = entity->getEntityData();
+        for (const auto& region : regions) {
+            reload |= entity->getVVTexture().markVisible(entityData.toLocal(region), _residencyFrame);
+        }
+    }
+
+    VkDeviceSize overage = _data->memoryBudget->getOverage();
+    if (!reload && !overage) return;
+
+    // Tile images and their heap slots may still be in use by the other frame in flight.
+    vkQueueWaitIdle(_data->graphicsQueue);
+
+    // What is on screen comes back first, even if that means evicting more below.
+    if (reload) {
+        for (auto& [_, entity] : _entityMap) entity->getVVTexture().reloadVisible(_residencyFrame);
+        markChanged();
+        _data->memoryBudget->update();
+        overage = _data->memoryBudget->getOverage();
+        if (!overage) return;
+    }
+
+    struct Candidate {
+        uint64_t lastVisible;
+        Veloxr::VVTexture* texture;
+        size_t index;
+    };
+    std::vector<Candidate> candidates;
+    for (auto& [_, entity] : _entityMap) {
+        auto& texture = entity->getVVTexture();
+        // Its host layers only come over with the last wave.
+        if (texture.isUploading()) continue;
+        const auto& tiles = texture.getTiledResult();
+        for (size_t i = 0; i < tiles.size(); i++) {
+            if (tiles[i].resident && tiles[i].lastVisible < _residencyFrame && texture.canReload(tiles[i])) {
+                candidates.push_back({ tiles[i].lastVisible, &texture, i });
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.lastVisible < b.lastVisible; });
+
+    VkDeviceSize freed = 0;
+    size_t evicted = 0;
+    for (const auto& candidate : candidates) {
+        if (freed >= overage) break;
+        const VkDeviceSize bytes = candidate.texture->evictTile(candidate.index);
+        freed += bytes;
+        evicted += bytes ? 1 : 0;
+    }
+    if (evicted) markChanged();
+
+    // Hand the emptied blocks back, the budget only counts what the driver sees.
+    _data->allocator->trim();
+    _data->memoryBudget->update();
+    if (freed < overage) console.warn("Over the memory budget with every off screen tile evicted.");
+    console.log("Evicted ", evicted, " tiles, ", freed / 1024 / 1024, " MB.");
 }
 
-void EntityManager::updateUniformBuffers(uint32_t currentImage, const Veloxr::UniformBufferObject& ubo) {
-    _shaderData->updateUniformBuffers(currentImage, ubo);
+void EntityManager::uploadRegions() {
+    bool waited = false;
+    for (auto& [_, entity] : _entityMap) {
+        auto& texture = entity->getVVTexture();
+        if (!waited) {
+            // Regions of an uploading texture wait for its last wave.
+            if (texture.isUploading() || !texture.hasPendingRegions()) continue;
+            // The other frame in flight may still sample the tiles.
+            vkQueueWaitIdle(_data->graphicsQueue);
+            waited = true;
+        }
+        texture.uploadRegions();
+    }
+    if (waited) markChanged();
+}
+
+void EntityManager::updateUniformBuffers(uint32_t view, uint32_t currentImage, const Veloxr::UniformBufferObject& ubo) {
+    _shaderData->updateUniformBuffers(view, currentImage, ubo);
+    _shaderData->updateEntityBuffer(view, currentImage, _entityData);
+}
+
+void EntityManager::updateEntities() {
+    size_t count = 0;
+    for (const auto& [_, entity] : _entityMap) count = std::max<size_t>(count, entity->getUID() + 1);
+
+    _entityScratch.assign(count, Veloxr::EntityData{});
+    for (const auto& [_, entity] : _entityMap) _entityScratch[entity->getUID()] = entity->getEntityData();
+
+    if (_entityScratch.size() == _entityData.size() &&
+            std::memcmp(_entityScratch.data(), _entityData.data(), sizeof(Veloxr::EntityData) * _entityData.size()) == 0) {
+        return;
+    }
+    std::swap(_entityScratch, _entityData);
+    markChanged();
 }
 
 void EntityManager::registerEntity(std::shared_ptr<Veloxr::RenderEntity> entity) noexcept {
@@ -70,6 +315,7 @@ void EntityManager::registerEntity(std::shared_ptr<Veloxr::RenderEntity> entity)
     }
 
     _entityMap[name] = entity;
+    _drawListDirty = true;
     return ;
 }
 
@@ -85,6 +331,7 @@ void EntityManager::destroyEntity(const std::string& name) noexcept {
 
     findIt->second->destroy();
     _entityMap.erase(findIt);
+    _drawListDirty = true;
 }
 
 std::shared_ptr<Veloxr::RenderEntity> EntityManager::createEntity(const std::string& name) noexcept {
@@ -99,6 +346,7 @@ std::shared_ptr<Veloxr::RenderEntity> EntityManager::createEntity(const std::str
     std::shared_ptr<Veloxr::RenderEntity> entity = std::make_shared<Veloxr::RenderEntity>(_data);
     entity->setName(name);
     _entityMap[name] = entity;
+    _drawListDirty = true;
     return entity;
 
 }
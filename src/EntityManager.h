@@ -3,6 +3,7 @@
 #include "Common.h"
 #include "VVShaderStageData.h"
 #include "RenderEntity.h"
+#include <functional>
 #include <map>
 #include <memory>
 #include <unordered_map>
@@ -54,9 +55,52 @@ namespace Veloxr {
             std::shared_ptr<Veloxr::VVShaderStageData> getShaderStageData() { return _shaderData; }
 
             // ECS Systems
-            [[nodiscard]] inline const std::vector<Veloxr::Vertex>& getVertices () const { return _vertices; }
+            [[nodiscard]] inline const std::vector<Veloxr::TileInstance>& getInstances () const { return _shaderData->getInstances(); }
+            // Tiles the entities whose texture changed (RenderEntity::isTextureDirty), uploads the first wave of their
+            // tiles and patches the draw list for them and for added or destroyed entities. The other entities keep
+            // their tiles. uploadPendingTiles() streams the rest.
             void initialize();
-            void updateUniformBuffers(uint32_t currentImage, const Veloxr::UniformBufferObject& ubo);
+            // Rebuilds the tile instances and stage data from the already loaded textures, no tiling or upload.
+            void rebuildDrawList();
+            // Writes the uniforms and the entries of the entity buffer that changed for this frame in flight.
+            void updateUniformBuffers(uint32_t view, uint32_t currentImage, const Veloxr::UniformBufferObject& ubo);
+
+            // Collects every entity's EntityData, indexed by its id. A moved, hidden or cropped entity bumps the
+            // version, no draw list rebuild. Call once per frame.
+            void updateEntities();
+            [[nodiscard]] inline const std::vector<Veloxr::EntityData>& getEntityData() const { return _entityData; }
+
+            // World space (minX, minY, maxX, maxY) that initialize() uploads first. Queried again every upload wave.
+            // One per view (VVShaderStageData::createView), an empty provider removes it. Uploads go by the union of
+            // all views, residency keeps the tiles under every one of them.
+            void setFocusProvider(std::function<glm::vec4()> provider, uint32_t view = 0) {
+                if (provider) _focusProviders[view] = std::move(provider);
+                else _focusProviders.erase(view);
+            }
+
+            // Keeps tiles within the VVMemoryBudget (VVRenderSettings::tileEviction): uploads evicted tiles under the
+            // focus regions again and evicts the least recently drawn ones while over budget. Call once per frame.
+            void updateResidency();
+
+            // Copies the regions queued through RenderEntity::updateRegion into their tiles. Call once per frame.
+            void uploadRegions();
+
+            // Uploads the next wave of the tiles initialize() left, closest to the focus regions as they are now, and
+            // adds the arrays that landed to the draw list. Call once per frame.
+            void uploadPendingTiles();
+            // Uploads every tile left at once.
+            void finishUploads();
+            bool hasPendingUploads() const;
+
+            // Releases every tile outside roi (world space) and drops it from the draw list. Tiles with a host copy
+            // are only evicted, the rest are freed and tiled again from the entity buffer by restoreCrop().
+            void commitCrop(const glm::vec4& roi);
+            void restoreCrop();
+
+            // Bumped whenever what the entities draw changes: the draw list, tiles coming back or going, region
+            // uploads and streamed virtual texture pages. Render on demand redraws when it moves.
+            inline uint64_t getVersion() const { return _version; }
+            inline void markChanged() { _version++; }
 
 
             void destroy();
@@ -72,10 +116,23 @@ namespace Veloxr {
             // the data and possess the full memory, we can stride correctly. But we can't assume the client
             // is willing to give us the data permanently
             std::unordered_map<std::string, std::shared_ptr<Veloxr::RenderEntity>> _entityMap;
-            std::vector<Veloxr::Vertex> _vertices;
+            std::vector<Veloxr::EntityData> _entityData;
+            std::vector<Veloxr::EntityData> _entityScratch;
 
             std::shared_ptr<Veloxr::VVShaderStageData> _shaderData;
-
+            std::map<uint32_t, std::function<glm::vec4()>> _focusProviders;
+            uint64_t _residencyFrame{0};
+            uint64_t _version{0};
+            bool _drawListDirty{false}; // An entity was added or destroyed since the last draw list.
+
+
+            void loadEntity(Veloxr::RenderEntity& entity);
+            // Tiles the entities concurrently on the shared task scheduler, then uploads the first of their common waves.
+            void loadEntities(const std::vector<Veloxr::RenderEntity*>& entities);
+            // One wave, or all of them, over every uploading entity. Host pixels of the finished ones are released.
+            void uploadPending(bool all);
+            // Non empty regions of every focus provider.
+            std::vector<glm::vec4> getFocusRegions() const;
 
             // Vk 
             void createVertexBuffer();
@@ -2,7 +2,9 @@
 #include "OrthographicCamera.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/matrix.hpp>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
 using namespace Veloxr;
 
@@ -160,6 +162,29 @@ void OrthographicCamera::fitViewport(float left, float right, float bottom, floa
 
 
 
+glm::vec4 OrthographicCamera::getVisibleBounds() const {
+    if (_right == _left || _top == _bottom) return glm::vec4(0.0f);
+
+    // Same transform as recalcView, without going through the matrices so it is valid before the first recalc.
+    const float c = std::cos(glm::radians(rotation));
+    const float s = std::sin(glm::radians(rotation));
+    const glm::vec2 corners[4] = {
+        { _left / _zoomLevel,  _bottom / _zoomLevel },
+        { _right / _zoomLevel, _bottom / _zoomLevel },
+        { _left / _zoomLevel,  _top / _zoomLevel },
+        { _right / _zoomLevel, _top / _zoomLevel },
+    };
+
+    glm::vec2 minCorner(std::numeric_limits<float>::max());
+    glm::vec2 maxCorner(std::numeric_limits<float>::lowest());
+    for (const auto& corner : corners) {
+        const glm::vec2 world(_position.x + corner.x * c - corner.y * s, _position.y + corner.x * s + corner.y * c);
+        minCorner = glm::min(minCorner, world);
+        maxCorner = glm::max(maxCorner, world);
+    }
+    return { minCorner.x, minCorner.y, maxCorner.x, maxCorner.y };
+}
+
 void OrthographicCamera::recalcView() {
     glm::mat4 transform = glm::translate(glm::mat4(1.0f), _position)
         * glm::rotate(glm::mat4(1.0f), glm::radians(rotation), glm::vec3(0, 0, 1));
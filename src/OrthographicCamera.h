@@ -39,6 +39,9 @@ namespace Veloxr {
             float getWidth() const { return (_right - _left) / _zoomLevel; }
             float getHeight() const { return (_top - _bottom) / _zoomLevel; }
 
+            // World space rectangle on screen as (minX, minY, maxX, maxY). All zero before init().
+            glm::vec4 getVisibleBounds() const;
+
             // Set the zoom level, relative to world coordinates.
             void setZoomLevel(float zoomLevel);
             inline const float getZoomLevel() const { return _zoomLevel;}
@@ -61,15 +64,15 @@ namespace Veloxr {
             void recalcProjection();
             glm::mat4 projectionMatrix;
             glm::mat4 viewMatrix;
-            glm::vec3 _position;
-            float rotation;
+            glm::vec3 _position{0.0f};
+            float rotation{0.0f};
             float _zoomLevel = 1.0f;
-            float _left;
-            float _right;
-            float _bottom;
-            float _top;
-            float _nearPlane;
-            float _farPlane;
+            float _left{0.0f};
+            float _right{0.0f};
+            float _bottom{0.0f};
+            float _top{0.0f};
+            float _nearPlane{0.0f};
+            float _farPlane{0.0f};
             bool _dirty {true};
     };
 }
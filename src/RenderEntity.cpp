@@ -1,10 +1,11 @@
 #include "RenderEntity.h"
 #include "UniqueOrderedNumber.h"
+#include "texture.h"
 #include <algorithm>
 
 using Veloxr::RenderEntity;
 
-Veloxr::OrderedNumberFactory RenderEntity::_entitySlots{4, 1};
+Veloxr::OrderedNumberFactory RenderEntity::_entitySlots{RenderEntity::MAX_ENTITIES, 1};
 RenderEntity::RenderEntity(){
     _entityNumber = _entitySlots.getSlot(); 
     _name = "entity" + std::to_string(_entityNumber);
@@ -12,7 +13,7 @@ RenderEntity::RenderEntity(){
 RenderEntity::RenderEntity(std::shared_ptr<VVDataPacket> dataPacket) {
     _entityNumber = _entitySlots.getSlot(); 
     _name = "entity" + std::to_string(_entityNumber);
-    _texture.setDataPacket(dataPacket);
+    _texture->setDataPacket(dataPacket);
 }
 
 void RenderEntity::setPosition(float x, float y) {
@@ -23,48 +24,59 @@ void RenderEntity::setPosition(glm::vec3& pos) {
     _position = pos;
 }
 
-const std::vector<Veloxr::Vertex> RenderEntity::getVertices () {
-    // if(_isHidden) return {};
-    auto vertices = _texture.getBaseVertices();
-
-    // Transform size
-    if (_resolution.x != 0 && _resolution.y != 0) {
-        const glm::vec2 res = _resolution;
-        const glm::vec2 invRes = 1.0f / res;
-
-        for (auto& vert : vertices) {
-            vert.pos.x = std::clamp(vert.pos.x, 0.0f, res.x);
-            vert.pos.y = std::clamp(vert.pos.y, 0.0f, res.y);
-        }
-    }
-
-    // Transform position
-    for(auto& vert : vertices ) {
-        vert.pos.x += _position.x;
-        vert.pos.y += _position.y;
-        vert.renderUID = _entityNumber;
-    }
+const std::vector<Veloxr::TileInstance> RenderEntity::getInstances () {
+    auto instances = _texture->getBaseInstances();
+    // Position, size and visibility are applied by the vertex shader from the entity buffer.
+    for(auto& instance : instances ) instance.renderUID = _entityNumber;
+    return instances;
+}
 
-    return vertices;
+Veloxr::EntityData RenderEntity::getEntityData() const {
+    Veloxr::EntityData data{};
+    data.transform = { _position.x, _position.y, _scale.x, _scale.y };
+    if (_resolution.x != 0 && _resolution.y != 0) data.crop = { 0.0f, 0.0f, _resolution.x, _resolution.y };
+    data.opacity = _opacity;
+    data.flags = _isHidden ? Veloxr::EntityData::HIDDEN : 0u;
+    return data;
 }
 
 void RenderEntity::setTextureBuffer(std::unique_ptr<Veloxr::VeloxrBuffer> buffer) {
     _textureBuffer = std::shared_ptr<Veloxr::VeloxrBuffer>(std::move(buffer));
+    _textureDirty = true;
 }
 
 void RenderEntity::setTextureBuffer(VeloxrBuffer& buffer) {
     _textureBuffer = std::make_shared<Veloxr::VeloxrBuffer>(std::move(buffer));
+    _textureDirty = true;
 }
 
 void RenderEntity::setTextureBuffer(std::shared_ptr<Veloxr::VeloxrBuffer> buffer) {
     _textureBuffer = buffer;
+    _textureDirty = true;
+}
+void RenderEntity::setSourcePath(const std::string& path) {
+    _pixelSource = [path]() { return Veloxr::OIIOTexture::loadBuffer(path); };
+    // Without a buffer the source is what gets tiled.
+    if (!_textureBuffer) _textureDirty = true;
 }
+
+bool RenderEntity::releaseHostPixels() {
+    if (!_pixelSource || !_texture->releaseHostPixels(_pixelSource)) return false;
+    _textureBuffer.reset();
+    return true;
+}
+
+std::shared_ptr<Veloxr::VeloxrBuffer> RenderEntity::getBuffer() {
+    if (_textureBuffer || !_pixelSource) return _textureBuffer;
+    return _pixelSource();
+}
+
 void RenderEntity::setName(const std::string& name) {
     _name = name;
 }
 
 void RenderEntity::destroy() {
     _entitySlots.removeSlot(_entityNumber);
-    _texture.destroy();
+    _texture->destroy();
 
 }
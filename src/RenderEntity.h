@@ -15,30 +15,65 @@ namespace Veloxr {
 
     class RenderEntity {
         public:
+            // Entity ids run from 1 to MAX_ENTITIES, each indexes one EntityData entry of the entity buffer.
+            static constexpr int MAX_ENTITIES = 4096;
+
             RenderEntity();
             RenderEntity(std::shared_ptr<VVDataPacket> dataPacket);
 
             
-            void appendVertex(Veloxr::Vertex&& vertex) {
-                _vertices.push_back(std::move(vertex));
+            void appendInstance(Veloxr::TileInstance&& instance) {
+                _instances.push_back(std::move(instance));
             }
 
+            // Position, scale, resolution, visibility and opacity only change the entity's EntityData, no initialize() needed.
             void setIsHidden(bool isHidden) { _isHidden = isHidden; }
             void setName(const std::string& name);
             void setPosition(float x, float y);
             void setPosition(glm::vec3& pos);
+            void setScale(glm::vec2 scale) { _scale = scale; }
+            void setOpacity(float opacity) { _opacity = opacity; }
             void setTextureBuffer(std::unique_ptr<Veloxr::VeloxrBuffer> buffer);
             void setTextureBuffer(std::shared_ptr<Veloxr::VeloxrBuffer> buffer);
             void setTextureBuffer(Veloxr::VeloxrBuffer& buffer);
-            void setDataPacket(std::shared_ptr<VVDataPacket> dataPacket) { _texture.setDataPacket(dataPacket); }
+            // Where the pixels come from again once VVRenderSettings::releaseHostPixels dropped them. Without one
+            // the buffer stays for the entity's lifetime.
+            void setSourcePath(const std::string& path);
+            void setPixelSource(Veloxr::PixelSource source) {
+                _pixelSource = std::move(source);
+                if (!_textureBuffer) _textureDirty = true;
+            }
+            // Drops the buffer and the tile host copies of the uploaded texture, see VVTexture::releaseHostPixels.
+            bool releaseHostPixels();
+            void setDataPacket(std::shared_ptr<VVDataPacket> dataPacket) { _texture->setDataPacket(dataPacket); }
+            // Crops the entity to (0, 0, resolution), in its own pixels before the scale.
             void setResolution(glm::vec2 resolution) {_resolution = resolution;}
+            // Lossy BC1 / BC7 tiles for view-only entities. Takes effect on the next EntityManager::initialize().
+            void setTileCompression(Veloxr::TileCompression compression) { _tileCompression = compression; _textureDirty = true; }
+            // Stream through the virtual texture cache instead of uploading whole tiles, when the renderer has it enabled.
+            void setVirtualTexture(bool virtualTexture) { _virtualTexture = virtualTexture; _textureDirty = true; }
+            // Small box filtered copy drawn instead of the tiles when zoomed out. Takes effect on the next EntityManager::initialize().
+            void setOverviewTexture(bool overview) { _overviewTexture = overview; _textureDirty = true; }
+            // Exchanges the loaded texture and its buffer with texture / buffer, e.g. tiled ahead by VVImagePrefetcher.
+            // The draw list has to be rebuilt afterwards (EntityManager::rebuildDrawList).
+            void swapTexture(std::unique_ptr<Veloxr::VVTexture>& texture, std::shared_ptr<Veloxr::VeloxrBuffer>& buffer) {
+                std::swap(_texture, texture);
+                std::swap(_textureBuffer, buffer);
+                _textureDirty = false;
+            }
+            // Replaces rect (x, y, width, height in buffer pixels, before the EXIF orientation) of the loaded texture.
+            // pixels have the buffer's channel count, pitch is the row stride in bytes (0 for tight rows).
+            // Only the affected tiles are copied, on the next frame. No initialize() needed.
+            void updateRegion(const glm::uvec4& rect, const unsigned char* pixels, size_t pitch = 0) { _texture->updateRegion(rect, pixels, pitch); }
 
             void destroy();
 
             inline const glm::vec3& getPosition() const { return _position; }
+            inline const glm::vec2& getScale() const { return _scale; }
+            inline float getOpacity() const { return _opacity; }
             inline const glm::vec2 getResolution() const { 
                 if(_resolution.x != 0 && _resolution.y != 0) return _resolution;
-                const auto& bounding = _texture.getBoundingBox();
+                const auto& bounding = _texture->getBoundingBox();
                 uint32_t width = bounding.z - bounding.x;
                 uint32_t height = bounding.w - bounding.y;
                 return {width, height};
@@ -52,25 +87,42 @@ namespace Veloxr {
             inline const std::string& getName() const { return _name; }
             inline const bool isHidden () const { return _isHidden; }
             inline const int getUID () const { return _entityNumber; }
+            inline Veloxr::TileCompression getTileCompression() const { return _tileCompression; }
+            inline bool isVirtualTexture() const { return _virtualTexture; }
+            inline bool hasOverviewTexture() const { return _overviewTexture; }
+            // Set by the texture setters above, EntityManager::initialize() only tiles and uploads dirty entities.
+            inline bool isTextureDirty() const { return _textureDirty; }
+            inline void clearTextureDirty() { _textureDirty = false; }
 
-            // Copy to modify position
-            const std::vector<Veloxr::Vertex> getVertices ();
+            // One instance per tile quad in entity space, tagged with the entity id.
+            const std::vector<Veloxr::TileInstance> getInstances ();
+            // Transform, crop, visibility and opacity as the vertex shader reads them.
+            Veloxr::EntityData getEntityData() const;
 
             // Use these :| 
-            [[nodiscard]] inline Veloxr::VVTexture& getVVTexture() { return _texture; }
-            [[nodiscard]] inline const std::shared_ptr<Veloxr::VeloxrBuffer> getBuffer() const { return _textureBuffer; }
+            [[nodiscard]] inline Veloxr::VVTexture& getVVTexture() { return *_texture; }
+            // Produced again from the pixel source when released, the entity does not keep it then.
+            [[nodiscard]] std::shared_ptr<Veloxr::VeloxrBuffer> getBuffer();
 
         private:
             static OrderedNumberFactory _entitySlots;
 
             glm::vec3 _position{0, 0, 0};
             glm::vec2 _resolution{0, 0};
+            glm::vec2 _scale{1, 1};
+            float _opacity{1.0f};
             std::string _name{""};
             bool _isHidden{false};
+            Veloxr::TileCompression _tileCompression{Veloxr::TileCompression::None};
+            bool _virtualTexture{false};
+            bool _overviewTexture{false};
+            bool _textureDirty{true};
             int _entityNumber;
 
             std::shared_ptr<Veloxr::VeloxrBuffer> _textureBuffer;
-            std::vector<Veloxr::Vertex> _vertices;
-            Veloxr::VVTexture _texture;
+            Veloxr::PixelSource _pixelSource;
+            std::vector<Veloxr::TileInstance> _instances;
+            // Owned through a pointer so a texture tiled ahead of time can be swapped in.
+            std::unique_ptr<Veloxr::VVTexture> _texture{std::make_unique<Veloxr::VVTexture>()};
     };
 }
@@ -13,9 +13,10 @@ namespace Veloxr {
 
     struct TextureData {
         uint32_t width, height, channels;
-        std::vector<unsigned char> pixelData;
+        Veloxr::PixelBuffer pixelData;
         uint32_t rotateIndex=0;
         uint32_t samplerIndex{};
+        uint32_t x{0}, y{0}; // Origin in the buffer, before the EXIF orientation.
     };
 
     struct TiledResult {
@@ -37,8 +38,17 @@ namespace Veloxr {
         public:
             TextureTiling() = default;
             void init();
-            TiledResult tile(Veloxr::VeloxrBuffer& buffer, uint32_t maxResolution=4096*2);
-            TiledResult tile(std::shared_ptr<Veloxr::VeloxrBuffer> buffer, uint32_t deviceMaxDimension=8192);
+            // tileChannels 0 keeps the buffer's channel count (1, 2 or 4, RGB is padded to 4). 3 keeps RGB packed.
+            TiledResult tile(Veloxr::VeloxrBuffer& buffer, uint32_t maxResolution=4096*2, uint32_t tileChannels=0);
+            TiledResult tile(std::shared_ptr<Veloxr::VeloxrBuffer> buffer, uint32_t deviceMaxDimension=8192, uint32_t tileChannels=0);
+
+            static uint32_t getTileChannels(uint64_t numChannels, bool expandToRGBA);
+
+            // Copies count pixels from srcChannels to dstChannels. Gray is broadcast to RGB, missing alpha is opaque.
+            static void convertPixels(const unsigned char* src, v_int srcChannels, unsigned char* dst, v_int dstChannels, v_int count);
+
+            // Two triangles over the whole (EXIF oriented) image, the orientation goes into the UVs.
+            static std::vector<Vertex> makeQuad(uint32_t rawW, uint32_t rawH, int orientation, int textureUnit);
 
     };
 
@@ -1,23 +1,31 @@
 #pragma once
 
 #include <queue>
+#include <stdexcept>
 
 namespace Veloxr {
 
     class TileManager {
 
         public:
-            TileManager(int maxSlots=1024) {
+            static constexpr int MAX_SLOTS = 1024;
+
+            TileManager(int maxSlots=MAX_SLOTS): _maxSlots(maxSlots) {
                 _availableTextureSlots = {};
                 for(int i = 0; i < maxSlots; i++) _availableTextureSlots.push(i);
             }
 
-            inline int getTextureSlot() { auto val = _availableTextureSlots.top(); _availableTextureSlots.pop(); return val;}
+            inline int getTextureSlot() {
+                if (_availableTextureSlots.empty()) throw std::runtime_error("failed to get texture slot, all slots are taken!");
+                auto val = _availableTextureSlots.top(); _availableTextureSlots.pop(); return val;
+            }
+            inline size_t getUsedSlotCount() const { return static_cast<size_t>(_maxSlots) - _availableTextureSlots.size(); }
             void removeTextureSlot(int slot) {
                 _availableTextureSlots.push(slot);
             }
 
         private:
+            int _maxSlots;
             std::priority_queue<int, std::vector<int>, std::greater<int>> _availableTextureSlots;
     };
 }
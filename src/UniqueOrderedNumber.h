@@ -1,6 +1,7 @@
 #pragma once
 
 #include <queue>
+#include <stdexcept>
 
 namespace Veloxr {
 
@@ -11,7 +12,10 @@ namespace Veloxr {
                 for(int i = startNum; i < maxSlots + startNum; i++) _availableSlots.push(i);
             }
 
-            inline int getSlot() { auto val = _availableSlots.top(); _availableSlots.pop(); return val;}
+            inline int getSlot() {
+                if (_availableSlots.empty()) throw std::runtime_error("failed to get slot, all slots are taken!");
+                auto val = _availableSlots.top(); _availableSlots.pop(); return val;
+            }
             void removeSlot(int slot) {
                 _availableSlots.push(slot);
             }
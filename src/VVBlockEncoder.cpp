@@ -0,0 +1,287 @@
+#include "VVBlockEncoder.h"
+#include "VVUtils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace Veloxr {
+
+    namespace {
+        constexpr int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        inline uint16_t toRGB565(int r, int g, int b) {
+            return static_cast<uint16_t>(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+        }
+
+        inline void fromRGB565(uint16_t c, int rgb[3]) {
+            const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+            rgb[0] = (r << 3) | (r >> 2);
+            rgb[1] = (g << 2) | (g >> 4);
+            rgb[2] = (b << 3) | (b >> 2);
+        }
+
+        // Quantises both endpoints to 7 bits + p-bit (keeping whichever p-bit lands closer) and picks the
+        // nearest of the 16 interpolated colours per pixel. Returns the squared error of the block.
+        int fitBC7(const unsigned char block[64], const float targets[2][4], int endpoint7[2][4], int pbit[2], int indices[16]) {
+            int endpoint8[2][4];
+            for (int e = 0; e < 2; e++) {
+                float bestError = INFINITY;
+                for (int p = 0; p < 2; p++) {
+                    float error = 0.0f;
+                    int candidate[4];
+                    for (int c = 0; c < 4; c++) {
+                        const float target = std::clamp(targets[e][c], 0.0f, 255.0f);
+                        candidate[c] = std::clamp(static_cast<int>(std::lround((target - p) / 2.0f)), 0, 127);
+                        const float d = target - static_cast<float>((candidate[c] << 1) | p);
+                        error += d * d;
+                    }
+                    if (error < bestError) {
+                        bestError = error;
+                        pbit[e] = p;
+                        for (int c = 0; c < 4; c++) endpoint7[e][c] = candidate[c];
+                    }
+                }
+                for (int c = 0; c < 4; c++) endpoint8[e][c] = (endpoint7[e][c] << 1) | pbit[e];
+            }
+
+            int palette[16][4];
+            for (int w = 0; w < 16; w++) {
+                for (int c = 0; c < 4; c++) {
+                    palette[w][c] = ((64 - BC7_WEIGHTS[w]) * endpoint8[0][c] + BC7_WEIGHTS[w] * endpoint8[1][c] + 32) >> 6;
+                }
+            }
+
+            int totalError = 0;
+            for (int i = 0; i < 16; i++) {
+                int best = 0, bestError = INT32_MAX;
+                for (int w = 0; w < 16; w++) {
+                    int error = 0;
+                    for (int c = 0; c < 4; c++) {
+                        const int d = block[i * 4 + c] - palette[w][c];
+                        error += d * d;
+                    }
+                    if (error < bestError) { bestError = error; best = w; }
+                }
+                indices[i] = best;
+                totalError += bestError;
+            }
+            return totalError;
+        }
+
+        // Little endian 128 bit writer, bits are appended LSB first as BC7 expects.
+        struct BitWriter {
+            uint64_t bits[2]{0, 0};
+            uint32_t pos{0};
+
+            inline void write(uint64_t value, uint32_t count) {
+                for (uint32_t i = 0; i < count; i++, pos++) {
+                    bits[pos >> 6] |= ((value >> i) & 1ull) << (pos & 63);
+                }
+            }
+        };
+    }
+
+    VkFormat VVBlockEncoder::getFormat(Veloxr::TileCompression compression) {
+        switch (compression) {
+            case Veloxr::TileCompression::BC1: return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+            case Veloxr::TileCompression::BC7: return VK_FORMAT_BC7_SRGB_BLOCK;
+            default: return VK_FORMAT_UNDEFINED;
+        }
+    }
+
+    bool VVBlockEncoder::isBlockCompressed(VkFormat format) {
+        return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+    }
+
+    uint32_t VVBlockEncoder::getBlockBytes(Veloxr::TileCompression compression) {
+        return compression == Veloxr::TileCompression::BC1 ? 8 : 16;
+    }
+
+    VkDeviceSize VVBlockEncoder::getEncodedSize(uint32_t width, uint32_t height, Veloxr::TileCompression compression) {
+        return static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(compression);
+    }
+
+    void VVBlockEncoder::encodeBlockBC1(const unsigned char block[64], unsigned char* out) {
+        int minColor[3] = { 255, 255, 255 };
+        int maxColor[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++) {
+                minColor[c] = std::min<int>(minColor[c], block[i * 4 + c]);
+                maxColor[c] = std::max<int>(maxColor[c], block[i * 4 + c]);
+            }
+        }
+
+        // Inset the box by 1/16 so the endpoints are not dominated by outliers.
+        for (int c = 0; c < 3; c++) {
+            const int inset = (maxColor[c] - minColor[c]) >> 4;
+            minColor[c] = std::min(255, minColor[c] + inset);
+            maxColor[c] = std::max(0, maxColor[c] - inset);
+        }
+
+        uint16_t c0 = toRGB565(maxColor[0], maxColor[1], maxColor[2]);
+        uint16_t c1 = toRGB565(minColor[0], minColor[1], minColor[2]);
+        uint32_t indices = 0;
+
+        if (c0 != c1) {
+            // c0 > c1 selects the opaque 4 colour palette.
+            if (c0 < c1) std::swap(c0, c1);
+
+            int palette[4][3];
+            fromRGB565(c0, palette[0]);
+            fromRGB565(c1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; i++) {
+                int best = 0, bestError = INT32_MAX;
+                for (int p = 0; p < 4; p++) {
+                    const int dr = block[i * 4 + 0] - palette[p][0];
+                    const int dg = block[i * 4 + 1] - palette[p][1];
+                    const int db = block[i * 4 + 2] - palette[p][2];
+                    const int error = dr * dr + dg * dg + db * db;
+                    if (error < bestError) { bestError = error; best = p; }
+                }
+                indices |= static_cast<uint32_t>(best) << (i * 2);
+            }
+        }
+
+        out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+        out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+        std::memcpy(out + 4, &indices, 4);
+    }
+
+    void VVBlockEncoder::encodeBlockBC7(const unsigned char block[64], unsigned char* out) {
+        float pixels[16][4];
+        float mean[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 4; c++) {
+                pixels[i][c] = block[i * 4 + c];
+                mean[c] += pixels[i][c];
+            }
+        }
+        for (int c = 0; c < 4; c++) mean[c] /= 16.0f;
+
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; i++) {
+            float d[4];
+            for (int c = 0; c < 4; c++) d[c] = pixels[i][c] - mean[c];
+            for (int a = 0; a < 4; a++) {
+                for (int b = 0; b < 4; b++) covariance[a][b] += d[a] * d[b];
+            }
+        }
+
+        // Principal axis by power iteration, seeded with the luminance / alpha diagonal.
+        float axis[4] = { 0.577f, 0.577f, 0.577f, 0.1f };
+        for (int iteration = 0; iteration < 6; iteration++) {
+            float next[4] = { 0, 0, 0, 0 };
+            for (int a = 0; a < 4; a++) {
+                for (int b = 0; b < 4; b++) next[a] += covariance[a][b] * axis[b];
+            }
+            const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+            if (length < 1e-6f) break;
+            for (int c = 0; c < 4; c++) axis[c] = next[c] / length;
+        }
+
+        float minT = 0.0f, maxT = 0.0f;
+        for (int i = 0; i < 16; i++) {
+            float t = 0.0f;
+            for (int c = 0; c < 4; c++) t += (pixels[i][c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        float targets[2][4];
+        for (int c = 0; c < 4; c++) {
+            targets[0][c] = mean[c] + axis[c] * minT;
+            targets[1][c] = mean[c] + axis[c] * maxT;
+        }
+
+        int endpoint7[2][4];
+        int pbit[2];
+        int indices[16];
+        int bestError = fitBC7(block, targets, endpoint7, pbit, indices);
+
+        // One least squares pass: solve the endpoints for the chosen weights, keep it if the block improved.
+        float aa = 0, ab = 0, bb = 0;
+        float ax[4] = { 0, 0, 0, 0 }, bx[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < 16; i++) {
+            const float b = BC7_WEIGHTS[indices[i]] / 64.0f;
+            const float a = 1.0f - b;
+            aa += a * a; ab += a * b; bb += b * b;
+            for (int c = 0; c < 4; c++) {
+                ax[c] += a * pixels[i][c];
+                bx[c] += b * pixels[i][c];
+            }
+        }
+        const float det = aa * bb - ab * ab;
+        if (std::fabs(det) > 1e-3f) {
+            float refined[2][4];
+            for (int c = 0; c < 4; c++) {
+                refined[0][c] = (bb * ax[c] - ab * bx[c]) / det;
+                refined[1][c] = (aa * bx[c] - ab * ax[c]) / det;
+            }
+            int refinedEndpoint7[2][4];
+            int refinedPbit[2];
+            int refinedIndices[16];
+            const int refinedError = fitBC7(block, refined, refinedEndpoint7, refinedPbit, refinedIndices);
+            if (refinedError < bestError) {
+                std::memcpy(endpoint7, refinedEndpoint7, sizeof(endpoint7));
+                std::memcpy(pbit, refinedPbit, sizeof(pbit));
+                std::memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+
+        // The anchor (first) index only has 3 bits, its MSB must be 0. Swap the endpoints if it is not.
+        if (indices[0] & 8) {
+            std::swap(endpoint7[0], endpoint7[1]);
+            std::swap(pbit[0], pbit[1]);
+            for (int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+        }
+
+        BitWriter writer;
+        writer.write(1ull << 6, 7); // Mode 6.
+        for (int c = 0; c < 4; c++) {
+            writer.write(endpoint7[0][c], 7);
+            writer.write(endpoint7[1][c], 7);
+        }
+        writer.write(pbit[0], 1);
+        writer.write(pbit[1], 1);
+        writer.write(indices[0], 3);
+        for (int i = 1; i < 16; i++) writer.write(indices[i], 4);
+
+        std::memcpy(out, writer.bits, 16);
+    }
+
+    Veloxr::PixelBuffer VVBlockEncoder::encode(const unsigned char* rgba, uint32_t width, uint32_t height, Veloxr::TileCompression compression) {
+        if (compression == Veloxr::TileCompression::None) {
+            throw std::invalid_argument("cannot block encode without a compression mode!");
+        }
+
+        const uint32_t blocksX = (width + 3) / 4;
+        const uint32_t blocksY = (height + 3) / 4;
+        const uint32_t blockBytes = getBlockBytes(compression);
+        Veloxr::PixelBuffer encoded(static_cast<size_t>(getEncodedSize(width, height, compression)));
+
+        VVUtils::parallelFor(blocksY, [&](size_t by) {
+            unsigned char block[64];
+            for (uint32_t bx = 0; bx < blocksX; bx++) {
+                for (uint32_t y = 0; y < 4; y++) {
+                    const uint32_t srcY = std::min<uint32_t>(static_cast<uint32_t>(by) * 4 + y, height - 1);
+                    for (uint32_t x = 0; x < 4; x++) {
+                        const uint32_t srcX = std::min<uint32_t>(bx * 4 + x, width - 1);
+                        std::memcpy(block + (y * 4 + x) * 4, rgba + (static_cast<size_t>(srcY) * width + srcX) * 4, 4);
+                    }
+                }
+
+                unsigned char* out = encoded.data() + (by * blocksX + bx) * blockBytes;
+                if (compression == Veloxr::TileCompression::BC1) encodeBlockBC1(block, out);
+                else encodeBlockBC7(block, out);
+            }
+        });
+
+        return encoded;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan_core.h>
+
+#include "DataUtils.h"
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    /**
+     * CPU BC1 / BC7 encoder for RGBA8 tiles. Blocks are independent, so a tile is split into block rows
+     * and spread over VVUtils::parallelFor. The per block loops work on fixed size arrays so they vectorise.
+     *
+     * BC1 uses an inset bounding box fit (opaque, 4 colour mode).
+     * BC7 only emits mode 6 (one subset, RGBA 7.7.7.7 + p-bit, 4 bit indices) with a principal axis fit.
+     */
+    class VVBlockEncoder final {
+        private:
+            VVBlockEncoder() = delete;
+
+            inline static LLogger console{"[Veloxr][VVBlockEncoder] "};
+
+            static void encodeBlockBC1(const unsigned char block[64], unsigned char* out);
+            static void encodeBlockBC7(const unsigned char block[64], unsigned char* out);
+
+        public:
+            static VkFormat getFormat(Veloxr::TileCompression compression);
+            static bool isBlockCompressed(VkFormat format);
+            static uint32_t getBlockBytes(Veloxr::TileCompression compression);
+            static VkDeviceSize getEncodedSize(uint32_t width, uint32_t height, Veloxr::TileCompression compression);
+
+            // rgba is width * height * 4 bytes. Edge blocks repeat the last row / column.
+            static Veloxr::PixelBuffer encode(const unsigned char* rgba, uint32_t width, uint32_t height, Veloxr::TileCompression compression);
+    };
+}
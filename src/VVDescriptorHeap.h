@@ -0,0 +1,41 @@
+#pragma once
+
+#include <mutex>
+#include <vulkan/vulkan_core.h>
+
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    /**
+     * Persistent bindless descriptor set (set 1) holding every tile image, indexed by TileManager slot.
+     * Built on descriptor indexing: partially bound, update after bind and a variable count array,
+     * so a tile writes its own slot once and nothing is rebuilt when entities come and go.
+     * Freed slots are left as is, partially bound descriptors only have to be valid when a draw reads them.
+     */
+    class VVDescriptorHeap {
+        public:
+            VVDescriptorHeap(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t maxSlots);
+            ~VVDescriptorHeap();
+
+            inline bool isValid() const { return _descriptorSet != VK_NULL_HANDLE; }
+            inline uint32_t getCapacity() const { return _capacity; }
+            inline VkDescriptorSetLayout getDescriptorSetLayout() const { return _descriptorSetLayout; }
+            inline VkDescriptorSet getDescriptorSet() const { return _descriptorSet; }
+
+            void write(uint32_t slot, VkImageView imageView, VkImageLayout imageLayout);
+
+            void destroy();
+
+        private:
+            inline static LLogger console{"[Veloxr][VVDescriptorHeap] "};
+
+            VkDevice _device;
+            uint32_t _capacity{0};
+            std::mutex _mutex;
+
+            VkDescriptorSetLayout _descriptorSetLayout{VK_NULL_HANDLE};
+            VkDescriptorPool _descriptorPool{VK_NULL_HANDLE};
+            VkDescriptorSet _descriptorSet{VK_NULL_HANDLE};
+    };
+}
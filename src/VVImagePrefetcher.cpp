@@ -0,0 +1,315 @@
+#include "VVImagePrefetcher.h"
+#include "RenderEntity.h"
+#include "VVTexture.h"
+#include "VVMemoryBudget.h"
+#include "VVDescriptorHeap.h"
+#include "texture.h"
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <stdexcept>
+
+namespace Veloxr {
+
+    VVImagePrefetcher::VVImagePrefetcher(std::shared_ptr<Veloxr::VVDataPacket> data): _data(data) {}
+
+    void VVImagePrefetcher::setImages(std::vector<std::string> paths) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // Contexts that never step through a list never get the thread.
+        if (!_worker.joinable() && !_stop) _worker = std::thread([this]() { workerLoop(); });
+        _generation++;
+        if (std::any_of(_entries.begin(), _entries.end(), [](const auto& entry) { return entry.second.texture != nullptr; })) {
+            vkQueueWaitIdle(_data->graphicsQueue);
+        }
+        _entries.clear();
+        _paths = std::move(paths);
+        _current = NO_IMAGE;
+        console.log("Image list of ", _paths.size(), " images.");
+    }
+
+    void VVImagePrefetcher::setTileOptions(Veloxr::TileCompression compression, bool overview) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _compression = compression;
+        _overview = overview;
+    }
+
+    std::shared_ptr<Veloxr::VeloxrBuffer> VVImagePrefetcher::decode(const std::string& path) {
+        return Veloxr::OIIOTexture::loadBuffer(path);
+    }
+
+    VkDeviceSize VVImagePrefetcher::getDeviceBytes(const Veloxr::VVTexture& texture) {
+        VkDeviceSize bytes = 0;
+        for (const auto& tile : texture.getTiledResult()) bytes += tile.textureImageMemory.size;
+        return bytes;
+    }
+
+    std::vector<size_t> VVImagePrefetcher::getWindow() const {
+        std::vector<size_t> window;
+        if (_current == NO_IMAGE) return window;
+        for (size_t distance = 1; distance <= _data->settings.prefetchRadius; distance++) {
+            if (_current + distance < _paths.size()) window.push_back(_current + distance);
+            if (distance <= _current) window.push_back(_current - distance);
+        }
+        return window;
+    }
+
+    VkDeviceSize VVImagePrefetcher::getHostUsage() const {
+        VkDeviceSize bytes = 0;
+        for (const auto& [_, entry] : _entries) bytes += entry.hostBytes;
+        return bytes;
+    }
+
+    VkDeviceSize VVImagePrefetcher::getDeviceUsage() const {
+        VkDeviceSize bytes = 0;
+        for (const auto& [_, entry] : _entries) bytes += entry.deviceBytes;
+        return bytes;
+    }
+
+    bool VVImagePrefetcher::cachesTextures() const {
+        return _data->descriptorHeap != nullptr;
+    }
+
+    bool VVImagePrefetcher::canTile(const Veloxr::VeloxrBuffer& buffer) const {
+        // RGBA estimate, tiles are never larger.
+        const VkDeviceSize estimate = static_cast<VkDeviceSize>(buffer.width) * buffer.height * 4;
+        if (getDeviceUsage() + estimate > _data->settings.prefetchDeviceBudget) return false;
+
+        // Cached tiles hold heap slots the entities draw from too, half of the heap at most.
+        size_t cachedSlots = 0;
+        for (const auto& [_, entry] : _entries) {
+            if (entry.texture) cachedSlots += entry.texture->getTiledResult().size();
+        }
+        const size_t slots = Veloxr::VVTexture::getMaxSlotCount(buffer, _overview);
+        const size_t capacity = _data->descriptorHeap->getCapacity();
+        return Veloxr::VVTexture::getUsedSlotCount() + slots <= capacity && cachedSlots + slots <= capacity / 2;
+    }
+
+    void VVImagePrefetcher::workerLoop() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            size_t index = NO_IMAGE;
+            _wake.wait(lock, [&]() {
+                if (_stop) return true;
+                if (getHostUsage() >= _data->settings.prefetchHostBudget) return false;
+                for (size_t candidate : getWindow()) {
+                    const auto findIt = _entries.find(candidate);
+                    if (findIt != _entries.end() && (findIt->second.buffer || findIt->second.decoding || findIt->second.failed)) continue;
+                    index = candidate;
+                    return true;
+                }
+                return false;
+            });
+            if (_stop) return;
+
+            _entries[index].decoding = true;
+            const uint64_t generation = _generation;
+            const std::string path = _paths[index];
+            lock.unlock();
+
+            std::shared_ptr<Veloxr::VeloxrBuffer> buffer;
+            const auto now = std::chrono::high_resolution_clock::now();
+            try {
+                buffer = decode(path);
+            } catch (const std::exception& e) {
+                console.warn("Prefetch of ", path, " failed: ", e.what());
+            }
+            const auto timeToDecodeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
+
+            lock.lock();
+            if (generation != _generation) continue;
+            auto& entry = _entries[index];
+            entry.decoding = false;
+            entry.failed = !buffer;
+            entry.buffer = buffer;
+            entry.hostBytes = buffer ? buffer->data.size() : 0;
+            if (buffer) console.logc1("Decoded ", path, " in ", timeToDecodeMs, " ms.");
+            _decoded.notify_all();
+        }
+    }
+
+    bool VVImagePrefetcher::show(size_t index, Veloxr::RenderEntity& entity) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (index >= _paths.size()) {
+            console.warn("Image ", index, " is out of range (", _paths.size(), " images).");
+            return false;
+        }
+        if (index == _current) return true;
+
+        const auto now = std::chrono::high_resolution_clock::now();
+        auto& next = _entries[index];
+        _decoded.wait(lock, [&]() { return !next.decoding; });
+
+        const bool ready = next.texture != nullptr;
+        if (!ready) {
+            if (!next.buffer) {
+                // Keeps the worker off this one while we decode it ourselves.
+                next.decoding = true;
+                const std::string path = _paths[index];
+                lock.unlock();
+                std::shared_ptr<Veloxr::VeloxrBuffer> buffer;
+                try {
+                    buffer = decode(path);
+                } catch (...) {
+                    lock.lock();
+                    next.decoding = false;
+                    throw;
+                }
+                lock.lock();
+                next.decoding = false;
+                next.buffer = buffer;
+            }
+            if (!cachesTextures()) {
+                // Without the heap the slots index the shader's fixed image array, the shown image gives its slots
+                // back before the next one takes any. The frames in flight may still sample its tiles.
+                vkQueueWaitIdle(_data->graphicsQueue);
+                entity.getVVTexture().destroy();
+            }
+            next.texture = std::make_unique<Veloxr::VVTexture>(_data);
+            next.texture->tileTexture(next.buffer, _compression, {}, _overview);
+        }
+
+        // What the entity showed comes back in next and is cached under the index it was shown for.
+        entity.swapTexture(next.texture, next.buffer);
+        std::unique_ptr<Veloxr::VVTexture> previousTexture = std::move(next.texture);
+        std::shared_ptr<Veloxr::VeloxrBuffer> previousBuffer = std::move(next.buffer);
+        _entries.erase(index);
+
+        if (_current != NO_IMAGE && previousTexture && !cachesTextures()) {
+            // Its tiles are gone already, only the pixels are kept.
+            auto& previous = _entries[_current];
+            previous.hostBytes = previousBuffer ? previousBuffer->data.size() : 0;
+            previous.buffer = std::move(previousBuffer);
+            previous.lastShown = ++_clock;
+        } else if (_current != NO_IMAGE && previousTexture) {
+            auto& previous = _entries[_current];
+            previous.hostBytes = previousBuffer ? previousBuffer->data.size() : 0;
+            previous.deviceBytes = getDeviceBytes(*previousTexture);
+            previous.buffer = std::move(previousBuffer);
+            previous.texture = std::move(previousTexture);
+            previous.lastShown = ++_clock;
+        } else if (previousTexture) {
+            // Loaded outside of the list, not ours to cache. The frames in flight may still sample it.
+            vkQueueWaitIdle(_data->graphicsQueue);
+            previousTexture->destroy();
+        }
+        _current = index;
+        trim();
+        _wake.notify_all();
+
+        const auto timeToShowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
+        console.log("Showing ", _paths[index], ready ? " (prefetched)" : " (loaded in place)", " in ", timeToShowMs, " ms.");
+        return ready;
+    }
+
+    void VVImagePrefetcher::update() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        // Whatever the entities need comes first.
+        if (!cachesTextures() || (_data->memoryBudget && _data->memoryBudget->getOverage())) return;
+
+        // One image per frame keeps the hitch bounded.
+        size_t index = NO_IMAGE;
+        std::shared_ptr<Veloxr::VeloxrBuffer> buffer;
+        for (size_t candidate : getWindow()) {
+            const auto findIt = _entries.find(candidate);
+            if (findIt == _entries.end()) continue;
+            const auto& entry = findIt->second;
+            if (!entry.buffer || entry.texture || entry.decoding) continue;
+            if (!canTile(*entry.buffer)) break;
+            index = candidate;
+            buffer = entry.buffer;
+            break;
+        }
+        if (index == NO_IMAGE) {
+            trim();
+            return;
+        }
+        const uint64_t generation = _generation;
+        const auto compression = _compression;
+        const bool overview = _overview;
+        const std::string path = _paths[index];
+        lock.unlock();
+
+        // Tiled without the lock, the worker keeps decoding the rest of the window meanwhile.
+        const auto now = std::chrono::high_resolution_clock::now();
+        auto texture = std::make_unique<Veloxr::VVTexture>(_data);
+        texture->tileTexture(buffer, compression, {}, overview);
+        const auto timeToTileMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
+
+        lock.lock();
+        const auto findIt = _entries.find(index);
+        if (generation != _generation || findIt == _entries.end() || findIt->second.texture || findIt->second.buffer != buffer) {
+            // The list moved on meanwhile, no frame has sampled these tiles yet.
+            texture.reset();
+        } else {
+            auto& entry = findIt->second;
+            entry.texture = std::move(texture);
+            entry.deviceBytes = getDeviceBytes(*entry.texture);
+            console.log("Prefetched ", path, ": ", entry.deviceBytes / 1024 / 1024, " MB in ", timeToTileMs, " ms.");
+        }
+        trim();
+    }
+
+    bool VVImagePrefetcher::hasPendingWork() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_data->memoryBudget && _data->memoryBudget->getOverage()) return false;
+        for (size_t index : getWindow()) {
+            const auto findIt = _entries.find(index);
+            if (findIt == _entries.end()) continue;
+            const auto& entry = findIt->second;
+            if (entry.decoding) return true;
+            if (!cachesTextures() || !entry.buffer || entry.texture) continue;
+            return canTile(*entry.buffer);
+        }
+        return false;
+    }
+
+    void VVImagePrefetcher::trim() {
+        const auto window = getWindow();
+        const std::set<size_t> inWindow(window.begin(), window.end());
+
+        // Least recently shown first, the window is never given up, update() and the worker wait for room instead.
+        std::vector<size_t> candidates;
+        for (const auto& [index, entry] : _entries) {
+            if (!inWindow.count(index) && !entry.decoding) candidates.push_back(index);
+        }
+        std::sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+            return _entries.at(a).lastShown < _entries.at(b).lastShown;
+        });
+
+        bool waited = false;
+        auto dropTexture = [&](Entry& entry) {
+            if (!entry.texture) return;
+            // The image shown last may still be sampled by a frame in flight.
+            if (!waited) vkQueueWaitIdle(_data->graphicsQueue);
+            waited = true;
+            entry.texture.reset();
+            entry.deviceBytes = 0;
+        };
+
+        for (size_t index : candidates) {
+            if (getDeviceUsage() <= _data->settings.prefetchDeviceBudget) break;
+            dropTexture(_entries.at(index));
+        }
+        for (size_t index : candidates) {
+            if (getHostUsage() <= _data->settings.prefetchHostBudget) break;
+            dropTexture(_entries.at(index));
+            _entries.erase(index);
+        }
+        _wake.notify_all();
+    }
+
+    void VVImagePrefetcher::destroy() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        if (_worker.joinable()) _worker.join();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_entries.empty() && _data && _data->graphicsQueue) vkQueueWaitIdle(_data->graphicsQueue);
+        _entries.clear();
+    }
+
+    VVImagePrefetcher::~VVImagePrefetcher() { destroy(); }
+}
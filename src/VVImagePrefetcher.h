@@ -0,0 +1,98 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "Common.h"
+#include "DataUtils.h"
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    class RenderEntity;
+    class VVTexture;
+
+    /**
+     * Stepping through a list of images (RendererCore::showImage).
+     *
+     * A worker thread, started by the first setImages(), decodes the VVRenderSettings::prefetchRadius images on each
+     * side of the shown one, update() tiles and uploads them on the render thread, nearest first, one per frame.
+     * show() then only swaps the entity's texture and buffer, the caller rebuilds the draw list. The image shown
+     * before goes back into the cache, so stepping back is just as cheap.
+     * Tiles are only cached with the bindless descriptor heap, and in at most half of its slots. Without it the
+     * slots index the shader's fixed image array, so only the decoded pixels are kept ahead.
+     * Cached images beyond the window stay until the host (decoded pixels) or device (tiles) budget is exceeded,
+     * the least recently shown ones go first.
+     */
+    class VVImagePrefetcher {
+        public:
+            VVImagePrefetcher(std::shared_ptr<Veloxr::VVDataPacket> data);
+            ~VVImagePrefetcher();
+
+            // Drops everything cached for the previous list.
+            void setImages(std::vector<std::string> paths);
+            inline size_t getImageCount() const { return _paths.size(); }
+            // Applied to every image tiled from now on, match the entity the images are shown on.
+            void setTileOptions(Veloxr::TileCompression compression, bool overview);
+
+            // Puts images[index] on entity. Returns false when it was not prefetched and had to be decoded and tiled
+            // in place. Render thread only.
+            bool show(size_t index, Veloxr::RenderEntity& entity);
+
+            // Tiles the nearest decoded image of the window and trims to the budgets. Render thread, after the frame fence.
+            void update();
+            // Images of the window being decoded, or decoded and waiting for update() to tile them within the budget.
+            bool hasPendingWork();
+
+            void destroy();
+
+        private:
+            inline static LLogger console{"[Veloxr][VVImagePrefetcher] "};
+            static constexpr size_t NO_IMAGE = static_cast<size_t>(-1);
+
+            struct Entry {
+                std::shared_ptr<Veloxr::VeloxrBuffer> buffer;
+                std::unique_ptr<Veloxr::VVTexture> texture;
+                VkDeviceSize hostBytes{0};
+                VkDeviceSize deviceBytes{0};
+                uint64_t lastShown{0};
+                bool decoding{false};
+                bool failed{false};
+            };
+
+            std::shared_ptr<Veloxr::VVDataPacket> _data;
+            Veloxr::TileCompression _compression{Veloxr::TileCompression::None};
+            bool _overview{false};
+
+            std::mutex _mutex;
+            std::condition_variable _wake;   // Worker: the window moved or memory was freed.
+            std::condition_variable _decoded;
+            std::thread _worker;
+            bool _stop{false};
+            uint64_t _generation{0}; // Bumped by setImages, a decode for an older list is dropped.
+
+            std::vector<std::string> _paths;
+            std::map<size_t, Entry> _entries; // The shown image lives in the entity, not in here.
+            size_t _current{NO_IMAGE};
+            uint64_t _clock{0};
+
+            void workerLoop();
+            // The window around the shown image, nearest first.
+            std::vector<size_t> getWindow() const;
+            VkDeviceSize getHostUsage() const;
+            VkDeviceSize getDeviceUsage() const;
+            bool cachesTextures() const;
+            // Within the device budget and the heap slots left for prefetching.
+            bool canTile(const Veloxr::VeloxrBuffer& buffer) const;
+            void trim();
+
+            static std::shared_ptr<Veloxr::VeloxrBuffer> decode(const std::string& path);
+            static VkDeviceSize getDeviceBytes(const Veloxr::VVTexture& texture);
+    };
+}
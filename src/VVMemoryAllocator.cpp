@@ -0,0 +1,315 @@
+#include "VVMemoryAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace Veloxr {
+
+    static inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+    }
+
+    VVMemoryAllocator::VVMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice): _device(device), _physicalDevice(physicalDevice) {
+        vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &_memoryProperties);
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+        _bufferImageGranularity = std::max<VkDeviceSize>(1, deviceProperties.limits.bufferImageGranularity);
+
+        _dedicatedCount.resize(_memoryProperties.memoryTypeCount, 0);
+        _dedicatedBytes.resize(_memoryProperties.memoryTypeCount, 0);
+        console.logc2("Created allocator with ", _memoryProperties.memoryTypeCount, " memory types, bufferImageGranularity = ", _bufferImageGranularity);
+    }
+
+    uint32_t VVMemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    VkDeviceSize VVMemoryAllocator::blockSizeForType(uint32_t memoryTypeIndex) const {
+        auto heapIndex = _memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+        auto heapSize = _memoryProperties.memoryHeaps[heapIndex].size;
+        // Small heaps (BAR, integrated carve outs) get smaller blocks so one pool can't starve the heap.
+        return std::min(DEFAULT_BLOCK_SIZE, std::max<VkDeviceSize>(heapSize / 8, 16ull * 1024 * 1024));
+    }
+
+    VVAllocation VVMemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear) {
+        uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+        VkDeviceSize blockSize = blockSizeForType(memoryTypeIndex);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (requirements.size > blockSize / 2) {
+            return allocateDedicated(memoryTypeIndex, requirements.size);
+        }
+
+        bool splitPools = _bufferImageGranularity > 1;
+        uint32_t key = memoryTypeIndex * 2 + ((splitPools && linear) ? 1 : 0);
+        auto& pool = _pools[key];
+        pool.memoryTypeIndex = memoryTypeIndex;
+
+        VkDeviceSize alignment = requirements.alignment;
+
+        VVAllocation allocation{};
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.size = requirements.size;
+
+        // Fullest blocks first keeps the tail blocks empty so they can be recycled / trimmed.
+        std::vector<Veloxr::VVMemoryBlock*> candidates;
+        for (auto& block : pool.blocks) candidates.push_back(block.get());
+        std::stable_sort(candidates.begin(), candidates.end(), [](auto* a, auto* b) { return a->used > b->used; });
+
+        for (auto* block : candidates) {
+            VkDeviceSize offset;
+            if (allocateFromBlock(*block, requirements.size, alignment, offset)) {
+                allocation.memory = block->memory;
+                allocation.offset = offset;
+                allocation.block = block;
+                allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+                return allocation;
+            }
+        }
+
+        auto* block = createBlock(pool, blockSize);
+        if (!block) {
+            // Out of memory for a whole block, hand back what we hold and try the exact size.
+            for (auto& [_, other] : _pools) releaseEmptyBlocks(other, 0);
+            return allocateDedicated(memoryTypeIndex, requirements.size);
+        }
+
+        VkDeviceSize offset;
+        if (!allocateFromBlock(*block, requirements.size, alignment, offset)) {
+            throw std::runtime_error("failed to sub-allocate from a fresh memory block!");
+        }
+        allocation.memory = block->memory;
+        allocation.offset = offset;
+        allocation.block = block;
+        allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+        return allocation;
+    }
+
+    bool VVMemoryAllocator::allocateFromBlock(Veloxr::VVMemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset) {
+        for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+            VkDeviceSize rangeStart = it->first;
+            VkDeviceSize rangeEnd = it->first + it->second;
+            VkDeviceSize alignedStart = alignUp(rangeStart, alignment);
+            if (alignedStart + size > rangeEnd) continue;
+
+            block.freeRanges.erase(it);
+            if (alignedStart > rangeStart) block.freeRanges[rangeStart] = alignedStart - rangeStart;
+            if (alignedStart + size < rangeEnd) block.freeRanges[alignedStart + size] = rangeEnd - (alignedStart + size);
+
+            block.used += size;
+            block.allocationCount++;
+            outOffset = alignedStart;
+            return true;
+        }
+        return false;
+    }
+
+    Veloxr::VVMemoryBlock* VVMemoryAllocator::createBlock(Pool& pool, VkDeviceSize size) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = pool.memoryTypeIndex;
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(_device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            console.warn("Failed to allocate a ", size / 1024 / 1024, " MB block for memory type ", pool.memoryTypeIndex);
+            return nullptr;
+        }
+
+        auto block = std::make_unique<Veloxr::VVMemoryBlock>();
+        block->memory = memory;
+        block->size = size;
+        block->freeRanges[0] = size;
+        if (_memoryProperties.memoryTypes[pool.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            vkMapMemory(_device, memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+        }
+        console.logc2("New ", size / 1024 / 1024, " MB block for memory type ", pool.memoryTypeIndex);
+
+        pool.blocks.push_back(std::move(block));
+        return pool.blocks.back().get();
+    }
+
+    VVAllocation VVMemoryAllocator::allocateDedicated(uint32_t memoryTypeIndex, VkDeviceSize size) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+        VVAllocation allocation{};
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.size = size;
+        if (vkAllocateMemory(_device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory!");
+        }
+        if (_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            vkMapMemory(_device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mapped);
+        }
+        _dedicatedCount[memoryTypeIndex]++;
+        _dedicatedBytes[memoryTypeIndex] += size;
+        return allocation;
+    }
+
+    VVAllocation VVMemoryAllocator::importHostPointer(void* hostPointer, VkDeviceSize size) {
+        VVAllocation allocation{};
+#ifdef VK_EXT_external_memory_host
+        auto getMemoryHostPointerProperties = (PFN_vkGetMemoryHostPointerPropertiesEXT) vkGetDeviceProcAddr(_device, "vkGetMemoryHostPointerPropertiesEXT");
+        if (!getMemoryHostPointerProperties) return allocation;
+
+        VkMemoryHostPointerPropertiesEXT hostPointerProperties{};
+        hostPointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+        if (getMemoryHostPointerProperties(_device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, hostPointer, &hostPointerProperties) != VK_SUCCESS ||
+                hostPointerProperties.memoryTypeBits == 0) {
+            return allocation;
+        }
+
+        VkImportMemoryHostPointerInfoEXT importInfo{};
+        importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+        importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+        importInfo.pHostPointer = hostPointer;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = &importInfo;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = findMemoryType(hostPointerProperties.memoryTypeBits, 0);
+
+        if (vkAllocateMemory(_device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS) {
+            console.warn("Failed to import ", size / 1024, " KB of host memory.");
+            return {};
+        }
+        allocation.size = size;
+        allocation.memoryTypeIndex = allocInfo.memoryTypeIndex;
+        allocation.mapped = hostPointer;
+        allocation.imported = true;
+#endif
+        return allocation;
+    }
+
+    void VVMemoryAllocator::free(VVAllocation& allocation) {
+        if (!allocation.isValid()) return;
+
+        if (allocation.imported) {
+            vkFreeMemory(_device, allocation.memory, nullptr);
+            allocation = {};
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (!allocation.block) {
+            if (allocation.mapped) vkUnmapMemory(_device, allocation.memory);
+            vkFreeMemory(_device, allocation.memory, nullptr);
+            _dedicatedCount[allocation.memoryTypeIndex]--;
+            _dedicatedBytes[allocation.memoryTypeIndex] -= allocation.size;
+            allocation = {};
+            return;
+        }
+
+        auto* block = allocation.block;
+        VkDeviceSize start = allocation.offset;
+        VkDeviceSize end = allocation.offset + allocation.size;
+
+        // Coalesce with the neighbouring free ranges.
+        auto next = block->freeRanges.lower_bound(start);
+        if (next != block->freeRanges.end() && next->first == end) {
+            end += next->second;
+            next = block->freeRanges.erase(next);
+        }
+        if (next != block->freeRanges.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == start) {
+                start = prev->first;
+                block->freeRanges.erase(prev);
+            }
+        }
+        block->freeRanges[start] = end - start;
+        block->used -= allocation.size;
+        block->allocationCount--;
+
+        if (block->allocationCount == 0) {
+            for (auto& [_, pool] : _pools) {
+                if (pool.memoryTypeIndex == allocation.memoryTypeIndex) releaseEmptyBlocks(pool, _maxRetainedEmptyBlocks);
+            }
+        }
+        allocation = {};
+    }
+
+    void VVMemoryAllocator::releaseEmptyBlocks(Pool& pool, uint32_t keep) {
+        uint32_t kept = 0;
+        for (auto it = pool.blocks.begin(); it != pool.blocks.end();) {
+            auto& block = *it;
+            if (block->allocationCount != 0) { ++it; continue; }
+            if (kept < keep) { kept++; ++it; continue; }
+
+            if (block->mapped) vkUnmapMemory(_device, block->memory);
+            vkFreeMemory(_device, block->memory, nullptr);
+            it = pool.blocks.erase(it);
+        }
+    }
+
+    std::vector<Veloxr::VVHeapStats> VVMemoryAllocator::getHeapStats() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<Veloxr::VVHeapStats> stats(_memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < _memoryProperties.memoryHeapCount; i++) {
+            stats[i].heapSize = _memoryProperties.memoryHeaps[i].size;
+        }
+
+        for (const auto& [_, pool] : _pools) {
+            auto& heap = stats[_memoryProperties.memoryTypes[pool.memoryTypeIndex].heapIndex];
+            for (const auto& block : pool.blocks) {
+                heap.blockBytes += block->size;
+                heap.allocatedBytes += block->used;
+                heap.allocationCount += block->allocationCount;
+                heap.blockCount++;
+            }
+        }
+
+        for (uint32_t type = 0; type < _memoryProperties.memoryTypeCount; type++) {
+            auto& heap = stats[_memoryProperties.memoryTypes[type].heapIndex];
+            heap.blockBytes += _dedicatedBytes[type];
+            heap.allocatedBytes += _dedicatedBytes[type];
+            heap.allocationCount += _dedicatedCount[type];
+            heap.dedicatedCount += _dedicatedCount[type];
+        }
+        return stats;
+    }
+
+    void VVMemoryAllocator::logStats() const {
+        auto stats = getHeapStats();
+        for (size_t i = 0; i < stats.size(); i++) {
+            const auto& s = stats[i];
+            console.log("Heap ", i, ": ", s.allocatedBytes / 1024 / 1024, " / ", s.blockBytes / 1024 / 1024, " MB used in ",
+                    s.blockCount, " blocks + ", s.dedicatedCount, " dedicated, ", s.allocationCount, " allocations. Heap size ", s.heapSize / 1024 / 1024, " MB");
+        }
+    }
+
+    void VVMemoryAllocator::trim() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& [_, pool] : _pools) releaseEmptyBlocks(pool, 0);
+    }
+
+    void VVMemoryAllocator::destroy() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_device) return;
+        for (auto& [_, pool] : _pools) {
+            for (auto& block : pool.blocks) {
+                if (block->allocationCount) console.warn("Destroying block with ", block->allocationCount, " live allocations.");
+                if (block->mapped) vkUnmapMemory(_device, block->memory);
+                vkFreeMemory(_device, block->memory, nullptr);
+            }
+        }
+        _pools.clear();
+        _device = VK_NULL_HANDLE;
+    }
+
+    VVMemoryAllocator::~VVMemoryAllocator() {
+        destroy();
+    }
+}
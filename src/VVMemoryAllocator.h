@@ -0,0 +1,105 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    struct VVMemoryBlock;
+
+    // Handle to a sub-range of a pooled VkDeviceMemory block (or a dedicated allocation when block is null).
+    struct VVAllocation {
+        VkDeviceMemory memory{VK_NULL_HANDLE};
+        VkDeviceSize offset{0};
+        VkDeviceSize size{0};
+        void* mapped{nullptr}; // Already offset. Only set for host visible memory.
+        uint32_t memoryTypeIndex{0};
+        VVMemoryBlock* block{nullptr};
+        bool imported{false}; // Wraps host memory we don't own, see importHostPointer.
+
+        inline bool isValid() const { return memory != VK_NULL_HANDLE; }
+    };
+
+    struct VVHeapStats {
+        VkDeviceSize heapSize{0};
+        VkDeviceSize blockBytes{0};      // Memory reserved from the driver, including dedicated allocations.
+        VkDeviceSize allocatedBytes{0};  // Memory handed out to resources.
+        uint32_t blockCount{0};
+        uint32_t dedicatedCount{0};
+        uint32_t allocationCount{0};
+    };
+
+    struct VVMemoryBlock {
+        VkDeviceMemory memory{VK_NULL_HANDLE};
+        VkDeviceSize size{0};
+        VkDeviceSize used{0};
+        uint32_t allocationCount{0};
+        void* mapped{nullptr};
+        // offset -> size, coalesced on free.
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+    };
+
+    /**
+     * Pools VkDeviceMemory per memory type and sub-allocates buffers and images out of large blocks.
+     *
+     * Linear (buffers, linear images) and optimal resources are kept in separate pools when the device
+     * reports a bufferImageGranularity > 1, so neighbours never violate the granularity rule.
+     * Empty blocks are retained for reuse across entity destroy / reload cycles, call trim() to hand them back.
+     */
+    class VVMemoryAllocator {
+        public:
+            VVMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice);
+            ~VVMemoryAllocator();
+
+            VVAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear);
+            void free(VVAllocation& allocation);
+
+            // VK_EXT_external_memory_host. Wraps size bytes at hostPointer as device memory, the caller keeps the
+            // host memory alive until the allocation is freed. Returns an invalid allocation when the import fails.
+            VVAllocation importHostPointer(void* hostPointer, VkDeviceSize size);
+
+            uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+            const VkPhysicalDeviceMemoryProperties& getMemoryProperties() const { return _memoryProperties; }
+
+            std::vector<Veloxr::VVHeapStats> getHeapStats() const;
+            void logStats() const;
+
+            // Release every empty block back to the driver.
+            void trim();
+            void destroy();
+
+            inline void setMaxRetainedEmptyBlocks(uint32_t count) { _maxRetainedEmptyBlocks = count; }
+
+        private:
+            inline static LLogger console{"[Veloxr][VVMemoryAllocator] "};
+            static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 256ull * 1024 * 1024;
+
+            struct Pool {
+                uint32_t memoryTypeIndex{0};
+                std::vector<std::unique_ptr<Veloxr::VVMemoryBlock>> blocks;
+            };
+
+            VkDevice _device;
+            VkPhysicalDevice _physicalDevice;
+            VkPhysicalDeviceMemoryProperties _memoryProperties{};
+            VkDeviceSize _bufferImageGranularity{1};
+            uint32_t _maxRetainedEmptyBlocks{1};
+
+            mutable std::mutex _mutex;
+            // Key: memoryTypeIndex * 2 + linear
+            std::map<uint32_t, Pool> _pools;
+            std::vector<uint32_t> _dedicatedCount;
+            std::vector<VkDeviceSize> _dedicatedBytes;
+
+            VkDeviceSize blockSizeForType(uint32_t memoryTypeIndex) const;
+            bool allocateFromBlock(Veloxr::VVMemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset);
+            Veloxr::VVMemoryBlock* createBlock(Pool& pool, VkDeviceSize size);
+            VVAllocation allocateDedicated(uint32_t memoryTypeIndex, VkDeviceSize size);
+            void releaseEmptyBlocks(Pool& pool, uint32_t keep);
+    };
+}
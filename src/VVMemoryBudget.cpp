@@ -0,0 +1,142 @@
+#include "VVMemoryBudget.h"
+#include "CommandUtils.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace Veloxr {
+
+    VVMemoryBudget::VVMemoryBudget(std::shared_ptr<Veloxr::VVDataPacket> data): _data(data), _cap(data->settings.deviceMemoryBudget) {
+        createPlaceholder();
+        update();
+        console.log("Device memory budget: ", _stats.budget / 1024 / 1024, " MB (driver ", _stats.driverBudget / 1024 / 1024,
+                " MB, VK_EXT_memory_budget: ", _data->features.memoryBudget, "), in use: ", _stats.usage / 1024 / 1024, " MB");
+    }
+
+    void VVMemoryBudget::createPlaceholder() {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = { 1, 1, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateImage(_data->device, &imageInfo, nullptr, &_placeholderImage) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create placeholder image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(_data->device, _placeholderImage, &memRequirements);
+        _placeholderMemory = _data->allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+        vkBindImageMemory(_data->device, _placeholderImage, _placeholderMemory.memory, _placeholderMemory.offset);
+
+        VkImageSubresourceRange range{};
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.baseMipLevel = 0;
+        range.levelCount = 1;
+        range.baseArrayLayer = 0;
+        range.layerCount = 1;
+
+        // Tiles are sampled as 2D arrays, the layer index clamps to the single layer.
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = _placeholderImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.format = imageInfo.format;
+        viewInfo.subresourceRange = range;
+        if (vkCreateImageView(_data->device, &viewInfo, nullptr, &_placeholderView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create placeholder image view!");
+        }
+
+        VkCommandBuffer commandBuffer = CommandUtils::beginSingleTimeCommands(_data->device, _data->commandPool);
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = _placeholderImage;
+        barrier.subresourceRange = range;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkClearColorValue transparent{};
+        vkCmdClearColorImage(commandBuffer, _placeholderImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &transparent, 1, &range);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        CommandUtils::endSingleTimeCommands(_data->device, commandBuffer, _data->commandPool, _data->graphicsQueue);
+    }
+
+    void VVMemoryBudget::setCap(VkDeviceSize bytes) {
+        _cap = bytes;
+        console.log("Device memory cap: ", bytes ? std::to_string(bytes / 1024 / 1024) + " MB" : std::string("none"));
+    }
+
+    const Veloxr::VVMemoryBudgetStats& VVMemoryBudget::update() {
+        const auto& memoryProperties = _data->allocator->getMemoryProperties();
+        VkDeviceSize usage = 0, driverBudget = 0;
+
+        if (_data->features.memoryBudget) {
+            // Usage is this process, the budget already accounts for everyone else on the device.
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+            budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+            VkPhysicalDeviceMemoryProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            properties2.pNext = &budgetProperties;
+            vkGetPhysicalDeviceMemoryProperties2(_data->physicalDevice, &properties2);
+
+            for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+                if (!(memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) continue;
+                usage += budgetProperties.heapUsage[i];
+                driverBudget += budgetProperties.heapBudget[i];
+            }
+        } else {
+            // Only our own blocks are known. 80% of the heap is the usual rule of thumb for what is safe to take.
+            const auto heaps = _data->allocator->getHeapStats();
+            for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+                if (!(memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) continue;
+                usage += heaps[i].blockBytes;
+                driverBudget += heaps[i].heapSize / 5 * 4;
+            }
+        }
+
+        const VkDeviceSize budget = _cap ? std::min(_cap, driverBudget) : driverBudget;
+        Veloxr::VVMemoryPressure pressure = Veloxr::VVMemoryPressure::Normal;
+        if (usage > budget) pressure = Veloxr::VVMemoryPressure::Critical;
+        else if (usage > budget * HIGH_WATER) pressure = Veloxr::VVMemoryPressure::High;
+
+        const bool changed = pressure != _stats.pressure;
+        _stats = { usage, budget, driverBudget, pressure };
+        if (changed) {
+            console.warn("Memory pressure ", static_cast<int>(pressure), ": ", usage / 1024 / 1024, " / ", budget / 1024 / 1024, " MB");
+            if (_callback) _callback(_stats);
+        }
+        return _stats;
+    }
+
+    VkDeviceSize VVMemoryBudget::getOverage() const {
+        if (_stats.usage <= _stats.budget) return 0;
+        return _stats.usage - static_cast<VkDeviceSize>(_stats.budget * LOW_WATER);
+    }
+
+    void VVMemoryBudget::destroy() {
+        if (!_data || !_data->device) return;
+        if (_placeholderView) vkDestroyImageView(_data->device, _placeholderView, nullptr);
+        if (_placeholderImage) vkDestroyImage(_data->device, _placeholderImage, nullptr);
+        if (_placeholderMemory.isValid()) _data->allocator->free(_placeholderMemory);
+        _placeholderView = VK_NULL_HANDLE;
+        _placeholderImage = VK_NULL_HANDLE;
+    }
+
+    VVMemoryBudget::~VVMemoryBudget() { destroy(); }
+}
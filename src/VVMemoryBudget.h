@@ -0,0 +1,73 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vulkan/vulkan_core.h>
+
+#include "Common.h"
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    enum class VVMemoryPressure : uint8_t {
+        Normal,
+        High,     // Above HIGH_WATER of the budget.
+        Critical  // Over budget, tiles are being evicted.
+    };
+
+    struct VVMemoryBudgetStats {
+        VkDeviceSize usage{0};  // Device local bytes used by this process.
+        VkDeviceSize budget{0}; // min(driver budget, app cap).
+        VkDeviceSize driverBudget{0};
+        Veloxr::VVMemoryPressure pressure{Veloxr::VVMemoryPressure::Normal};
+    };
+
+    /**
+     * Tracks device local memory against VK_EXT_memory_budget (or the allocator's own numbers and the heap size
+     * when the extension is missing) and an optional app cap, so Veloxr can make room for other GPU users.
+     * EntityManager::updateResidency evicts tiles while getOverage() is non zero; evicted tiles sample the
+     * transparent placeholder image until they are uploaded again.
+     */
+    class VVMemoryBudget {
+        public:
+            static constexpr double HIGH_WATER = 0.85;
+            // Eviction frees down to this fraction of the budget so a tile coming back does not evict again.
+            static constexpr double LOW_WATER = 0.75;
+
+            VVMemoryBudget(std::shared_ptr<Veloxr::VVDataPacket> data);
+            ~VVMemoryBudget();
+
+            // 0 follows the driver budget only.
+            void setCap(VkDeviceSize bytes);
+            inline VkDeviceSize getCap() const { return _cap; }
+
+            // Fired from update() whenever the pressure level changes.
+            void setPressureCallback(std::function<void(const Veloxr::VVMemoryBudgetStats&)> callback) { _callback = std::move(callback); }
+
+            // Re-reads the heaps. Cheap enough to call every frame.
+            const Veloxr::VVMemoryBudgetStats& update();
+            inline const Veloxr::VVMemoryBudgetStats& getStats() const { return _stats; }
+
+            // Bytes to free to get back to LOW_WATER, 0 while within budget.
+            VkDeviceSize getOverage() const;
+
+            // 1x1 transparent 2D array image bound in place of evicted tiles.
+            inline VkImageView getPlaceholderView() const { return _placeholderView; }
+
+            void destroy();
+
+        private:
+            inline static LLogger console{"[Veloxr][VVMemoryBudget] "};
+
+            std::shared_ptr<Veloxr::VVDataPacket> _data;
+            VkDeviceSize _cap{0};
+            Veloxr::VVMemoryBudgetStats _stats{};
+            std::function<void(const Veloxr::VVMemoryBudgetStats&)> _callback;
+
+            VkImage _placeholderImage{VK_NULL_HANDLE};
+            Veloxr::VVAllocation _placeholderMemory{};
+            VkImageView _placeholderView{VK_NULL_HANDLE};
+
+            void createPlaceholder();
+    };
+}
@@ -0,0 +1,242 @@
+#include "VVRGBExpander.h"
+#include "VVUtils.h"
+#include <array>
+#include <filesystem>
+#include <stdexcept>
+
+namespace Veloxr {
+
+    VVRGBExpander::VVRGBExpander(std::shared_ptr<Veloxr::VVDataPacket> data): _data(data) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(_data->physicalDevice, &properties);
+        _maxStorageBufferRange = properties.limits.maxStorageBufferRange;
+
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(_data->physicalDevice, IMAGE_FORMAT, &formatProperties);
+        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+            console.warn("RGBA8 storage images not supported, RGB tiles are expanded on the CPU.");
+            return;
+        }
+        if (!_data->features.graphicsQueueCompute) {
+            console.warn("Graphics queue has no compute support, RGB tiles are expanded on the CPU.");
+            return;
+        }
+
+        const auto shaderPath = std::filesystem::path(_data->shaderDirectory) / "rgb_expand.spv";
+        if (_data->shaderDirectory.empty() || !std::filesystem::exists(shaderPath)) {
+            console.warn("Missing ", shaderPath.string(), ", RGB tiles are expanded on the CPU.");
+            return;
+        }
+
+        try {
+            createPipeline();
+        } catch (const std::exception& e) {
+            // An unreadable or outdated binary is no reason to fail the upload path.
+            console.warn("GPU RGB expansion unavailable (", e.what(), "), RGB tiles are expanded on the CPU.");
+            destroy();
+            return;
+        }
+        console.log("GPU RGB expansion enabled, max storage buffer range: ", (_maxStorageBufferRange / 1024.0 / 1024.0), " MB");
+    }
+
+    void VVRGBExpander::createPipeline() {
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(_data->device, &layoutInfo, nullptr, &_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create rgb expand descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(uint32_t) * 2;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(_data->device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create rgb expand pipeline layout!");
+        }
+
+        auto shaderCode = VVUtils::readFile((std::filesystem::path(_data->shaderDirectory) / "rgb_expand.spv").string());
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(_data->device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = _pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(_data->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline);
+        vkDestroyShaderModule(_data->device, shaderModule, nullptr);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create rgb expand pipeline!");
+        }
+
+        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[0].descriptorCount = MAX_DISPATCHES;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSizes[1].descriptorCount = MAX_DISPATCHES;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = MAX_DISPATCHES;
+        if (vkCreateDescriptorPool(_data->device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create rgb expand descriptor pool!");
+        }
+    }
+
+    bool VVRGBExpander::supportsExtent(uint32_t width, uint32_t height) const {
+        return isValid() && static_cast<VkDeviceSize>(width) * height * 3 <= _maxStorageBufferRange;
+    }
+
+    void VVRGBExpander::recordBarrier(VkCommandBuffer commandBuffer, VkImage image, uint32_t layer, VkImageLayout oldLayout, VkImageLayout newLayout) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = layer;
+        barrier.subresourceRange.layerCount = 1;
+
+        VkPipelineStageFlags sourceStage;
+        VkPipelineStageFlags destinationStage;
+        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        } else {
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            sourceStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    void VVRGBExpander::record(VkCommandBuffer commandBuffer, VkBuffer packedPixels, VkImage image, uint32_t layer, uint32_t width, uint32_t height) {
+        if (isFull()) {
+            throw std::runtime_error("rgb expander is full, reset() after submitting!");
+        }
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = IMAGE_FORMAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = layer;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView storageView;
+        if (vkCreateImageView(_data->device, &viewInfo, nullptr, &storageView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create rgb expand image view!");
+        }
+        _views.push_back(storageView);
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = _descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &_descriptorSetLayout;
+
+        VkDescriptorSet descriptorSet;
+        if (vkAllocateDescriptorSets(_data->device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate rgb expand descriptor set!");
+        }
+
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = packedPixels;
+        bufferInfo.offset = 0;
+        bufferInfo.range = VK_WHOLE_SIZE;
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageView = storageView;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = descriptorSet;
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[0].pBufferInfo = &bufferInfo;
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = descriptorSet;
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(_data->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+        recordBarrier(commandBuffer, image, layer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+        const uint32_t extent[2] = { width, height };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(extent), extent);
+        vkCmdDispatch(commandBuffer, (width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+        recordBarrier(commandBuffer, image, layer, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    void VVRGBExpander::reset() {
+        for (auto view : _views) {
+            vkDestroyImageView(_data->device, view, nullptr);
+        }
+        _views.clear();
+        if (_descriptorPool) vkResetDescriptorPool(_data->device, _descriptorPool, 0);
+    }
+
+    void VVRGBExpander::destroy() {
+        if (!_data || !_data->device) return;
+        reset();
+        if (_descriptorPool) vkDestroyDescriptorPool(_data->device, _descriptorPool, nullptr);
+        if (_pipeline) vkDestroyPipeline(_data->device, _pipeline, nullptr);
+        if (_pipelineLayout) vkDestroyPipelineLayout(_data->device, _pipelineLayout, nullptr);
+        if (_descriptorSetLayout) vkDestroyDescriptorSetLayout(_data->device, _descriptorSetLayout, nullptr);
+        _descriptorPool = VK_NULL_HANDLE;
+        _pipeline = VK_NULL_HANDLE;
+        _pipelineLayout = VK_NULL_HANDLE;
+        _descriptorSetLayout = VK_NULL_HANDLE;
+    }
+
+    VVRGBExpander::~VVRGBExpander() { destroy(); }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "Common.h"
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    /**
+     * Compute pass that expands packed 8 bit RGB staging data into RGBA8 tile images (spirv/rgb_expand.spv).
+     * Saves the CPU expansion and a third of the transfer for 3 channel sources.
+     *
+     * Target images are R8G8B8A8_UNORM with VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT, written through a UNORM storage view
+     * and sampled through the tile's sRGB view. Per tile views and descriptor sets live until reset().
+     */
+    class VVRGBExpander {
+        public:
+            static constexpr VkFormat IMAGE_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+            static constexpr uint32_t MAX_DISPATCHES = 64;
+
+            VVRGBExpander(std::shared_ptr<Veloxr::VVDataPacket> data);
+            ~VVRGBExpander();
+
+            inline bool isValid() const { return _pipeline != VK_NULL_HANDLE; }
+            inline bool isFull() const { return _views.size() >= MAX_DISPATCHES; }
+
+            // Largest tile the storage buffer binding can cover.
+            bool supportsExtent(uint32_t width, uint32_t height) const;
+
+            // Records UNDEFINED -> GENERAL, the dispatch and GENERAL -> SHADER_READ_ONLY for one tile (one layer of image).
+            void record(VkCommandBuffer commandBuffer, VkBuffer packedPixels, VkImage image, uint32_t layer, uint32_t width, uint32_t height);
+
+            // Call once the command buffer holding the recorded dispatches has completed.
+            void reset();
+            void destroy();
+
+        private:
+            inline static LLogger console{"[Veloxr][VVRGBExpander] "};
+            static constexpr uint32_t WORKGROUP_SIZE = 16;
+
+            std::shared_ptr<Veloxr::VVDataPacket> _data;
+            VkDeviceSize _maxStorageBufferRange{0};
+
+            VkDescriptorSetLayout _descriptorSetLayout{VK_NULL_HANDLE};
+            VkPipelineLayout _pipelineLayout{VK_NULL_HANDLE};
+            VkPipeline _pipeline{VK_NULL_HANDLE};
+            VkDescriptorPool _descriptorPool{VK_NULL_HANDLE};
+            std::vector<VkImageView> _views;
+
+            void createPipeline();
+            void recordBarrier(VkCommandBuffer commandBuffer, VkImage image, uint32_t layer, VkImageLayout oldLayout, VkImageLayout newLayout);
+    };
+}
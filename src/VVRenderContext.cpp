@@ -0,0 +1,135 @@
+#include "VVRenderContext.h"
+#include "device.h"
+#include "EntityManager.h"
+#include "TileManager.h"
+#include "VVDescriptorHeap.h"
+#include "VVImagePrefetcher.h"
+#include "VVMemoryAllocator.h"
+#include "VVMemoryBudget.h"
+#include "VVSamplerCache.h"
+#include "VVTileCache.h"
+#include "VVTileUploader.h"
+#include "VVVirtualTextureCache.h"
+#include <filesystem>
+#include <stdexcept>
+
+namespace Veloxr {
+
+    VVRenderContext::VVRenderContext(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, VkSurfaceKHR surface,
+            const Veloxr::VVRenderSettings& settings, bool enableValidationLayers, uint32_t instanceApiVersion,
+            const std::string& shaderDirectory): _instance(instance), _debugMessenger(debugMessenger) {
+        _device = std::make_shared<Veloxr::Device>(instance, surface, enableValidationLayers, instanceApiVersion);
+        _device->create();
+
+        _data = std::make_shared<Veloxr::VVDataPacket>();
+        _data->device = _device->getLogicalDevice();
+        _data->physicalDevice = _device->getPhysicalDevice();
+        _data->graphicsQueue = _device->getGraphicsQueue();
+        _data->presentQueue = _device->getPresentationQueue();
+        _data->features = _device->getFeatures();
+        _data->settings = settings;
+        _data->allocator = std::make_shared<Veloxr::VVMemoryAllocator>(_data->device, _data->physicalDevice);
+        _data->samplerCache = std::make_shared<Veloxr::VVSamplerCache>(_data->device);
+
+        createCommandPool();
+
+        _data->shaderDirectory = shaderDirectory;
+        _data->tileCache = std::make_shared<Veloxr::VVTileCache>(settings.tileCacheDirectory.empty() ?
+                std::filesystem::temp_directory_path() / "veloxr_tile_cache" : std::filesystem::path(settings.tileCacheDirectory),
+                settings.tileCacheMaxBytes);
+        _data->uploader = Veloxr::VVTileUploader::create(_data);
+        _data->memoryBudget = std::make_shared<Veloxr::VVMemoryBudget>(_data);
+        if (settings.bindlessDescriptors && _data->features.descriptorIndexing) {
+            _data->descriptorHeap = std::make_shared<Veloxr::VVDescriptorHeap>(_data->device, _data->physicalDevice, Veloxr::TileManager::MAX_SLOTS);
+        }
+        console.log("Bindless tile descriptors: ", _data->descriptorHeap != nullptr);
+        if (settings.virtualTextures) {
+            if (_data->descriptorHeap && _data->features.fragmentStoresAndAtomics) {
+                _data->virtualTextures = std::make_shared<Veloxr::VVVirtualTextureCache>(_data, settings.virtualTextureCacheSize);
+            } else {
+                console.warn("Virtual textures need bindless descriptors and fragment stores, entities are tiled as usual.");
+            }
+        }
+        console.log("Tile upload path: ", _data->uploader->getName());
+        _entityManager = std::make_shared<Veloxr::EntityManager>(_data);
+        _imagePrefetcher = std::make_shared<Veloxr::VVImagePrefetcher>(_data);
+    }
+
+    void VVRenderContext::createCommandPool() {
+        // Uploads and single time commands, every viewport records its frames from a pool of its own.
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = _device->getQueueFamilies().graphicsFamily.value();
+
+        if (vkCreateCommandPool(_data->device, &poolInfo, nullptr, &_data->commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create command pool!");
+        }
+    }
+
+    void VVRenderContext::attachViewport(uint32_t view) {
+        _viewports.insert(view);
+    }
+
+    bool VVRenderContext::detachViewport(uint32_t view) {
+        _viewports.erase(view);
+        _updatedViewports.erase(view);
+        return _viewports.empty();
+    }
+
+    void VVRenderContext::update(uint32_t view) {
+        // N viewports would otherwise read feedback, upload and wait on the queue N times a frame.
+        const bool newRound = _updatedViewports.count(view) > 0 || _updatedViewports.empty();
+        if (!newRound) {
+            _updatedViewports.insert(view);
+            return;
+        }
+        _updatedViewports = { view };
+
+        _entityManager->updateEntities();
+        if (_data->virtualTextures && _data->virtualTextures->update()) _entityManager->markChanged();
+        _entityManager->uploadPendingTiles();
+        _entityManager->updateResidency();
+        _entityManager->uploadRegions();
+        _imagePrefetcher->update();
+    }
+
+    bool VVRenderContext::hasPendingWork() const {
+        return (_entityManager && _entityManager->hasPendingUploads()) || (_imagePrefetcher && _imagePrefetcher->hasPendingWork());
+    }
+
+    void VVRenderContext::destroy() {
+        if (!_data || !_data->device) return;
+        console.logc1(__func__);
+        vkDeviceWaitIdle(_data->device);
+
+        if (_imagePrefetcher) _imagePrefetcher->destroy();
+        _imagePrefetcher.reset();
+        if (_entityManager) _entityManager->destroy();
+        _entityManager.reset();
+        if (_data->virtualTextures) _data->virtualTextures->destroy();
+        _data->virtualTextures.reset();
+        if (_data->memoryBudget) _data->memoryBudget->destroy();
+        _data->memoryBudget.reset();
+        if (_data->descriptorHeap) _data->descriptorHeap->destroy();
+        _data->descriptorHeap.reset();
+        _data->samplerCache->destroy();
+        _data->uploader.reset();
+        _data->allocator->logStats();
+        _data->allocator->destroy();
+
+        vkDestroyCommandPool(_data->device, _data->commandPool, nullptr);
+        vkDestroyDevice(_data->device, nullptr);
+        _data->device = VK_NULL_HANDLE;
+
+        if (_debugMessenger) {
+            auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(_instance, "vkDestroyDebugUtilsMessengerEXT");
+            if (func != nullptr) func(_instance, _debugMessenger, nullptr);
+            _debugMessenger = VK_NULL_HANDLE;
+        }
+        vkDestroyInstance(_instance, nullptr);
+        _instance = VK_NULL_HANDLE;
+    }
+
+    VVRenderContext::~VVRenderContext() { destroy(); }
+}
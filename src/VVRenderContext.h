@@ -0,0 +1,72 @@
+#pragma once
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vulkan/vulkan_core.h>
+
+#include "Common.h"
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    class Device;
+    class EntityManager;
+    class VVImagePrefetcher;
+
+    /**
+     * Everything a RendererCore renders from that does not belong to its window: the instance, the device and
+     * queues, the VVDataPacket subsystems (allocator, samplers, uploader, caches, descriptor heap, memory budget)
+     * and the EntityManager with every uploaded tile.
+     *
+     * The first RendererCore::init creates it, further viewports join it with RendererCore::init(window, context)
+     * and only add a surface, swapchain, pipeline, command buffers, a camera and a view (VVShaderStageData) of
+     * their own. The context goes when the last attached viewport is destroyed, handles the client still holds
+     * (RendererCore::getRenderContext) cannot be joined after that.
+     *
+     * The viewports share one graphics queue, drawFrame of all of them must be called from the same thread.
+     */
+    class VVRenderContext {
+        public:
+            // Takes over the instance and debug messenger. surface is only used to pick a device that presents to it.
+            VVRenderContext(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, VkSurfaceKHR surface,
+                    const Veloxr::VVRenderSettings& settings, bool enableValidationLayers, uint32_t instanceApiVersion,
+                    const std::string& shaderDirectory);
+            ~VVRenderContext();
+
+            // Viewports drawing from the context, by their VVShaderStageData view. detachViewport returns whether it
+            // was the last one.
+            void attachViewport(uint32_t view);
+            bool detachViewport(uint32_t view);
+            inline bool isValid() const { return _data && _data->device; }
+
+            // The per frame work on the shared tiles: entity state, virtual texture feedback, the next tile upload wave,
+            // residency, region uploads and prefetching. Each viewport calls it after its fence, the work runs once per round of viewports: on
+            // the first call, then again once a viewport calls a second time. The residency keeps every view's tiles.
+            void update(uint32_t view);
+            // Background work update() still has to pick up, render on demand keeps calling it while there is some.
+            bool hasPendingWork() const;
+
+            inline VkInstance getInstance() const { return _instance; }
+            inline std::shared_ptr<Veloxr::Device> getDevice() const { return _device; }
+            inline std::shared_ptr<Veloxr::VVDataPacket> getDataPacket() const { return _data; }
+            inline std::shared_ptr<Veloxr::EntityManager> getEntityManager() const { return _entityManager; }
+            inline std::shared_ptr<Veloxr::VVImagePrefetcher> getImagePrefetcher() const { return _imagePrefetcher; }
+
+            void destroy();
+
+        private:
+            inline static LLogger console{"[Veloxr][VVRenderContext] "};
+
+            VkInstance _instance{VK_NULL_HANDLE};
+            VkDebugUtilsMessengerEXT _debugMessenger{VK_NULL_HANDLE};
+            std::shared_ptr<Veloxr::Device> _device;
+            std::shared_ptr<Veloxr::VVDataPacket> _data;
+            std::shared_ptr<Veloxr::EntityManager> _entityManager;
+            std::shared_ptr<Veloxr::VVImagePrefetcher> _imagePrefetcher;
+            std::set<uint32_t> _viewports;
+            std::set<uint32_t> _updatedViewports; // Called update() since the work last ran.
+
+            void createCommandPool();
+    };
+}
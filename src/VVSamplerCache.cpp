@@ -0,0 +1,62 @@
+#include "VVSamplerCache.h"
+#include <stdexcept>
+
+namespace Veloxr {
+
+    VVSamplerCache::VVSamplerCache(VkDevice device): _device(device) {}
+
+    VkSampler VVSamplerCache::getSampler(const Veloxr::VVSamplerKey& key) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto findIt = _samplers.find(key);
+        if (findIt != _samplers.end()) return findIt->second;
+
+        VkSampler sampler = createSampler(key);
+        _samplers.emplace(key, sampler);
+        console.logc1("Created sampler ", _samplers.size(), " for filter ", key.magFilter, "/", key.minFilter, " address mode ", key.addressMode);
+        return sampler;
+    }
+
+    VkSampler VVSamplerCache::createSampler(const Veloxr::VVSamplerKey& key) {
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = key.magFilter;
+        samplerInfo.minFilter = key.minFilter;
+        samplerInfo.addressModeU = key.addressMode;
+        samplerInfo.addressModeV = key.addressMode;
+        samplerInfo.addressModeW = key.addressMode;
+
+        samplerInfo.anisotropyEnable = key.maxAnisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+        samplerInfo.maxAnisotropy = key.maxAnisotropy;
+        samplerInfo.borderColor = key.borderColor;
+
+        // false = normalized, true = [0, texWidth], [0, texHeight]
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+        // Shadow mapping, ignore.
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+
+        samplerInfo.mipmapMode = key.mipmapMode;
+        samplerInfo.mipLodBias = 0.0f;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = key.maxLod;
+
+        VkSampler sampler;
+        if (vkCreateSampler(_device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture sampler!");
+        }
+        return sampler;
+    }
+
+    void VVSamplerCache::destroy() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_device) return;
+        for (auto& [_, sampler] : _samplers) {
+            vkDestroySampler(_device, sampler, nullptr);
+        }
+        console.log("Destroyed ", _samplers.size(), " cached samplers.");
+        _samplers.clear();
+    }
+
+    VVSamplerCache::~VVSamplerCache() { destroy(); }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vulkan/vulkan_core.h>
+
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    // Sampler state we actually vary. Everything else in VkSamplerCreateInfo is fixed by the cache.
+    struct VVSamplerKey {
+        VkFilter magFilter{VK_FILTER_NEAREST};
+        VkFilter minFilter{VK_FILTER_NEAREST};
+        VkSamplerMipmapMode mipmapMode{VK_SAMPLER_MIPMAP_MODE_LINEAR};
+        VkSamplerAddressMode addressMode{VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER};
+        VkBorderColor borderColor{VK_BORDER_COLOR_INT_OPAQUE_BLACK};
+        float maxLod{0.0f};
+        float maxAnisotropy{1.0f};
+
+        inline bool operator<(const VVSamplerKey& other) const {
+            return std::tie(magFilter, minFilter, mipmapMode, addressMode, borderColor, maxLod, maxAnisotropy)
+                 < std::tie(other.magFilter, other.minFilter, other.mipmapMode, other.addressMode, other.borderColor, other.maxLod, other.maxAnisotropy);
+        }
+    };
+
+    /**
+     * Device wide VkSampler cache. Samplers are deduplicated by VVSamplerKey and owned by the cache,
+     * so tiles only ever hold a borrowed handle and must not destroy it.
+     */
+    class VVSamplerCache {
+        public:
+            VVSamplerCache(VkDevice device);
+            ~VVSamplerCache();
+
+            VkSampler getSampler(const Veloxr::VVSamplerKey& key = {});
+            inline size_t size() const { std::lock_guard<std::mutex> lock(_mutex); return _samplers.size(); }
+
+            void destroy();
+
+        private:
+            inline static LLogger console{"[Veloxr][VVSamplerCache] "};
+
+            VkDevice _device;
+            mutable std::mutex _mutex;
+            std::map<Veloxr::VVSamplerKey, VkSampler> _samplers;
+
+            VkSampler createSampler(const Veloxr::VVSamplerKey& key);
+    };
+}
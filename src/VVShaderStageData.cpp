@@ -2,12 +2,13 @@
 #include "Common.h"
 #include "EntityManager.h"
 #include "RenderEntity.h"
+#include "VVMemoryBudget.h"
 #include <stdexcept>
 
 namespace Veloxr {
     
     VVShaderStageData::VVShaderStageData(std::shared_ptr<VVDataPacket> dataPacket): _data(dataPacket) {
-        _vertices = std::make_shared<std::vector<Veloxr::Vertex>>();
+        _instances = std::make_shared<std::vector<Veloxr::TileInstance>>();
 
     }
 
@@ -19,72 +20,160 @@ namespace Veloxr {
     void VVShaderStageData::setTextureMap(std::unordered_map<std::string, std::shared_ptr<Veloxr::RenderEntity>>& textureMap) {
         console.logc2(__func__);
         _textureMap = textureMap;
-        _vertices->clear();
+        _instances->clear();
 
-        for( auto& [_, entity] : _textureMap) {
-            auto verts = entity->getVertices();
-            console.logc2("Adding ", verts.size(), " entities");
-            _vertices->insert(_vertices->end(), verts.begin(), verts.end());
-            console.logc2("Added ", verts.size(), " entities");
+        std::vector<std::shared_ptr<Veloxr::RenderEntity>> entities;
+        for (auto& [_, entity] : _textureMap) entities.push_back(entity);
+        std::sort(entities.begin(), entities.end(), [](const auto& a, const auto& b) { return a->getUID() < b->getUID(); });
+
+        for( auto& entity : entities) {
+            auto instances = entity->getInstances();
+            console.logc2("Adding ", instances.size(), " instances");
+            _instances->insert(_instances->end(), instances.begin(), instances.end());
+            console.logc2("Added ", instances.size(), " instances");
         }
         console.logc2(__func__, " done.");
     }
     void VVShaderStageData::createStageData() {
         console.logc2(__func__);
-        destroy();
-        if (!_vertices.get() || _vertices->empty()) {
-            console.fatal("Cannot create stage data for empty vertices.");
+        if (!_instances.get()) {
+            console.fatal("Cannot create stage data without instances.");
             throw std::runtime_error("Cannot create stage data with no entities.");
             return;
         }
+        // A crop outside every tile leaves nothing, the buffers and sets stay and no draw is recorded.
+        if (_instances->empty()) console.warn("No instances left to draw.");
+        _version++;
+
+        _tileIndex.build(*_instances);
+
+        // Layout, pool, sets and uniforms stay. Only the instances and, without bindless, the image slots changed.
+        // Bindless tiles already wrote their own descriptors into the heap.
+        if (descriptorSetLayout) {
+            vkDeviceWaitIdle(_data->device);
+            updateVertexBuffer();
+            if (getMaxDrawCount() > _drawCapacity) {
+                _drawCapacity = getMaxDrawCount();
+                for (auto& [_, view] : _views) {
+                    destroyDrawBuffers(view);
+                    createDrawBuffers(view);
+                }
+            }
+            if (!isBindless()) updateImageDescriptors();
+            return;
+        }
 
+        destroy();
         createDescriptorLayout();
-        createUniformBuffers();
+        _drawCapacity = getMaxDrawCount();
+        for (auto& [_, view] : _views) {
+            createUniformBuffers(view);
+            createDrawBuffers(view);
+        }
         createVertexBuffer();
         createDescriptorPool();
-        createDescriptorSets();
+        if (!isBindless()) _imageInfos = collectImageInfos(&_imageGenerations);
+        for (auto& [_, view] : _views) createDescriptorSets(view);
+    }
+
+    uint32_t VVShaderStageData::createView() {
+        console.logc1(__func__);
+        if (_views.size() >= MAX_VIEWS) {
+            throw std::runtime_error("failed to create view, too many views!");
+        }
+        const uint32_t id = _nextView++;
+        auto& view = _views[id];
+        // A viewport added after the stage data was created gets its buffers and sets right away.
+        if (descriptorPool) {
+            createUniformBuffers(view);
+            createDrawBuffers(view);
+            createDescriptorSets(view);
+        }
+        return id;
+    }
+
+    void VVShaderStageData::destroyView(uint32_t view) {
+        console.logc1(__func__);
+        auto findIt = _views.find(view);
+        if (findIt == _views.end()) return;
+        if (_data && _data->device) {
+            vkDeviceWaitIdle(_data->device);
+            destroyViewData(findIt->second);
+        }
+        _views.erase(findIt);
     }
 
     void VVShaderStageData::createVertexBuffer() {
         console.logc1(__func__);
         console.log("Creating vertexBuffer\n");
-        VkDeviceSize bufferSize = sizeof(_vertices->front()) * _vertices->size();
+        // Room to grow, adding entities one by one does not reallocate every time.
+        _instanceCapacity = std::max<size_t>({ 1, _instances->size(), _instanceCapacity * 2 });
+        VkDeviceSize bufferSize = sizeof(Veloxr::TileInstance) * _instanceCapacity;
+
+        VVUtils::createBuffer(_data, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+
+        uploadInstances(0, _instances->size());
+        _uploadedInstances = *_instances;
+    }
+
+    void VVShaderStageData::updateVertexBuffer() {
+        if (!vertexBuffer || _instances->size() > _instanceCapacity) {
+            VVUtils::destroyBuffer(_data, vertexBuffer, vertexBufferMemory);
+            createVertexBuffer();
+            return;
+        }
+
+        // Entities are ordered by id: an added one only changes the end, a re-tiled one its own range and what follows.
+        const auto& instances = *_instances;
+        auto equal = [&](size_t i) { return std::memcmp(&instances[i], &_uploadedInstances[i], sizeof(Veloxr::TileInstance)) == 0; };
+        const size_t common = std::min(instances.size(), _uploadedInstances.size());
+        size_t first = 0;
+        while (first < common && equal(first)) first++;
+        size_t last = instances.size();
+        if (instances.size() == _uploadedInstances.size()) {
+            while (last > first && equal(last - 1)) last--;
+        }
+
+        if (first < last) uploadInstances(first, last);
+        console.logc1("Uploaded ", last - first, " of ", instances.size(), " instances.");
+        _uploadedInstances = instances;
+    }
+
+    void VVShaderStageData::uploadInstances(size_t first, size_t last) {
+        if (first >= last) return;
+        VkDeviceSize bufferSize = sizeof(Veloxr::TileInstance) * (last - first);
 
         VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
+        Veloxr::VVAllocation stagingBufferMemory;
         VVUtils::createBuffer(_data, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
-        void* data;
-        vkMapMemory(_data->device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, _vertices->data(), (size_t) bufferSize);
-        vkUnmapMemory(_data->device, stagingBufferMemory);
-
-        VVUtils::createBuffer(_data, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+        memcpy(stagingBufferMemory.mapped, _instances->data() + first, (size_t) bufferSize);
 
-        VVUtils::copyBuffer(_data, stagingBuffer, vertexBuffer, bufferSize);
+        VVUtils::copyBuffer(_data, stagingBuffer, vertexBuffer, bufferSize, sizeof(Veloxr::TileInstance) * first);
 
-        vkDestroyBuffer(_data->device, stagingBuffer, nullptr);
-        vkFreeMemory(_data->device, stagingBufferMemory, nullptr);
+        VVUtils::destroyBuffer(_data, stagingBuffer, stagingBufferMemory);
     }
 
     void VVShaderStageData::createDescriptorPool() {
         // ASSERT -> WE HAVE TILED OUR TEXTURE
         console.logc1(__func__);
-        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        std::array<VkDescriptorPoolSize, 4> poolSizes{};
         poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = static_cast<uint32_t>(_vertices->size() / NUM_VERTICES_PER_TILE * MAX_FRAMES_IN_FLIGHT);
-
-#ifdef __APPLE__
-        poolSizes[1].descriptorCount = static_cast<uint32_t>(16 * MAX_FRAMES_IN_FLIGHT);
-#endif
+        poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * MAX_VIEWS);
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+        poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * MAX_VIEWS);
+        poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * MAX_VIEWS);
+        poolSizes[3].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        poolSizes[3].descriptorCount = static_cast<uint32_t>(_imageDescriptorCount * MAX_FRAMES_IN_FLIGHT * MAX_VIEWS);
 
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        // Views come and go with their viewports.
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+        poolInfo.poolSizeCount = isBindless() ? 3 : static_cast<uint32_t>(poolSizes.size());
         poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * MAX_VIEWS);
 
         if (vkCreateDescriptorPool(_data->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
             console.fatal("Failed to create descriptor pool.");
@@ -92,23 +181,89 @@ namespace Veloxr {
         }
     }
 
-    void VVShaderStageData::createUniformBuffers() {
+    void VVShaderStageData::createUniformBuffers(View& view) {
         console.logc1(__func__);
         VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-        uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+        view.uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        view.uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        view.uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            VVUtils::createBuffer(_data, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
+            VVUtils::createBuffer(_data, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, view.uniformBuffers[i], view.uniformBuffersMemory[i]);
 
-            vkMapMemory(_data->device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+            view.uniformBuffersMapped[i] = view.uniformBuffersMemory[i].mapped;
+        }
+
+        const VkDeviceSize entityBufferSize = sizeof(Veloxr::EntityData) * ENTITY_BUFFER_ENTRIES;
+        view.entityBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        view.entityBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        view.entityShadows.assign(MAX_FRAMES_IN_FLIGHT, std::vector<Veloxr::EntityData>(ENTITY_BUFFER_ENTRIES));
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            VVUtils::createBuffer(_data, entityBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, view.entityBuffers[i], view.entityBuffersMemory[i]);
+            std::memcpy(view.entityBuffersMemory[i].mapped, view.entityShadows[i].data(), entityBufferSize);
         }
+    }
 
+    void VVShaderStageData::updateEntityBuffer(uint32_t view, uint32_t currentImage, const std::vector<Veloxr::EntityData>& entities) {
+        auto findIt = _views.find(view);
+        if (findIt == _views.end() || findIt->second.entityBuffers.empty()) return;
+        auto& shadow = findIt->second.entityShadows[currentImage];
+        auto* mapped = static_cast<Veloxr::EntityData*>(findIt->second.entityBuffersMemory[currentImage].mapped);
+        const size_t count = std::min(entities.size(), shadow.size());
+        if (entities.size() > shadow.size()) console.warn(entities.size(), " entities, only ", shadow.size(), " fit the entity buffer.");
+        for (size_t i = 0; i < count; i++) {
+            if (std::memcmp(&shadow[i], &entities[i], sizeof(Veloxr::EntityData)) == 0) continue;
+            shadow[i] = entities[i];
+            mapped[i] = entities[i];
+        }
     }
 
-    void VVShaderStageData::createDescriptorSets() {
+    void VVShaderStageData::createDrawBuffers(View& view) {
+        const VkDeviceSize bufferSize = DRAW_COMMANDS_OFFSET + sizeof(VkDrawIndirectCommand) * std::max(_drawCapacity, getMaxDrawCount());
+
+        view.drawBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        view.drawBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        view.drawCounts.assign(MAX_FRAMES_IN_FLIGHT, 0);
+        view.drawVersions.assign(MAX_FRAMES_IN_FLIGHT, 0);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            VVUtils::createBuffer(_data, bufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, view.drawBuffers[i], view.drawBuffersMemory[i]);
+            std::memset(view.drawBuffersMemory[i].mapped, 0, DRAW_COMMANDS_OFFSET);
+        }
+    }
+
+    void VVShaderStageData::destroyDrawBuffers(View& view) {
+        for (size_t i = 0; i < view.drawBuffers.size(); ++i) {
+            VVUtils::destroyBuffer(_data, view.drawBuffers[i], view.drawBuffersMemory[i]);
+        }
+        view.drawBuffers.clear(); view.drawBuffersMemory.clear(); view.drawCounts.clear(); view.drawVersions.clear();
+    }
+
+    uint32_t VVShaderStageData::updateDrawCommands(uint32_t view, uint32_t currentImage, const glm::vec4& bounds, const glm::vec4& roi,
+            const std::vector<Veloxr::EntityData>& entities, float worldPerPixel) {
+        auto findIt = _views.find(view);
+        if (findIt == _views.end() || findIt->second.drawBuffers.empty()) return 0;
+        auto& data = findIt->second;
+
+        _tileIndex.cull(bounds, roi, entities, worldPerPixel, _drawCommands);
+        const uint32_t count = static_cast<uint32_t>(std::min<size_t>(_drawCommands.size(), getMaxDrawCount()));
+        auto* mapped = static_cast<unsigned char*>(data.drawBuffersMemory[currentImage].mapped);
+        const size_t bytes = sizeof(VkDrawIndirectCommand) * count;
+        if (count != data.drawCounts[currentImage] || std::memcmp(mapped + DRAW_COMMANDS_OFFSET, _drawCommands.data(), bytes) != 0) {
+            std::memcpy(mapped + DRAW_COMMANDS_OFFSET, _drawCommands.data(), bytes);
+            std::memcpy(mapped, &count, sizeof(count));
+            data.drawCounts[currentImage] = count;
+            data.drawVersions[currentImage]++;
+        }
+        return count;
+    }
+
+    const VkDrawIndirectCommand* VVShaderStageData::getDrawCommands(uint32_t view, uint32_t currentImage) const {
+        const auto& data = _views.at(view);
+        return reinterpret_cast<const VkDrawIndirectCommand*>(static_cast<const unsigned char*>(data.drawBuffersMemory[currentImage].mapped) + DRAW_COMMANDS_OFFSET);
+    }
+
+    void VVShaderStageData::createDescriptorSets(View& view) {
         console.logc1(__func__);
 
         auto device = _data->device;
@@ -121,10 +276,10 @@ namespace Veloxr {
         allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
         allocInfo.pSetLayouts = layouts.data();
 
-        descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+        view.descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
 
-        console.log("Allocating sets.", device, " - ", descriptorSets.size());
-        auto result = vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) ;
+        console.log("Allocating sets.", device, " - ", view.descriptorSets.size());
+        auto result = vkAllocateDescriptorSets(device, &allocInfo, view.descriptorSets.data()) ;
         console.debug("Checking result.");
         if (result != VK_SUCCESS) {
             console.fatal("Failed to allocated descriptor sets: ", result);
@@ -135,50 +290,28 @@ namespace Veloxr {
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = uniformBuffers[i];
+            bufferInfo.buffer = view.uniformBuffers[i];
             bufferInfo.offset = 0;
             bufferInfo.range = sizeof(UniformBufferObject);
 
-            std::vector<VkDescriptorImageInfo> imageInfos;
-            std::map<int, VkDescriptorImageInfo> orderedSamplers;
-            for (auto& [_, entity] : _textureMap) {
-                const auto& texture = entity->getVVTexture();
-                for( const auto& data : texture.getTiledResult() ){
-                    console.warn("Data in VVTexture: ", data.textureImageView, " - ", data.textureSampler, " - ", data.samplerIndex);
-                    VkDescriptorImageInfo imageInfo{};
-                    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                    imageInfo.imageView = data.textureImageView;
-                    imageInfo.sampler = data.textureSampler;
-                    orderedSamplers[data.samplerIndex] = (imageInfo);
-                }
-            }
-            console.log("Set the Samplers and image views.");
-
-            for(auto& [samplerIndex, imageInfo] : orderedSamplers) {
-                console.debug("Applying slot ", samplerIndex);
-                imageInfos.push_back(imageInfo);
-            }
+            VkDescriptorBufferInfo entityBufferInfo{};
+            entityBufferInfo.buffer = view.entityBuffers[i];
+            entityBufferInfo.offset = 0;
+            entityBufferInfo.range = VK_WHOLE_SIZE;
 
-                    // Ensure we have at least one texture, fill with dummy if needed
-#ifdef __APPLE__
-            uint32_t maxSamplers = 16;
-#else
-            uint32_t maxSamplers = 1024;
-#endif
-            if (imageInfos.empty()) {
-                console.warn("No textures available for descriptor set binding");
-                return; // Skip if no textures
-            }
+            // Bindless sets only carry the uniforms, sampler and entities, the images come from the descriptor heap (set 1).
+            // Without textures yet, updateImageDescriptors() writes the images once there are some.
+            const bool writeImages = !isBindless() && !_imageInfos.empty();
+            if (!isBindless() && !writeImages) console.warn("No textures available for descriptor set binding");
 
-            // Fill remaining slots with the first texture to avoid validation errors
-            while (imageInfos.size() < maxSamplers) {
-                imageInfos.push_back(imageInfos[0]);
-            }
+            // One sampler serves every tile image.
+            VkDescriptorImageInfo samplerInfo{};
+            samplerInfo.sampler = _data->samplerCache->getSampler();
 
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+            std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
 
             descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = descriptorSets[i];
+            descriptorWrites[0].dstSet = view.descriptorSets[i];
             descriptorWrites[0].dstBinding = 0;
             descriptorWrites[0].dstArrayElement = 0;
             descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -186,19 +319,114 @@ namespace Veloxr {
             descriptorWrites[0].pBufferInfo = &bufferInfo;
 
             descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = descriptorSets[i];
+            descriptorWrites[1].dstSet = view.descriptorSets[i];
             descriptorWrites[1].dstBinding = 1;
             descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[1].descriptorCount = static_cast<uint32_t>(imageInfos.size());
-            descriptorWrites[1].pImageInfo = imageInfos.data();
+            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+            descriptorWrites[1].descriptorCount = 1;
+            descriptorWrites[1].pImageInfo = &samplerInfo;
+
+            descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[2].dstSet = view.descriptorSets[i];
+            descriptorWrites[2].dstBinding = 3;
+            descriptorWrites[2].dstArrayElement = 0;
+            descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[2].descriptorCount = 1;
+            descriptorWrites[2].pBufferInfo = &entityBufferInfo;
+
+            descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[3].dstSet = view.descriptorSets[i];
+            descriptorWrites[3].dstBinding = 2;
+            descriptorWrites[3].dstArrayElement = 0;
+            descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            descriptorWrites[3].descriptorCount = static_cast<uint32_t>(_imageInfos.size());
+            descriptorWrites[3].pImageInfo = _imageInfos.data();
 
             console.log("Updating descriptor sets\n");
-            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            const uint32_t writeCount = writeImages ? static_cast<uint32_t>(descriptorWrites.size()) : 3;
+            vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
         }
     }
 
 
+    std::vector<VkDescriptorImageInfo> VVShaderStageData::collectImageInfos(std::vector<uint64_t>* generations) const {
+        std::map<int, VkDescriptorImageInfo> orderedSamplers;
+        std::map<int, uint64_t> slotGenerations;
+        for (auto& [_, entity] : _textureMap) {
+            const auto& texture = entity->getVVTexture();
+            for( const auto& data : texture.getTiledResult() ){
+                console.debug("Data in VVTexture: ", data.textureImageView, " - ", data.samplerIndex, " (", data.layerCount, " layers)");
+                VkDescriptorImageInfo imageInfo{};
+                imageInfo.imageLayout = data.imageLayout;
+                imageInfo.imageView = data.textureImageView;
+                // Tiles released by a committed crop or still uploading keep their slot but are not drawn, the placeholder holds it.
+                if (!imageInfo.imageView && _data->memoryBudget) {
+                    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                    imageInfo.imageView = _data->memoryBudget->getPlaceholderView();
+                }
+                orderedSamplers[data.samplerIndex] = (imageInfo);
+                slotGenerations[data.samplerIndex] = texture.getGeneration();
+            }
+        }
+        if (orderedSamplers.empty()) return {};
+
+        // Fill unused slots with the first texture to avoid validation errors
+        std::vector<VkDescriptorImageInfo> imageInfos(_imageDescriptorCount, orderedSamplers.begin()->second);
+        if (generations) generations->assign(_imageDescriptorCount, slotGenerations.begin()->second);
+        for (auto& [samplerIndex, imageInfo] : orderedSamplers) {
+            if (samplerIndex < 0 || static_cast<uint32_t>(samplerIndex) >= _imageDescriptorCount) {
+                console.warn("Texture slot ", samplerIndex, " is past the ", _imageDescriptorCount, " image descriptors, not drawn.");
+                continue;
+            }
+            imageInfos[samplerIndex] = imageInfo;
+            if (generations) (*generations)[samplerIndex] = slotGenerations[samplerIndex];
+        }
+        return imageInfos;
+    }
+
+    void VVShaderStageData::updateImageDescriptors() {
+        std::vector<uint64_t> generations;
+        auto imageInfos = collectImageInfos(&generations);
+        if (imageInfos.empty()) return;
+
+        // Sets written before any texture existed get every slot, the others only the runs of slots that changed.
+        auto changed = [&](size_t i) {
+            return _imageInfos.size() != imageInfos.size() || imageInfos[i].imageView != _imageInfos[i].imageView ||
+                imageInfos[i].imageLayout != _imageInfos[i].imageLayout || generations[i] != _imageGenerations[i];
+        };
+        std::vector<VkWriteDescriptorSet> descriptorWrites;
+        size_t slots = 0;
+        for (size_t first = 0; first < imageInfos.size();) {
+            if (!changed(first)) {
+                first++;
+                continue;
+            }
+            size_t last = first + 1;
+            while (last < imageInfos.size() && changed(last)) last++;
+            for (auto& [_, view] : _views) {
+                for (VkDescriptorSet set : view.descriptorSets) {
+                    VkWriteDescriptorSet write{};
+                    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                    write.dstSet = set;
+                    write.dstBinding = 2;
+                    write.dstArrayElement = static_cast<uint32_t>(first);
+                    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+                    write.descriptorCount = static_cast<uint32_t>(last - first);
+                    write.pImageInfo = imageInfos.data() + first;
+                    descriptorWrites.push_back(write);
+                }
+            }
+            slots += last - first;
+            first = last;
+        }
+        if (!descriptorWrites.empty()) {
+            vkUpdateDescriptorSets(_data->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
+        console.logc1("Updated ", slots, " of ", imageInfos.size(), " image descriptors.");
+        _imageInfos = std::move(imageInfos);
+        _imageGenerations = std::move(generations);
+    }
+
     void VVShaderStageData::createDescriptorLayout() {
         console.logc1(__func__);
         console.debug("Creating descrLayout with: ", _data.get(), _data->physicalDevice);
@@ -211,17 +439,38 @@ namespace Veloxr {
         VkPhysicalDeviceProperties deviceProperties;
         vkGetPhysicalDeviceProperties(_data->physicalDevice, &deviceProperties);
 
+        // Separate sampler + sampled images: the image array is bounded by maxPerStageDescriptorSampledImages
+        // instead of maxPerStageDescriptorSamplers, and only one VkSampler is bound no matter the tile count.
         VkDescriptorSetLayoutBinding samplerLayoutBinding{};
         samplerLayoutBinding.binding = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.descriptorCount = std::min((uint32_t)2048, deviceProperties.limits.maxPerStageDescriptorSamplers);
+        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+        samplerLayoutBinding.descriptorCount = 1;
         samplerLayoutBinding.pImmutableSamplers = nullptr;
         samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-        std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
+        // No more than the fragment shader's array declares, slots past it would be written but never indexed.
+        _imageDescriptorCount = std::min(SHADER_IMAGE_COUNT, deviceProperties.limits.maxPerStageDescriptorSampledImages);
+
+        VkDescriptorSetLayoutBinding imageLayoutBinding{};
+        imageLayoutBinding.binding = 2;
+        imageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        imageLayoutBinding.descriptorCount = _imageDescriptorCount;
+        imageLayoutBinding.pImmutableSamplers = nullptr;
+        imageLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        // Transform, crop, visibility and opacity of every entity, indexed by renderUID.
+        VkDescriptorSetLayoutBinding entityLayoutBinding{};
+        entityLayoutBinding.binding = 3;
+        entityLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        entityLayoutBinding.descriptorCount = 1;
+        entityLayoutBinding.pImmutableSamplers = nullptr;
+        entityLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        // The images go last, bindless layouts leave them out.
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings = {uboLayoutBinding, samplerLayoutBinding, entityLayoutBinding, imageLayoutBinding};
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.bindingCount = isBindless() ? 3 : static_cast<uint32_t>(bindings.size());
         layoutInfo.pBindings = bindings.data();
 
         if (vkCreateDescriptorSetLayout(_data->device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
@@ -229,8 +478,25 @@ namespace Veloxr {
         }
     }
 
-    void VVShaderStageData::updateUniformBuffers(uint32_t currentImage, const Veloxr::UniformBufferObject& ubo) {
-        memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    void VVShaderStageData::updateUniformBuffers(uint32_t view, uint32_t currentImage, const Veloxr::UniformBufferObject& ubo) {
+        auto findIt = _views.find(view);
+        if (findIt == _views.end() || findIt->second.uniformBuffersMapped.empty()) return;
+        memcpy(findIt->second.uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    }
+
+    void VVShaderStageData::destroyViewData(View& view) {
+        for (size_t i = 0; i < view.uniformBuffers.size(); ++i) {
+            VVUtils::destroyBuffer(_data, view.uniformBuffers[i], view.uniformBuffersMemory[i]);
+        }
+        for (size_t i = 0; i < view.entityBuffers.size(); ++i) {
+            VVUtils::destroyBuffer(_data, view.entityBuffers[i], view.entityBuffersMemory[i]);
+        }
+        view.entityBuffers.clear(); view.entityBuffersMemory.clear(); view.entityShadows.clear();
+        destroyDrawBuffers(view);
+        if (descriptorPool && !view.descriptorSets.empty()) {
+            vkFreeDescriptorSets(_data->device, descriptorPool, static_cast<uint32_t>(view.descriptorSets.size()), view.descriptorSets.data());
+        }
+        view.uniformBuffers.clear(); view.uniformBuffersMemory.clear(); view.uniformBuffersMapped.clear(); view.descriptorSets.clear();
     }
 
     void VVShaderStageData::destroy() {
@@ -240,23 +506,21 @@ namespace Veloxr {
 
         vkDeviceWaitIdle(d); 
 
-        if (vertexBuffer) vkDestroyBuffer(d, vertexBuffer, nullptr);
-        if (vertexBufferMemory) vkFreeMemory(d, vertexBufferMemory, nullptr);
+        VVUtils::destroyBuffer(_data, vertexBuffer, vertexBufferMemory);
 
-        for (size_t i = 0; i < uniformBuffers.size(); ++i) {
-            if (uniformBuffers[i]) vkDestroyBuffer(d, uniformBuffers[i], nullptr);
-            if (uniformBuffersMemory[i]) vkFreeMemory(d, uniformBuffersMemory[i], nullptr);
-        }
+        for (auto& [_, view] : _views) destroyViewData(view);
 
         if (descriptorPool) vkDestroyDescriptorPool(d, descriptorPool, nullptr);
         if (descriptorSetLayout) vkDestroyDescriptorSetLayout(d, descriptorSetLayout, nullptr);
 
-        uniformBuffers.clear(); uniformBuffersMemory.clear(); uniformBuffersMapped.clear(); descriptorSets.clear();
-
         vertexBuffer = VK_NULL_HANDLE;
-        vertexBufferMemory = VK_NULL_HANDLE;
         descriptorPool = VK_NULL_HANDLE;
         descriptorSetLayout = VK_NULL_HANDLE;
+        _uploadedInstances.clear();
+        _instanceCapacity = 0;
+        _drawCapacity = 0;
+        _imageInfos.clear();
+        _imageGenerations.clear();
         console.warn("Done with destruction.");
     }
 }
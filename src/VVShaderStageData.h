@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <cstring>
 #include <map>
@@ -7,6 +8,7 @@
 #include "Common.h"
 #include "RenderEntity.h"
 #include "VVTexture.h"
+#include "VVTileIndex.h"
 #include "VVUtils.h"
 #include "Vertex.h"
 
@@ -21,14 +23,42 @@ namespace Veloxr {
             void setDataPacket(std::shared_ptr<VVDataPacket> dataPacket);
 
             // uh do not edit
+            // Collects the instances of every entity, ordered by entity id so a new entity lands at the end.
             void setTextureMap(std::unordered_map<std::string, std::shared_ptr<Veloxr::RenderEntity>>& textureMap);
+            // The first call creates the layout, buffers and sets. Later calls only upload the instances and image
+            // descriptors that differ from the last call, the buffers grow when they have to. No instances draw nothing.
             void createStageData();
-            void updateUniformBuffers(uint32_t currentImage, const Veloxr::UniformBufferObject& ubo);
-
-
+            [[nodiscard]] inline const std::vector<Veloxr::TileInstance>& getInstances() const { return *_instances; }
+
+            // One per viewport (camera) drawing the shared vertices and tiles: its own uniform buffers and set 0 per
+            // frame in flight. Up to MAX_VIEWS at once.
+            uint32_t createView();
+            void destroyView(uint32_t view);
+            void updateUniformBuffers(uint32_t view, uint32_t currentImage, const Veloxr::UniformBufferObject& ubo);
+            // Copies the entries of entities (indexed by entity id) that differ from what the view's buffer for
+            // currentImage holds, moving one entity writes one entry.
+            void updateEntityBuffer(uint32_t view, uint32_t currentImage, const std::vector<Veloxr::EntityData>& entities);
+
+            // Culls the vertex buffer against the view (VVTileIndex::cull) into its draw buffer for currentImage:
+            // a uint32_t draw count, then the VkDrawIndirectCommands from DRAW_COMMANDS_OFFSET. Returns the count.
+            uint32_t updateDrawCommands(uint32_t view, uint32_t currentImage, const glm::vec4& bounds, const glm::vec4& roi,
+                    const std::vector<Veloxr::EntityData>& entities, float worldPerPixel);
+            VkBuffer getDrawBuffer(uint32_t view, uint32_t currentImage) const { return _views.at(view).drawBuffers[currentImage]; }
+            const VkDrawIndirectCommand* getDrawCommands(uint32_t view, uint32_t currentImage) const;
+            uint32_t getDrawCount(uint32_t view, uint32_t currentImage) const { return _views.at(view).drawCounts[currentImage]; }
+            // Bumped when updateDrawCommands wrote other commands than before, for command buffers with the count baked in.
+            uint64_t getDrawVersion(uint32_t view, uint32_t currentImage) const { return _views.at(view).drawVersions[currentImage]; }
+            // What a draw buffer holds at most, every quad on its own.
+            inline uint32_t getMaxDrawCount() const { return std::max(1u, _tileIndex.getQuadCount()); }
+            static constexpr VkDeviceSize DRAW_COMMANDS_OFFSET = 16;
+
+
+            // Per instance rate, one TileInstance per tile quad of every entity.
             VkBuffer& getVertexBuffer() { return vertexBuffer;}
-            const std::vector<VkDescriptorSet>& getDescriptorSets() { return descriptorSets; }
+            const std::vector<VkDescriptorSet>& getDescriptorSets(uint32_t view) { return _views.at(view).descriptorSets; }
             VkDescriptorSetLayout& getDescriptorSetLayout() { return descriptorSetLayout; }
+            // Bumped by createStageData(), command buffers recorded against an older vertex buffer or sets are stale.
+            inline uint64_t getVersion() const { return _version; }
 
             void destroy();
 
@@ -36,28 +66,69 @@ namespace Veloxr {
         private:
             inline static LLogger console{"[Veloxr][VVShaderStageData] "}; 
             inline static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
-            inline static constexpr uint32_t NUM_VERTICES_PER_TILE = 6;
+            inline static constexpr uint32_t MAX_VIEWS = 4;
+            inline static constexpr uint32_t ENTITY_BUFFER_ENTRIES = Veloxr::RenderEntity::MAX_ENTITIES + 1;
+            // texImages of passthrough.frag and passthrough_mac.frag, change together. Slots past it are not drawn.
+#ifdef __APPLE__
+            inline static constexpr uint32_t SHADER_IMAGE_COUNT = 16;
+#else
+            inline static constexpr uint32_t SHADER_IMAGE_COUNT = 128;
+#endif
 
             std::map<std::string, std::shared_ptr<Veloxr::RenderEntity>>::const_iterator _digestion;
 
-            std::vector<VkBuffer> uniformBuffers;
-            std::vector<VkDeviceMemory> uniformBuffersMemory;
-            std::vector<void*> uniformBuffersMapped;
-
-            VkBuffer vertexBuffer;
-            VkDeviceMemory vertexBufferMemory;
-            VkDescriptorPool descriptorPool;
-            std::vector<VkDescriptorSet> descriptorSets;
-            VkDescriptorSetLayout descriptorSetLayout;
-
-            void createUniformBuffers();
+            struct View {
+                std::vector<VkBuffer> uniformBuffers;
+                std::vector<Veloxr::VVAllocation> uniformBuffersMemory;
+                std::vector<void*> uniformBuffersMapped;
+                // Per frame in flight like the uniforms, each with a host copy to diff against.
+                std::vector<VkBuffer> entityBuffers;
+                std::vector<Veloxr::VVAllocation> entityBuffersMemory;
+                std::vector<std::vector<Veloxr::EntityData>> entityShadows;
+                std::vector<VkDescriptorSet> descriptorSets;
+                std::vector<VkBuffer> drawBuffers;
+                std::vector<Veloxr::VVAllocation> drawBuffersMemory;
+                std::vector<uint32_t> drawCounts;
+                std::vector<uint64_t> drawVersions;
+            };
+
+            // Views outlive destroy(), createStageData() gives them buffers and sets again.
+            std::map<uint32_t, View> _views;
+            uint32_t _nextView{0};
+
+            VkBuffer vertexBuffer{VK_NULL_HANDLE};
+            Veloxr::VVAllocation vertexBufferMemory;
+            VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
+            VkDescriptorSetLayout descriptorSetLayout{VK_NULL_HANDLE};
+            uint32_t _imageDescriptorCount{SHADER_IMAGE_COUNT};
+            uint64_t _version{0};
+            // What the vertex buffer and the image descriptors hold, createStageData() diffs against these.
+            std::vector<Veloxr::TileInstance> _uploadedInstances;
+            size_t _instanceCapacity{0};
+            uint32_t _drawCapacity{0};
+            std::vector<VkDescriptorImageInfo> _imageInfos;
+            std::vector<uint64_t> _imageGenerations; // VVTexture::getGeneration() of each slot's texture.
+            Veloxr::VVTileIndex _tileIndex;
+            std::vector<VkDrawIndirectCommand> _drawCommands; // Scratch for updateDrawCommands.
+
+            void createUniformBuffers(View& view);
             void createVertexBuffer();
+            void updateVertexBuffer();
+            void uploadInstances(size_t first, size_t last);
+            void createDrawBuffers(View& view);
+            void destroyDrawBuffers(View& view);
             void createDescriptorPool();
-            void createDescriptorSets();
+            void createDescriptorSets(View& view);
+            // Non bindless: the tile image of every slot (textureUnit), unused slots repeat the first one.
+            std::vector<VkDescriptorImageInfo> collectImageInfos(std::vector<uint64_t>* generations = nullptr) const;
+            void updateImageDescriptors();
             void createDescriptorLayout();
+            void destroyViewData(View& view);
+
+            inline bool isBindless() const { return _data->descriptorHeap != nullptr; }
 
             std::shared_ptr<VVDataPacket> _data;
-            std::shared_ptr<std::vector<Veloxr::Vertex>> _vertices;
+            std::shared_ptr<std::vector<Veloxr::TileInstance>> _instances;
             std::unordered_map<std::string, std::shared_ptr<Veloxr::RenderEntity>> _textureMap;
     };
 }
@@ -0,0 +1,84 @@
+#include "VVTaskScheduler.h"
+#include <algorithm>
+
+namespace Veloxr {
+
+    VVTaskScheduler& VVTaskScheduler::get() {
+        // The calling thread takes part in every parallelFor, one worker less keeps the cores busy without oversubscribing.
+        static VVTaskScheduler scheduler(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return scheduler;
+    }
+
+    VVTaskScheduler::VVTaskScheduler(size_t workerCount) {
+        _workers.reserve(workerCount);
+        for (size_t i = 0; i < workerCount; i++) _workers.emplace_back([this]() { workerLoop(); });
+        console.logc1("Started ", workerCount, " workers.");
+    }
+
+    VVTaskScheduler::~VVTaskScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (auto& worker : _workers) {
+            if (worker.joinable()) worker.join();
+        }
+    }
+
+    void VVTaskScheduler::run(Job& job) {
+        job.active++;
+        for (size_t i = job.next++; i < job.count; i = job.next++) {
+            try {
+                (*job.fn)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                if (!job.failure) job.failure = std::current_exception();
+                job.next = job.count;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.active--;
+        }
+        job.done.notify_all();
+    }
+
+    void VVTaskScheduler::workerLoop() {
+        while (true) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [&]() { return _stop || !_queue.empty(); });
+                if (_stop) return;
+                job = std::move(_queue.front());
+                _queue.pop_front();
+            }
+            // Picked up after the caller finished the range: next is past count, fn is never called.
+            run(*job);
+        }
+    }
+
+    void VVTaskScheduler::parallelFor(size_t count, const std::function<void(size_t)>& fn, size_t maxThreads) {
+        if (count == 0) return;
+        auto job = std::make_shared<Job>();
+        job->fn = &fn;
+        job->count = count;
+
+        const size_t helpers = std::min({count, std::max<size_t>(1, maxThreads), _workers.size() + 1}) - 1;
+        if (helpers) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                for (size_t i = 0; i < helpers; i++) _queue.push_back(job);
+            }
+            _wake.notify_all();
+        }
+
+        run(*job);
+        // Workers still inside fn hold references into the caller's frame, wait for them. Queued copies that run later find the range used up.
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->done.wait(lock, [&]() { return job->active == 0; });
+
+        if (job->failure) std::rethrow_exception(job->failure);
+    }
+}
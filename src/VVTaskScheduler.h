@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    /**
+     * Process wide worker threads behind VVUtils::parallelFor, so tiling, block compression, region copies and
+     * the ingest of several entities share one set of threads instead of each spawning its own.
+     *
+     * parallelFor may be called from inside a parallelFor body. The caller always works through its own range, the
+     * workers only help, so a nested call never waits on work that has not started.
+     */
+    class VVTaskScheduler {
+        public:
+            static VVTaskScheduler& get();
+
+            explicit VVTaskScheduler(size_t workerCount);
+            ~VVTaskScheduler();
+
+            // Runs fn(0..count-1) on the calling thread and up to maxThreads - 1 workers. Rethrows the first failure.
+            void parallelFor(size_t count, const std::function<void(size_t)>& fn, size_t maxThreads);
+
+            inline size_t getWorkerCount() const { return _workers.size(); }
+
+        private:
+            inline static LLogger console{"[Veloxr][VVTaskScheduler] "};
+
+            struct Job {
+                const std::function<void(size_t)>* fn;
+                size_t count;
+                std::atomic<size_t> next{0};
+                std::atomic<size_t> active{0};
+                std::exception_ptr failure;
+                std::mutex mutex;
+                std::condition_variable done;
+            };
+
+            std::vector<std::thread> _workers;
+            std::deque<std::shared_ptr<Job>> _queue;
+            std::mutex _mutex;
+            std::condition_variable _wake;
+            bool _stop{false};
+
+            void workerLoop();
+            // Takes indices until the range is used up. fn is only touched for indices below count.
+            static void run(Job& job);
+    };
+}
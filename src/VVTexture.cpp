@@ -3,7 +3,20 @@
 #include "TextureTiling.h"
 #include "TileManager.h"
 #include "VVUtils.h"
+#include "VVTileUploader.h"
+#include "VVBlockEncoder.h"
+#include "VVTileCache.h"
+#include "VVDescriptorHeap.h"
+#include "VVVirtualTextureCache.h"
+#include "VVMemoryBudget.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <thread>
+#include <map>
+#include <set>
 #include <limits>
+#include <tuple>
 
 
 namespace Veloxr {
@@ -17,184 +30,767 @@ void VVTexture::setDataPacket(std::shared_ptr<VVDataPacket> dataPacket) {
     _data = dataPacket;
 }
 
-void VVTexture::tileTexture(std::shared_ptr<Veloxr::VeloxrBuffer> buffer) {
+void VVTexture::tileTexture(std::shared_ptr<Veloxr::VeloxrBuffer> buffer, Veloxr::TileCompression compression, const std::function<glm::vec4()>& focus, bool overview) {
     destroy();
+    prepareTiles(buffer, compression, overview);
+    createTiles(focus);
+    uploadTiles({ this });
+}
+
+void VVTexture::prepareTiles(std::shared_ptr<Veloxr::VeloxrBuffer> buffer, Veloxr::TileCompression compression, bool overview) {
+    _buffer = buffer;
     console.logc2(__func__, buffer->data.size());
     auto now = std::chrono::high_resolution_clock::now();
-    static Veloxr::TextureTiling tiler{};
+    // Several textures tile at once, each with its own tiler.
+    Veloxr::TextureTiling tiler{};
+
+    // Tiles keep their native channel count, unless the device cannot sample the matching sRGB format.
+    // RGB stays packed when the uploader can expand it on the GPU.
+    if (compression != Veloxr::TileCompression::None && !isCompressionSupported(compression)) {
+        console.warn("Block compressed tiles not supported on this device, keeping lossless tiles.");
+        compression = Veloxr::TileCompression::None;
+    }
+    uint32_t tileChannels = Veloxr::TextureTiling::getTileChannels(buffer->numChannels, false);
+    const bool packedRGB = compression == Veloxr::TileCompression::None && buffer->numChannels == 3 && _data->uploader->supportsPackedRGB(
+            static_cast<uint32_t>(std::min<uint64_t>(buffer->width, MAX_TILE_DIMENSION)), static_cast<uint32_t>(std::min<uint64_t>(buffer->height, MAX_TILE_DIMENSION)));
+    if (compression != Veloxr::TileCompression::None) {
+        tileChannels = 4;
+    } else if (packedRGB) {
+        tileChannels = 3;
+    } else if (tileChannels < 4 && !isSampledFormatSupported(getTileFormat(tileChannels, buffer->channelOrder))) {
+        console.warn("No sampled support for ", tileChannels, " channel sRGB tiles, expanding to RGBA.");
+        tileChannels = 4;
+    }
 
-    // TODO: Calculate best time case for maxResolution. 4096 will be 200% faster that maxresolution, but not sure if they will have enough sampelrs
-    // TODO2: Use indexed binding on hardware that supports it.
-    Veloxr::TiledResult tileDataResult = tiler.tile(buffer, 8192);
+    _pending = std::make_unique<PendingTiles>();
+    _pending->buffer = buffer;
+    _pending->compression = compression;
+    _pending->packedRGB = packedRGB;
+    _pending->overview = overview;
+    _pending->tiles = tiler.tile(buffer, MAX_TILE_DIMENSION, tileChannels);
+    _pending->timeToTileMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
+
+    if (compression != Veloxr::TileCompression::None) {
+        now = std::chrono::high_resolution_clock::now();
+        for (auto& [_, tileData] : _pending->tiles.tiles) compressTile(tileData, compression);
+        auto timeToCompressMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
+        console.fatal("Time to block compress: ", timeToCompressMs, " ms");
+    }
+}
 
-    auto timeToTileMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
-    now = std::chrono::high_resolution_clock::now();
-    for(auto& [samplerIndexBase, tileData] : tileDataResult.tiles){
+void VVTexture::createTiles(const std::function<glm::vec4()>& focus) {
+    if (!_pending) return;
+    auto& pending = *_pending;
+    const auto& buffer = pending.buffer;
+    const auto compression = pending.compression;
+    const bool packedRGB = pending.packedRGB;
+    auto& tileDataResult = pending.tiles;
+    pending.focus = focus;
+
+    // Tiles of equal extent share one 2D array image and one descriptor slot, the vertex carries the layer.
+    // Interior tiles all land in a few arrays, the right column, bottom row and corner get arrays of their own.
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<int>> tileGroups;
+    for(const auto& [samplerIndexBase, tileData] : tileDataResult.tiles) {
+        tileGroups[{tileData.width, tileData.height}].push_back(samplerIndexBase);
+    }
 
-        int texWidth    = tileData.width;
-        int texHeight   = tileData.height;
-        int texChannels = 4;//myTexture.getNumChannels();
-        tileData.samplerIndex = _tileManager.getTextureSlot();
-        int samplerIndexSlot = tileData.samplerIndex;
+    // Entity space bounds per base tile index, used to upload the tiles under the camera first.
+    std::map<int, glm::vec4> tileBounds;
+    for(const auto& v : tileDataResult.vertices) {
+        auto [findIt, inserted] = tileBounds.try_emplace(v.textureUnit, glm::vec4{v.pos.x, v.pos.y, v.pos.x, v.pos.y});
+        if (inserted) continue;
+        findIt->second = { std::min(findIt->second.x, v.pos.x), std::min(findIt->second.y, v.pos.y),
+                           std::max(findIt->second.z, v.pos.x), std::max(findIt->second.w, v.pos.y) };
+    }
 
-        console.warn("Texture slot: ", tileData.samplerIndex, " => ", samplerIndexSlot);
+    std::map<int, std::pair<int, int>> slotRemap; // Base tile index -> (slot, layer)
+    pending.uploads.reserve(tileDataResult.tiles.size());
 
-        for(auto& v : tileDataResult.vertices) {
-            if(v.textureUnit == samplerIndexBase) {
-                v.textureUnit = samplerIndexSlot;
-            }
-        }
-        console.warn("Texture slot: ", tileData.samplerIndex, " => ", samplerIndexSlot);
-        VkDeviceSize imageSize = static_cast<VkDeviceSize>(texWidth) * 
+    for(const auto& [extent, tileIndices] : tileGroups) {
+        const auto [texWidth, texHeight] = extent;
+        const uint32_t texChannels = tileDataResult.tiles.at(tileIndices.front()).channels;
+        VkDeviceSize imageSize = compression != Veloxr::TileCompression::None ? Veloxr::VVBlockEncoder::getEncodedSize(texWidth, texHeight, compression) :
+            static_cast<VkDeviceSize>(texWidth) *
             static_cast<VkDeviceSize>(texHeight) *
             static_cast<VkDeviceSize>(texChannels);
+        const uint32_t maxLayers = getMaxArrayLayers(imageSize);
+        const VkFormat format = compression != Veloxr::TileCompression::None ? Veloxr::VVBlockEncoder::getFormat(compression) : getTileFormat(texChannels, buffer->channelOrder);
+
+        for(size_t first = 0; first < tileIndices.size(); first += maxLayers) {
+            const uint32_t layers = static_cast<uint32_t>(std::min<size_t>(maxLayers, tileIndices.size() - first));
+            const int samplerIndexSlot = _tileManager.getTextureSlot();
+
+            console.log("Loading texture array of ", layers, " x ", texWidth, " x ", texHeight, ": ", (imageSize * layers / 1024.0 / 1024.0), " MB with texture slot index: ", samplerIndexSlot);
+
+            VkImage textureImage;
+            Veloxr::VVAllocation textureImageMemory;
+            const Veloxr::VVTileImageDesc desc = _data->uploader->getImageDesc(format, texWidth, texHeight, layers, packedRGB);
+            createImage(texWidth, texHeight, layers, format, desc, textureImage, textureImageMemory);
+
+            for(uint32_t layer = 0; layer < layers; layer++) {
+                const int samplerIndexBase = tileIndices[first + layer];
+                const auto& tileData = tileDataResult.tiles.at(samplerIndexBase);
+                slotRemap[samplerIndexBase] = {samplerIndexSlot, static_cast<int>(layer)};
+                console.warn("Texture slot: ", samplerIndexBase, " => ", samplerIndexSlot, " layer ", layer);
+
+                Veloxr::VVTileUpload upload{};
+                upload.pixels = tileData.pixelData.data();
+                upload.size = imageSize;
+                upload.hostImportable = true;
+                upload.width = texWidth;
+                upload.height = texHeight;
+                upload.format = format;
+                upload.image = textureImage;
+                upload.layer = layer;
+                upload.tiling = desc.tiling;
+                upload.mapped = textureImageMemory.mapped;
+                upload.packedRGB = packedRGB;
+                pending.uploads.push_back(upload);
+                pending.uploadBounds.push_back(tileBounds[samplerIndexBase]);
+                pending.uploadArrays.push_back(_tiledResult.size());
+            }
+            pending.arrayTiles.emplace_back(tileIndices.begin() + first, tileIndices.begin() + first + layers);
+            pending.layersLeft.push_back(layers);
+
+            Veloxr::VVTileData vvTileData {};
+            vvTileData.textureImage = textureImage;
+            vvTileData.samplerIndex = samplerIndexSlot;
+            vvTileData.layerCount = layers;
+            vvTileData.textureImageMemory = textureImageMemory;
+            vvTileData.format = format;
+            // Compressed tiles are encoded from the RGBA bytes as laid out in the buffer, same swizzle as packed RGB.
+            vvTileData.components = getTileSwizzle(compression != Veloxr::TileCompression::None ? 3 : texChannels, buffer->channelOrder);
+            vvTileData.width = texWidth;
+            vvTileData.height = texHeight;
+            vvTileData.packedRGB = packedRGB;
+            vvTileData.channels = compression != Veloxr::TileCompression::None ? 0 : texChannels;
+            for (int samplerIndexBase : pending.arrayTiles.back()) {
+                const auto& tileData = tileDataResult.tiles.at(samplerIndexBase);
+                vvTileData.layerBounds.push_back(tileBounds[samplerIndexBase]);
+                vvTileData.layerOrigins.push_back({ tileData.x, tileData.y });
+            }
+            _tiledResult.emplace_back(std::move(vvTileData));
+        }
+    }
+
+    // Remap in one pass, slots handed out by the tile manager can collide with not yet remapped base indices.
+    for(auto& v : tileDataResult.vertices) {
+        auto findIt = slotRemap.find(v.textureUnit);
+        if(findIt == slotRemap.end()) continue;
+        v.textureUnit = findIt->second.first;
+        v.textureLayer = findIt->second.second;
+    }
+
+    // Each array's instances are drawn once its last layer lands, the bounds cover every tile from the start.
+    std::map<int, size_t> slotArrays;
+    for (size_t array = 0; array < _tiledResult.size(); array++) slotArrays[_tiledResult[array].samplerIndex] = array;
+    const auto instances = Veloxr::TileInstance::fromQuads(tileDataResult.vertices);
+    pending.arrayInstances.resize(_tiledResult.size());
+    for (const auto& instance : instances) pending.arrayInstances[slotArrays.at(instance.textureUnit)].push_back(instance);
+    updateBoundingBox(instances);
+
+    pending.uploadsLeft.resize(pending.uploads.size());
+    std::iota(pending.uploadsLeft.begin(), pending.uploadsLeft.end(), 0);
+    pending.uploadStart = std::chrono::high_resolution_clock::now();
+}
 
-        console.log("Loading texture of size ", texWidth, " x ", texHeight, ": ", (imageSize / 1024.0 / 1024.0), " MB with texture slot index: ", tileData.samplerIndex);
-
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        VVUtils::createBuffer(_data, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-        void* data;
-        vkMapMemory(_data->device, stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, tileData.pixelData.data(), static_cast<size_t>(imageSize));
-        vkUnmapMemory(_data->device, stagingBufferMemory);
-
-        VkImage textureImage;
-        VkDeviceMemory textureImageMemory;
-        createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
-
-        // not thread safe cuz of command pool
-        transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-        // thread safe
-        copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-        transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-        vkDestroyBuffer(_data->device, stagingBuffer, nullptr);
-        vkFreeMemory(_data->device, stagingBufferMemory, nullptr);
-        textureImage = textureImage;
-        textureImageMemory = textureImageMemory;
-
-        
-        auto imageView = createTextureImageView(textureImage);
-        auto sampler = createTextureSampler();
-        // _tiledResult.emplace_back(imageView, 
-        Veloxr::VVTileData vvTileData {};
-        vvTileData.textureImage = textureImage;
-        vvTileData.textureImageView = imageView;
-        vvTileData.textureSampler = sampler;
-        vvTileData.samplerIndex = samplerIndexSlot;
-        vvTileData.textureImageMemory = textureImageMemory;
-        _tiledResult.emplace_back(std::move(vvTileData));
-        // textureImageView = imageView;
-        // textureSampler = sampler;
-        // samplerIndex = samplerIndexSlot;
-    }
-    auto timeToUploadMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
-
-    _vertices.insert(_vertices.begin(), std::make_move_iterator(tileDataResult.vertices.begin()), std::make_move_iterator(tileDataResult.vertices.end()));
+uint32_t VVTexture::getMaxSlotCount(const Veloxr::VeloxrBuffer& buffer, bool overview) {
+    const uint64_t columns = (buffer.width + MAX_TILE_DIMENSION - 1) / MAX_TILE_DIMENSION;
+    const uint64_t rows = (buffer.height + MAX_TILE_DIMENSION - 1) / MAX_TILE_DIMENSION;
+    return static_cast<uint32_t>(columns * rows + (overview ? 1 : 0));
+}
 
+void VVTexture::createVirtualTexture(std::shared_ptr<Veloxr::VeloxrBuffer> buffer) {
+    destroy();
+    _buffer = buffer;
+    _virtualTextureId = static_cast<int>(_data->virtualTextures->registerTexture(buffer));
+    // Negative units select the virtual texture path in the fragment shader.
+    _instances = Veloxr::TileInstance::fromQuads(Veloxr::TextureTiling::makeQuad(static_cast<uint32_t>(buffer->width),
+            static_cast<uint32_t>(buffer->height), static_cast<int>(buffer->orientation), -(_virtualTextureId + 1)));
+    updateBoundingBox(_instances);
+}
+
+void VVTexture::updateBoundingBox(const std::vector<Veloxr::TileInstance>& instances) {
     float minX = std::numeric_limits<float>::max(), maxX = std::numeric_limits<float>::min();
     float minY = std::numeric_limits<float>::max(), maxY = std::numeric_limits<float>::min();
-    for (auto &v : _vertices) {
-        minX = std::min(minX, v.pos.x);
-        maxX = std::max(maxX, v.pos.x);
-        minY = std::min(minY, v.pos.y);
-        maxY = std::max(maxY, v.pos.y);
+    for (auto &instance : instances) {
+        minX = std::min(minX, instance.rect.x);
+        maxX = std::max(maxX, instance.rect.z);
+        minY = std::min(minY, instance.rect.y);
+        maxY = std::max(maxY, instance.rect.w);
     }
     console.warn("Final geometry bounding box: X in [", minX, ", ", maxX, "], Y in [", minY, ", ", maxY, "]");
     _currentBoundingBox = {minX, minY, maxX, maxY};
-
-    console.fatal("Time to tile: ", timeToTileMs, " ms");
-    console.fatal("Time to upload data: ", timeToUploadMs, " ms");
 }
 
-void VVTexture::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-    //console.logc1(__func__);
-    VkCommandBuffer commandBuffer = CommandUtils::beginSingleTimeCommands(_data->device, _data->commandPool);
+void VVTexture::uploadTiles(const std::vector<VVTexture*>& textures) {
+    while (std::any_of(textures.begin(), textures.end(), [](const VVTexture* texture) { return texture->isUploading(); })) {
+        uploadWave(textures);
+    }
+}
 
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {
-        width,
-        height,
-        1
+bool VVTexture::uploadWave(const std::vector<VVTexture*>& textures) {
+    struct PendingUpload {
+        VVTexture* texture;
+        size_t index; // Into the texture's PendingTiles::uploads
     };
-    vkCmdCopyBufferToImage(
-            commandBuffer,
-            buffer,
-            image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &region
-            );
-    CommandUtils::endSingleTimeCommands(_data->device, commandBuffer, _data->commandPool, _data->graphicsQueue);
+    std::vector<PendingUpload> pending;
+    std::shared_ptr<VVDataPacket> data;
+    bool focused = false;
+    for (auto* texture : textures) {
+        if (!texture->_pending) continue;
+        data = texture->_data;
+        focused |= static_cast<bool>(texture->_pending->focus);
+        for (size_t index : texture->_pending->uploadsLeft) pending.push_back({ texture, index });
+    }
+
+    bool changed = false;
+    if (!pending.empty()) {
+        if (focused) {
+            // Asked every wave, the camera may have moved since the last one. Tiles on screen in any texture go
+            // first, then by distance within their texture. Textures without a region keep their order, last.
+            std::map<VVTexture*, glm::vec4> regions;
+            for (const auto& upload : pending) {
+                if (regions.count(upload.texture)) continue;
+                const auto& focus = upload.texture->_pending->focus;
+                regions[upload.texture] = focus ? focus() : glm::vec4(0.0f);
+            }
+            auto priority = [&](const PendingUpload& upload) {
+                const glm::vec4& region = regions.at(upload.texture);
+                if (region.z <= region.x || region.w <= region.y) return std::make_tuple(1, 0.0f, 0.0f);
+                const auto [gap, offset] = getFocusPriority(upload.texture->_pending->uploadBounds[upload.index], region);
+                return std::make_tuple(0, gap, offset);
+            };
+            std::stable_sort(pending.begin(), pending.end(), [&](const PendingUpload& a, const PendingUpload& b) {
+                return priority(a) < priority(b);
+            });
+        }
+
+        // Without a focus everything goes in one wave, the uploader batches on its own.
+        const size_t minWaveTiles = focused ? std::max<size_t>(1, std::thread::hardware_concurrency()) : pending.size();
+        std::vector<Veloxr::VVTileUpload> wave;
+        VkDeviceSize waveBytes = 0;
+        while (wave.size() < pending.size()) {
+            const auto& upload = pending[wave.size()];
+            const auto& tileUpload = upload.texture->_pending->uploads[upload.index];
+            if (wave.size() >= minWaveTiles && waveBytes + tileUpload.size > UPLOAD_WAVE_BYTES) break;
+            waveBytes += tileUpload.size;
+            wave.push_back(tileUpload);
+        }
+
+        data->uploader->upload(wave);
+
+        for (size_t i = 0; i < wave.size(); i++) {
+            auto* texture = pending[i].texture;
+            auto& tiles = *texture->_pending;
+            tiles.uploads[pending[i].index].finalLayout = wave[i].finalLayout;
+            const size_t array = tiles.uploadArrays[pending[i].index];
+            if (--tiles.layersLeft[array] > 0) continue;
+
+            // Every layer of an array goes through the same path, the last one has the layout for the whole image.
+            auto& tile = texture->_tiledResult[array];
+            tile.textureImageView = texture->createTextureImageView(tile);
+            tile.imageLayout = wave[i].finalLayout;
+            if (data->descriptorHeap) {
+                data->descriptorHeap->write(tile.samplerIndex, tile.textureImageView, tile.imageLayout);
+            }
+            const auto& instances = tiles.arrayInstances[array];
+            texture->_instances.insert(texture->_instances.end(), instances.begin(), instances.end());
+            tiles.publishedInstances += instances.size();
+            changed = true;
+        }
+
+        for (auto* texture : textures) {
+            if (texture->_pending) texture->_pending->uploadsLeft.clear();
+        }
+        for (size_t i = wave.size(); i < pending.size(); i++) pending[i].texture->_pending->uploadsLeft.push_back(pending[i].index);
+        textures.front()->console.logc1("Upload wave of ", wave.size(), " tiles, ", pending.size() - wave.size(), " left.");
+    }
+
+    for (auto* texture : textures) {
+        if (!texture->_pending || !texture->_pending->uploadsLeft.empty()) continue;
+        texture->finishTiles();
+        changed = true;
+    }
+    return changed;
 }
 
-void VVTexture::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-    //console.logc1(__func__);
-    VkCommandBuffer commandBuffer = CommandUtils::beginSingleTimeCommands(_data->device, _data->commandPool);
+void VVTexture::finishTiles() {
+    auto& pending = *_pending;
+    if (canEvictTiles()) {
+        // The tiled result goes away with the pending tiles, move the upload ready bytes over so evicted tiles can come back.
+        for (size_t array = 0; array < pending.arrayTiles.size(); array++) {
+            for (int samplerIndexBase : pending.arrayTiles[array]) {
+                _tiledResult[array].hostLayers.push_back(std::move(pending.tiles.tiles.at(samplerIndexBase).pixelData));
+            }
+        }
+    }
+    auto timeToUploadMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - pending.uploadStart).count();
+
+    if (pending.overview) {
+        const auto now = std::chrono::high_resolution_clock::now();
+        createOverview(*pending.buffer, pending.tiles.vertices);
+        auto timeToOverviewMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
+        console.fatal("Time to build overview: ", timeToOverviewMs, " ms");
+    }
+
+    // Replaces the instances published as their arrays landed, the overview changed their scales.
+    _instances.erase(_instances.end() - static_cast<std::ptrdiff_t>(pending.publishedInstances), _instances.end());
+    const auto instances = Veloxr::TileInstance::fromQuads(pending.tiles.vertices);
+    _instances.insert(_instances.begin(), instances.begin(), instances.end());
+    updateBoundingBox(_instances);
+
+    console.fatal("Time to tile: ", pending.timeToTileMs, " ms");
+    console.fatal("Time to upload data (", _data->uploader->getName(), "): ", timeToUploadMs, " ms");
+    _pending.reset();
+}
+
+void VVTexture::createOverview(const Veloxr::VeloxrBuffer& buffer, std::vector<Veloxr::Vertex>& tileVertices) {
+    const uint64_t factor = (std::max(buffer.width, buffer.height) + OVERVIEW_MAX_EDGE - 1) / OVERVIEW_MAX_EDGE;
+    if (factor < 2) return; // Already small, the tiles are the overview.
+
+    const uint32_t width = static_cast<uint32_t>((buffer.width + factor - 1) / factor);
+    const uint32_t height = static_cast<uint32_t>((buffer.height + factor - 1) / factor);
+
+    // Box filter straight into RGBA in the buffer's channel order, one output row per task.
+    Veloxr::PixelBuffer pixels(static_cast<size_t>(width) * height * 4);
+    VVUtils::parallelFor(height, [&](size_t y) {
+        fillTexels(buffer, { 0, 0 }, static_cast<uint32_t>(factor), { 0, static_cast<uint32_t>(y), width, 1 }, 4, pixels.data() + y * width * 4, width * 4);
+    });
+
+    const VkFormat format = getTileFormat(4, buffer.channelOrder);
+    Veloxr::VVTileData overviewData{};
+    overviewData.samplerIndex = _tileManager.getTextureSlot();
+    overviewData.format = format;
+    overviewData.components = getTileSwizzle(4, buffer.channelOrder);
+    overviewData.width = width;
+    overviewData.height = height;
+    overviewData.scale = static_cast<uint32_t>(factor);
+    overviewData.layerOrigins.push_back({ 0, 0 });
+
+    const Veloxr::VVTileImageDesc desc = _data->uploader->getImageDesc(format, width, height, 1, false);
+    createImage(width, height, 1, format, desc, overviewData.textureImage, overviewData.textureImageMemory);
+
+    std::vector<Veloxr::VVTileUpload> uploads(1);
+    uploads[0].pixels = pixels.data();
+    uploads[0].size = pixels.size();
+    uploads[0].hostImportable = true;
+    uploads[0].width = width;
+    uploads[0].height = height;
+    uploads[0].format = format;
+    uploads[0].image = overviewData.textureImage;
+    uploads[0].tiling = desc.tiling;
+    uploads[0].mapped = overviewData.textureImageMemory.mapped;
+    _data->uploader->upload(uploads);
+
+    overviewData.textureImageView = createTextureImageView(overviewData);
+    overviewData.imageLayout = uploads[0].finalLayout;
+    if (_data->descriptorHeap) {
+        _data->descriptorHeap->write(overviewData.samplerIndex, overviewData.textureImageView, overviewData.imageLayout);
+    }
+
+    // The vertex shader picks one of the two sets per entity from the sign.
+    for (auto& v : tileVertices) v.overviewScale = -static_cast<float>(factor);
+    auto quad = Veloxr::TextureTiling::makeQuad(static_cast<uint32_t>(buffer.width), static_cast<uint32_t>(buffer.height),
+            static_cast<int>(buffer.orientation), static_cast<int>(overviewData.samplerIndex));
+    for (auto& v : quad) v.overviewScale = static_cast<float>(factor);
+    overviewData.layerBounds.push_back({ quad[0].pos.x, quad[0].pos.y, quad[2].pos.x, quad[2].pos.y });
+    tileVertices.insert(tileVertices.end(), quad.begin(), quad.end());
+
+    console.log("Overview ", width, " x ", height, " (1/", factor, ") with texture slot index: ", overviewData.samplerIndex);
+    _tiledResult.emplace_back(std::move(overviewData));
+}
+
+bool VVTexture::canEvictTiles() const {
+    // Without the heap the tile images are baked into the shader stage's descriptor sets.
+    return _data->settings.tileEviction && _data->descriptorHeap && _data->memoryBudget;
+}
+
+bool VVTexture::markVisible(const glm::vec4& region, uint64_t frame) {
+    bool missing = false;
+    for (auto& tile : _tiledResult) {
+        if (tile.cropped) continue;
+        const bool visible = std::any_of(tile.layerBounds.begin(), tile.layerBounds.end(), [&](const glm::vec4& bounds) {
+            return bounds.x < region.z && bounds.z > region.x && bounds.y < region.w && bounds.w > region.y;
+        });
+        if (!visible) continue;
+        tile.lastVisible = frame;
+        missing |= !tile.resident;
+    }
+    return missing;
+}
+
+void VVTexture::reloadVisible(uint64_t frame) {
+    std::shared_ptr<Veloxr::VeloxrBuffer> buffer;
+    for (auto& tile : _tiledResult) {
+        if (tile.resident || tile.lastVisible != frame) continue;
+        uploadTile(tile, buffer);
+    }
+}
+
+bool VVTexture::canReload(const Veloxr::VVTileData& tile) const {
+    return tile.hostLayers.size() == tile.layerCount || (_source && tile.layerOrigins.size() == tile.layerCount);
+}
+
+bool VVTexture::releaseHostPixels(Veloxr::PixelSource source) {
+    std::lock_guard<std::mutex> lock(_regionMutex);
+    if (!source || _pending || _virtualTextureId >= 0 || _edited) return false;
+    _source = std::move(source);
+
+    const bool tileCache = _data->tileCache && _data->tileCache->isEnabled();
+    size_t released = 0;
+    for (auto& tile : _tiledResult) {
+        if (!tile.channels && !tileCache) continue;
+        for (const auto& layer : tile.hostLayers) released += layer.size();
+        std::vector<Veloxr::PixelBuffer>().swap(tile.hostLayers);
+    }
+    if (_buffer) {
+        released += _buffer->data.size();
+        _releasedBuffer = _buffer;
+        _buffer.reset();
+    }
+    console.log("Released ", released / 1024 / 1024, " MB of host pixels, reloading from the pixel source.");
+    return true;
+}
 
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.srcAccessMask = 0; // TODO
-    barrier.dstAccessMask = 0; // TODO
-
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
+std::shared_ptr<Veloxr::VeloxrBuffer> VVTexture::acquireBuffer() {
+    if (_buffer) return _buffer;
+    if (auto buffer = _releasedBuffer.lock()) return buffer;
+    if (!_source) throw std::runtime_error("failed to acquire texture pixels, released without a pixel source!");
+
+    const auto now = std::chrono::high_resolution_clock::now();
+    auto buffer = _source();
+    if (!buffer || buffer->data.empty()) throw std::runtime_error("failed to acquire texture pixels, the pixel source is empty!");
+    _releasedBuffer = buffer;
+    const auto timeToLoadMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
+    console.log("Pixels ", buffer->width, " x ", buffer->height, " produced again from the pixel source in ", timeToLoadMs, " ms.");
+    return buffer;
+}
+
+std::vector<Veloxr::PixelBuffer> VVTexture::materializeLayers(const Veloxr::VVTileData& tile, const Veloxr::VeloxrBuffer& buffer) {
+    // Block compressed tiles were encoded from RGBA, the tile cache usually has them under the same key.
+    const uint32_t channels = tile.channels ? tile.channels : 4;
+    const Veloxr::TileCompression compression = tile.format == Veloxr::VVBlockEncoder::getFormat(Veloxr::TileCompression::BC1) ?
+        Veloxr::TileCompression::BC1 : Veloxr::TileCompression::BC7;
+
+    std::vector<Veloxr::PixelBuffer> layers(tile.layerOrigins.size());
+    for (size_t layer = 0; layer < layers.size(); layer++) {
+        Veloxr::TextureData data{};
+        data.width = tile.width;
+        data.height = tile.height;
+        data.channels = channels;
+        data.pixelData.resize(static_cast<size_t>(tile.width) * tile.height * channels);
+        VVUtils::parallelFor(tile.height, [&](size_t y) {
+            fillTexels(buffer, tile.layerOrigins[layer], tile.scale, { 0, static_cast<uint32_t>(y), tile.width, 1 }, channels,
+                    data.pixelData.data() + y * tile.width * channels, static_cast<size_t>(tile.width) * channels);
+        });
+        if (!tile.channels) compressTile(data, compression);
+        layers[layer] = std::move(data.pixelData);
+    }
+    return layers;
+}
+
+void VVTexture::uploadTile(Veloxr::VVTileData& tile, std::shared_ptr<Veloxr::VeloxrBuffer>& buffer) {
+    std::vector<Veloxr::PixelBuffer> materialized;
+    const bool hostLayers = tile.hostLayers.size() == tile.layerCount;
+    if (!hostLayers) {
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(_regionMutex);
+            buffer = acquireBuffer();
+        }
+        materialized = materializeLayers(tile, *buffer);
+    }
+    const auto& layers = hostLayers ? tile.hostLayers : materialized;
+
+    const Veloxr::VVTileImageDesc desc = _data->uploader->getImageDesc(tile.format, tile.width, tile.height, tile.layerCount, tile.packedRGB);
+    createImage(tile.width, tile.height, tile.layerCount, tile.format, desc, tile.textureImage, tile.textureImageMemory);
+
+    std::vector<Veloxr::VVTileUpload> uploads(tile.layerCount);
+    for (uint32_t layer = 0; layer < tile.layerCount; layer++) {
+        auto& upload = uploads[layer];
+        upload.pixels = layers[layer].data();
+        upload.size = layers[layer].size();
+        upload.hostImportable = true;
+        upload.width = tile.width;
+        upload.height = tile.height;
+        upload.format = tile.format;
+        upload.image = tile.textureImage;
+        upload.layer = layer;
+        upload.tiling = desc.tiling;
+        upload.mapped = tile.textureImageMemory.mapped;
+        upload.packedRGB = tile.packedRGB;
+    }
+    _data->uploader->upload(uploads);
+
+    tile.textureImageView = createTextureImageView(tile);
+    tile.imageLayout = uploads.back().finalLayout;
+    tile.resident = true;
+    // Without the heap the descriptor sets are written again with the draw list.
+    if (_data->descriptorHeap) _data->descriptorHeap->write(tile.samplerIndex, tile.textureImageView, tile.imageLayout);
+}
+
+VkDeviceSize VVTexture::evictTile(size_t index) {
+    auto& tile = _tiledResult.at(index);
+    if (!tile.resident || !canReload(tile)) return 0;
+
+    _data->descriptorHeap->write(tile.samplerIndex, _data->memoryBudget->getPlaceholderView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    const VkDeviceSize bytes = tile.textureImageMemory.size;
+    vkDestroyImageView(_data->device, tile.textureImageView, nullptr);
+    vkDestroyImage(_data->device, tile.textureImage, nullptr);
+    _data->allocator->free(tile.textureImageMemory);
+    tile.textureImageView = VK_NULL_HANDLE;
+    tile.textureImage = VK_NULL_HANDLE;
+    tile.textureImageMemory = {};
+    tile.resident = false;
+    return bytes;
+}
+
+VkDeviceSize VVTexture::releaseOutside(const glm::vec4& region) {
+    VkDeviceSize freed = 0;
+    std::set<int> released;
+    for (size_t i = 0; i < _tiledResult.size(); i++) {
+        auto& tile = _tiledResult[i];
+        const bool inside = std::any_of(tile.layerBounds.begin(), tile.layerBounds.end(), [&](const glm::vec4& bounds) {
+            return bounds.x < region.z && bounds.z > region.x && bounds.y < region.w && bounds.w > region.y;
+        });
+        if (inside || tile.cropped || tile.layerBounds.empty()) continue;
+
+        if (tile.resident && canReload(tile) && _data->descriptorHeap && _data->memoryBudget) {
+            freed += evictTile(i);
+        } else if (tile.resident) {
+            // Slot stays reserved so the vertices can come back unchanged, it points at the placeholder meanwhile.
+            if (_data->descriptorHeap && _data->memoryBudget) {
+                _data->descriptorHeap->write(tile.samplerIndex, _data->memoryBudget->getPlaceholderView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            }
+            freed += tile.textureImageMemory.size;
+            vkDestroyImageView(_data->device, tile.textureImageView, nullptr);
+            vkDestroyImage(_data->device, tile.textureImage, nullptr);
+            _data->allocator->free(tile.textureImageMemory);
+            tile.textureImageView = VK_NULL_HANDLE;
+            tile.textureImage = VK_NULL_HANDLE;
+            tile.textureImageMemory = {};
+            tile.resident = false;
+        }
+        tile.cropped = true;
+        released.insert(static_cast<int>(tile.samplerIndex));
+    }
+    if (released.empty()) return 0;
+
+    auto outside = std::stable_partition(_instances.begin(), _instances.end(), [&](const Veloxr::TileInstance& instance) {
+        return !released.count(instance.textureUnit);
+    });
+    _croppedInstances.insert(_croppedInstances.end(), outside, _instances.end());
+    _instances.erase(outside, _instances.end());
+    console.log("Released ", released.size(), " tile arrays outside the crop, ", freed / 1024 / 1024, " MB.");
+    return freed;
+}
+
+bool VVTexture::restoreCropped() {
+    bool restored = true;
+    std::shared_ptr<Veloxr::VeloxrBuffer> buffer;
+    for (auto& tile : _tiledResult) {
+        if (!tile.cropped) continue;
+        tile.cropped = false;
+        if (tile.resident) continue;
+        if (canReload(tile)) uploadTile(tile, buffer);
+        else restored = false;
+    }
+    _instances.insert(_instances.end(), _croppedInstances.begin(), _croppedInstances.end());
+    _croppedInstances.clear();
+    return restored;
+}
+
+void VVTexture::fillTexels(const Veloxr::VeloxrBuffer& buffer, const glm::uvec2& origin, uint32_t scale,
+        const glm::uvec4& texels, uint32_t channels, unsigned char* dst, size_t dstPitch) {
+    const uint64_t srcChannels = buffer.numChannels;
+    if (scale == 1) {
+        for (uint32_t row = 0; row < texels.w; row++) {
+            const unsigned char* src = buffer.data.data() + ((origin.y + texels.y + row) * buffer.width + origin.x + texels.x) * srcChannels;
+            Veloxr::TextureTiling::convertPixels(src, srcChannels, dst + row * dstPitch, channels, texels.z);
+        }
+        return;
+    }
+
+    const uint64_t firstColumn = origin.x + static_cast<uint64_t>(texels.x) * scale;
+    const uint64_t lastColumn = std::min<uint64_t>(origin.x + static_cast<uint64_t>(texels.x + texels.z) * scale, buffer.width);
+    std::vector<uint32_t> sums(static_cast<size_t>(texels.z) * 4);
+    for (uint32_t texelRow = 0; texelRow < texels.w; texelRow++) {
+        std::fill(sums.begin(), sums.end(), 0);
+        const uint64_t firstRow = origin.y + static_cast<uint64_t>(texels.y + texelRow) * scale;
+        const uint64_t lastRow = std::min<uint64_t>(firstRow + scale, buffer.height);
+        for (uint64_t row = firstRow; row < lastRow; row++) {
+            const unsigned char* src = buffer.data.data() + (row * buffer.width + firstColumn) * srcChannels;
+            for (uint64_t x = firstColumn; x < lastColumn; x++, src += srcChannels) {
+                uint32_t* sum = &sums[((x - firstColumn) / scale) * 4];
+                switch (srcChannels) {
+                    case 1: sum[0] += src[0]; sum[1] += src[0]; sum[2] += src[0]; sum[3] += 255; break;
+                    case 2: sum[0] += src[0]; sum[1] += src[0]; sum[2] += src[0]; sum[3] += src[1]; break;
+                    case 3: sum[0] += src[0]; sum[1] += src[1]; sum[2] += src[2]; sum[3] += 255; break;
+                    default: sum[0] += src[0]; sum[1] += src[1]; sum[2] += src[2]; sum[3] += src[3]; break;
+                }
+            }
+        }
+        unsigned char* out = dst + texelRow * dstPitch;
+        for (uint32_t x = 0; x < texels.z; x++) {
+            // Edge texels average fewer source pixels.
+            const uint64_t columns = std::min<uint64_t>(scale, lastColumn - (firstColumn + static_cast<uint64_t>(x) * scale));
+            const uint32_t count = static_cast<uint32_t>(columns * (lastRow - firstRow));
+            for (uint32_t c = 0; c < 4; c++) out[x * 4 + c] = static_cast<unsigned char>((sums[x * 4 + c] + count / 2) / count);
+        }
+    }
+}
+
+void VVTexture::updateRegion(const glm::uvec4& rect, const unsigned char* pixels, size_t pitch) {
+    std::lock_guard<std::mutex> lock(_regionMutex);
+    if ((!_buffer && !_source) || !pixels) {
+        console.warn("Region update on a texture that was never loaded, ignoring.");
+        return;
+    }
+    // Released pixels come back for good, the source would undo the edit.
+    if (!_buffer) _buffer = acquireBuffer();
+    _edited = true;
+
+    const uint64_t channels = _buffer->numChannels;
+    const uint64_t x0 = std::min<uint64_t>(rect.x, _buffer->width), x1 = std::min<uint64_t>(uint64_t(rect.x) + rect.z, _buffer->width);
+    const uint64_t y0 = std::min<uint64_t>(rect.y, _buffer->height), y1 = std::min<uint64_t>(uint64_t(rect.y) + rect.w, _buffer->height);
+    if (x0 >= x1 || y0 >= y1) return;
+    if (!pitch) pitch = static_cast<size_t>(rect.z * channels);
+
+    for (uint64_t y = y0; y < y1; y++) {
+        std::memcpy(_buffer->data.data() + (y * _buffer->width + x0) * channels, pixels + (y - rect.y) * pitch, static_cast<size_t>((x1 - x0) * channels));
+    }
+    _pendingRegions.push_back({ x0, y0, x1 - x0, y1 - y0 });
+}
+
+bool VVTexture::hasPendingRegions() {
+    std::lock_guard<std::mutex> lock(_regionMutex);
+    return !_pendingRegions.empty();
+}
+
+bool VVTexture::uploadRegions() {
+    if (_pending) return false;
+    std::lock_guard<std::mutex> lock(_regionMutex);
+    if (_pendingRegions.empty()) return false;
+    const std::vector<glm::uvec4> regions = std::move(_pendingRegions);
+    _pendingRegions.clear();
+
+    if (_virtualTextureId >= 0 && _data->virtualTextures) {
+        for (const auto& rect : regions) _data->virtualTextures->invalidateRegion(static_cast<uint32_t>(_virtualTextureId), rect);
+        return true;
+    }
+
+    struct RegionCopy {
+        size_t tile;
+        uint32_t layer;
+        glm::uvec4 texels;
+        VkDeviceSize offset;
+    };
+    std::vector<RegionCopy> copies;
+    VkDeviceSize stagingSize = 0;
+    bool skippedCompressed = false;
+
+    for (size_t i = 0; i < _tiledResult.size(); i++) {
+        const auto& tile = _tiledResult[i];
+        for (uint32_t layer = 0; layer < tile.layerOrigins.size(); layer++) {
+            const glm::uvec2 origin = tile.layerOrigins[layer];
+            for (const auto& rect : regions) {
+                // Buffer pixels to texels, a partly covered overview texel is filtered again as a whole.
+                const uint64_t x0 = std::max<uint64_t>(rect.x, origin.x), x1 = std::min<uint64_t>(uint64_t(rect.x) + rect.z, origin.x + uint64_t(tile.width) * tile.scale);
+                const uint64_t y0 = std::max<uint64_t>(rect.y, origin.y), y1 = std::min<uint64_t>(uint64_t(rect.y) + rect.w, origin.y + uint64_t(tile.height) * tile.scale);
+                if (x0 >= x1 || y0 >= y1) continue;
+                if (!tile.channels) {
+                    skippedCompressed = true;
+                    continue;
+                }
+                const uint32_t tx0 = static_cast<uint32_t>((x0 - origin.x) / tile.scale), tx1 = static_cast<uint32_t>((x1 - origin.x + tile.scale - 1) / tile.scale);
+                const uint32_t ty0 = static_cast<uint32_t>((y0 - origin.y) / tile.scale), ty1 = static_cast<uint32_t>((y1 - origin.y + tile.scale - 1) / tile.scale);
+                const glm::uvec4 texels{ tx0, ty0, tx1 - tx0, ty1 - ty0 };
+
+                // Evicted and cropped tiles come back from the host layers, keep those current too.
+                if (tile.hostLayers.size() == tile.layerCount) {
+                    const size_t rowBytes = static_cast<size_t>(tile.width) * tile.channels;
+                    fillTexels(*_buffer, origin, tile.scale, texels, tile.channels,
+                            _tiledResult[i].hostLayers[layer].data() + texels.y * rowBytes + texels.x * tile.channels, rowBytes);
+                }
+                if (!tile.resident) continue;
+
+                // Packed RGB tiles were expanded into an RGBA image.
+                const uint32_t imageChannels = tile.packedRGB ? 4 : tile.channels;
+                copies.push_back({ i, layer, texels, stagingSize });
+                stagingSize = (stagingSize + static_cast<VkDeviceSize>(texels.z) * texels.w * imageChannels + 3) & ~VkDeviceSize(3);
+            }
+        }
+    }
+    if (skippedCompressed) console.warn("Block compressed tiles are not updated in place, initialize() again to see the change.");
+    if (copies.empty()) return true;
+
+    VkBuffer stagingBuffer;
+    Veloxr::VVAllocation stagingMemory;
+    VVUtils::createBuffer(_data, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
+    VVUtils::parallelFor(copies.size(), [&](size_t c) {
+        const auto& copy = copies[c];
+        const auto& tile = _tiledResult[copy.tile];
+        const uint32_t imageChannels = tile.packedRGB ? 4 : tile.channels;
+        fillTexels(*_buffer, tile.layerOrigins[copy.layer], tile.scale, copy.texels, imageChannels,
+                static_cast<unsigned char*>(stagingMemory.mapped) + copy.offset, static_cast<size_t>(copy.texels.z) * imageChannels);
+    });
+
+    VkCommandBuffer commandBuffer = CommandUtils::beginSingleTimeCommands(_data->device, _data->commandPool);
+    std::map<size_t, std::vector<VkBufferImageCopy>> regionsPerTile;
+    for (const auto& copy : copies) {
+        VkBufferImageCopy region{};
+        region.bufferOffset = copy.offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = copy.layer;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { static_cast<int32_t>(copy.texels.x), static_cast<int32_t>(copy.texels.y), 0 };
+        region.imageExtent = { copy.texels.z, copy.texels.w, 1 };
+        regionsPerTile[copy.tile].push_back(region);
+    }
+    for (const auto& [index, tileRegions] : regionsPerTile) {
+        const auto& tile = _tiledResult[index];
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = tile.textureImage;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, tile.layerCount };
+        barrier.oldLayout = tile.imageLayout;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
         barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, tile.textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                static_cast<uint32_t>(tileRegions.size()), tileRegions.data());
 
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = tile.imageLayout;
         barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
         barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else {
-        throw std::invalid_argument("unsupported layout transition!");
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
     }
+    CommandUtils::endSingleTimeCommands(_data->device, commandBuffer, _data->commandPool, _data->graphicsQueue);
+    VVUtils::destroyBuffer(_data, stagingBuffer, stagingMemory);
 
-    vkCmdPipelineBarrier(
-            commandBuffer,
-            sourceStage,
-            destinationStage,
-            0,
-            0, nullptr,
-            0, nullptr,
-            1, &barrier
-            );
+    console.logc1("Updated ", regions.size(), " regions with ", copies.size(), " tile copies, ", stagingSize / 1024, " KB.");
+    return true;
+}
 
-    CommandUtils::endSingleTimeCommands(_data->device, commandBuffer, _data->commandPool, _data->graphicsQueue);
+std::pair<float, float> VVTexture::getFocusPriority(const glm::vec4& tile, const glm::vec4& region) {
+    // Gap between the rectangles first (0 when the tile is on screen), then distance to the view center.
+    const float dx = std::max({0.0f, region.x - tile.z, tile.x - region.z});
+    const float dy = std::max({0.0f, region.y - tile.w, tile.y - region.w});
+    const glm::vec2 offset = (glm::vec2(tile.x, tile.y) + glm::vec2(tile.z, tile.w)) * 0.5f
+                           - (glm::vec2(region.x, region.y) + glm::vec2(region.z, region.w)) * 0.5f;
+    return { dx * dx + dy * dy, glm::dot(offset, offset) };
 }
 
-void VVTexture::createImage(uint32_t width, uint32_t height, VkFormat format,
-        VkImageTiling tiling, VkImageUsageFlags usage,
-        VkMemoryPropertyFlags properties,
-        VkImage& image, VkDeviceMemory& imageMemory) {
+void VVTexture::createImage(uint32_t width, uint32_t height, uint32_t layers, VkFormat format,
+        const Veloxr::VVTileImageDesc& desc,
+        VkImage& image, Veloxr::VVAllocation& imageMemory) {
     //console.logc1(__func__);
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -203,11 +799,13 @@ void VVTexture::createImage(uint32_t width, uint32_t height, VkFormat format,
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
     imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
-    imageInfo.format = format;
-    imageInfo.tiling = tiling;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = usage;
+    imageInfo.arrayLayers = layers;
+    imageInfo.flags = desc.flags;
+    imageInfo.format = desc.imageFormat != VK_FORMAT_UNDEFINED ? desc.imageFormat : format;
+    imageInfo.tiling = desc.tiling;
+    imageInfo.initialLayout = desc.initialLayout;
+    // updateRegion() copies into tiles whatever path first filled them.
+    imageInfo.usage = desc.usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
@@ -218,31 +816,25 @@ void VVTexture::createImage(uint32_t width, uint32_t height, VkFormat format,
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(_data->device, image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = VVUtils::findMemoryType(_data, memRequirements.memoryTypeBits, properties);
+    imageMemory = _data->allocator->allocate(memRequirements, desc.memoryProperties, desc.tiling == VK_IMAGE_TILING_LINEAR);
 
-    if (vkAllocateMemory(_data->device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
-    }
-
-    vkBindImageMemory(_data->device, image, imageMemory, 0);
+    vkBindImageMemory(_data->device, image, imageMemory.memory, imageMemory.offset);
 }
 
 
-VkImageView VVTexture::createImageView(VkImage image, VkFormat format) {
+VkImageView VVTexture::createImageView(VkImage image, VkFormat format, uint32_t layers, VkComponentMapping components) {
     console.logc1(__func__);
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = image;
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
     viewInfo.format = format;
+    viewInfo.components = components;
     viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     viewInfo.subresourceRange.baseMipLevel = 0;
     viewInfo.subresourceRange.levelCount = 1;
     viewInfo.subresourceRange.baseArrayLayer = 0;
-    viewInfo.subresourceRange.layerCount = 1;
+    viewInfo.subresourceRange.layerCount = layers;
 
     VkImageView imageView;
     if (vkCreateImageView(_data->device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
@@ -251,48 +843,70 @@ VkImageView VVTexture::createImageView(VkImage image, VkFormat format) {
 
     return imageView;
 }
-VkImageView VVTexture::createTextureImageView(VkImage textureImage) {
+VkImageView VVTexture::createTextureImageView(const Veloxr::VVTileData& tile) {
     console.logc1(__func__);
-    return createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB);
+    _generation = ++_nextGeneration;
+    return createImageView(tile.textureImage, tile.format, tile.layerCount, tile.components);
 }
 
-VkSampler VVTexture::createTextureSampler() {
-    console.logc1(__func__);
+uint32_t VVTexture::getMaxArrayLayers(VkDeviceSize layerSize) const {
+    if (!_data->settings.packTileArrays) return 1;
 
-    VkSampler textureSampler;
-    VkSamplerCreateInfo samplerInfo{};
-    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    // TODO: See if Linear is better for filter
-    samplerInfo.magFilter = VK_FILTER_NEAREST;
-    samplerInfo.minFilter = VK_FILTER_NEAREST;
-    // TODO: SEe how to repeat, I think clamp
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_data->physicalDevice, &properties);
+    const VkDeviceSize byteLimit = std::max<VkDeviceSize>(1, MAX_ARRAY_BYTES / std::max<VkDeviceSize>(layerSize, 1));
+    return static_cast<uint32_t>(std::max<VkDeviceSize>(1, std::min<VkDeviceSize>(properties.limits.maxImageArrayLayers, byteLimit)));
+}
 
-    // TODO: Test with/without this.createGraphicsPipeline
-    samplerInfo.anisotropyEnable = VK_FALSE;
-    samplerInfo.maxAnisotropy = 1.0f;
-    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+bool VVTexture::isCompressionSupported(Veloxr::TileCompression compression) const {
+    return _data->features.textureCompressionBC && isSampledFormatSupported(Veloxr::VVBlockEncoder::getFormat(compression));
+}
 
-    // false = normalized, true = [0, texWidth], [0, texHeight]
-    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+void VVTexture::compressTile(Veloxr::TextureData& tile, Veloxr::TileCompression compression) {
+    const size_t encodedSize = static_cast<size_t>(Veloxr::VVBlockEncoder::getEncodedSize(tile.width, tile.height, compression));
+    const auto& cache = _data->tileCache;
+
+    Veloxr::VVTileCache::Key key{};
+    if (cache && cache->isEnabled()) {
+        key = Veloxr::VVTileCache::makeKey(tile.pixelData.data(), tile.pixelData.size(), tile.width, tile.height, compression);
+        Veloxr::PixelBuffer cached;
+        if (cache->load(key, encodedSize, cached)) {
+            console.logc1("Tile cache hit ", key.hash);
+            tile.pixelData = std::move(cached);
+            return;
+        }
+    }
 
-    // Shadow mapping, ignore.
-    samplerInfo.compareEnable = VK_FALSE;
-    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+    Veloxr::PixelBuffer encoded = Veloxr::VVBlockEncoder::encode(tile.pixelData.data(), tile.width, tile.height, compression);
+    if (cache && cache->isEnabled()) cache->store(key, encoded);
+    tile.pixelData = std::move(encoded);
+}
 
-    // TODO: Mipmap
-    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerInfo.mipLodBias = 0.0f;
-    samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
+bool VVTexture::isSampledFormatSupported(VkFormat format) const {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(_data->physicalDevice, format, &properties);
+    return properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+}
 
-    if (vkCreateSampler(_data->device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create texture sampler!");
+VkFormat VVTexture::getTileFormat(uint32_t channels, Veloxr::ChannelOrder order) {
+    // sRGB like the swapchain, so gray values are decoded the same way RGBA tiles were.
+    switch (channels) {
+        case 1: return VK_FORMAT_R8_SRGB;
+        case 2: return VK_FORMAT_R8G8_SRGB;
+        case 3: return VK_FORMAT_R8G8B8A8_SRGB; // Packed RGB, expanded on upload. BGR is handled by the swizzle.
+        default: return order == Veloxr::ChannelOrder::BGRA ? VK_FORMAT_B8G8R8A8_SRGB : VK_FORMAT_R8G8B8A8_SRGB;
     }
+}
 
-    return textureSampler;
+VkComponentMapping VVTexture::getTileSwizzle(uint32_t channels, Veloxr::ChannelOrder order) {
+    switch (channels) {
+        case 1: return { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_ONE };
+        case 2: return { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G };
+        case 3:
+            if (order == Veloxr::ChannelOrder::BGRA) return { VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_IDENTITY };
+            return {};
+        default: return { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY };
+    }
 }
 
 void VVTexture::destroy() {
@@ -303,28 +917,22 @@ void VVTexture::destroy() {
 
     console.log("Destroying on device: ", _data->device);
 
-    for(auto& [textureImage, textureImageMemory, textureImageView, textureSampler, _] : _tiledResult) {
-        if (textureSampler) {
-            console.logc1("Destroying Sampler");
-            vkDestroySampler(_data->device, textureSampler, nullptr);
-            console.logc1("Destroyed.");
-        }
-
-        if ( textureImageView ) {
+    for(auto& tile : _tiledResult) {
+        if ( tile.textureImageView ) {
             console.logc1("Destroying ImageView");
-            vkDestroyImageView(_data->device, textureImageView, nullptr);
+            vkDestroyImageView(_data->device, tile.textureImageView, nullptr);
             console.logc1("Destroyed.");
         }
 
-        if ( textureImage ) {
+        if ( tile.textureImage ) {
             console.logc1("Destroying Image");
-            vkDestroyImage(_data->device, textureImage, nullptr);
+            vkDestroyImage(_data->device, tile.textureImage, nullptr);
             console.logc1("Destroyed.");
         }
 
-        if ( textureImageMemory ) {
+        if ( tile.textureImageMemory.isValid() ) {
             console.logc1("Freeing textureImageMemory");
-            vkFreeMemory(_data->device, textureImageMemory, nullptr);
+            _data->allocator->free(tile.textureImageMemory);
             console.logc1("Destroyed.");
         }
     }
@@ -334,7 +942,22 @@ void VVTexture::destroy() {
     }
 
     _tiledResult.clear();
-    _vertices.clear();
+    _instances.clear();
+    _pending.reset();
+    _croppedInstances.clear();
+    {
+        std::lock_guard<std::mutex> lock(_regionMutex);
+        _pendingRegions.clear();
+        _buffer.reset();
+        _releasedBuffer.reset();
+        _source = {};
+        _edited = false;
+    }
+
+    if (_virtualTextureId >= 0 && _data->virtualTextures) {
+        _data->virtualTextures->unregisterTexture(static_cast<uint32_t>(_virtualTextureId));
+    }
+    _virtualTextureId = -1;
 }
 
 VVTexture::~VVTexture() {
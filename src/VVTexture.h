@@ -6,16 +6,39 @@
 #include "VLogger.h"
 #include "CommandUtils.h"
 #include "Vertex.h"
+#include "VVTileUploader.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <mutex>
 
 namespace Veloxr {
 
     struct VVTileData{
         VkImage textureImage;
-        VkDeviceMemory textureImageMemory;
+        Veloxr::VVAllocation textureImageMemory;
         VkImageView textureImageView;
-        VkSampler textureSampler;
         uint32_t samplerIndex;
+        uint32_t layerCount{1}; // Tiles of the same extent are layers of one 2D array image.
+        VkImageLayout imageLayout{VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkFormat format{VK_FORMAT_R8G8B8A8_SRGB};
+        VkComponentMapping components{}; // Broadcasts gray tiles to RGB in the view, no shader changes needed.
+
+        // Where the texels come from, see VVTexture::updateRegion.
+        uint32_t channels{4}; // Host bytes per texel (3 for packed RGB), 0 for block compressed tiles.
+        uint32_t scale{1}; // Buffer pixels per texel along each axis, the overview is box filtered.
+        std::vector<glm::uvec2> layerOrigins; // Buffer pixels, before the EXIF orientation.
+
+        // Residency, see EntityManager::updateResidency.
+        uint32_t width{0}, height{0};
+        bool packedRGB{false};
+        bool resident{true};
+        bool cropped{false}; // Released by releaseOutside(), its vertices are out of the draw list until restoreCropped().
+        uint64_t lastVisible{0};
+        std::vector<glm::vec4> layerBounds; // Entity space.
+        std::vector<Veloxr::PixelBuffer> hostLayers; // Upload ready bytes per layer, only kept with VVRenderSettings::tileEviction
+                                                     // and until releaseHostPixels().
     };
 
     class VVTexture {
@@ -25,14 +48,75 @@ namespace Veloxr {
             VVTexture(std::shared_ptr<VVDataPacket> dataPacket);
             void setDataPacket(std::shared_ptr<VVDataPacket> dataPacket);
 
-            void tileTexture(std::shared_ptr<Veloxr::VeloxrBuffer> buffer);
+            // focus is an entity space (minX, minY, maxX, maxY). Tiles closest to it are uploaded first, all of them
+            // before this returns.
+            // overview also builds a box filtered copy of at most OVERVIEW_MAX_EDGE on the long edge, drawn instead of
+            // the tiles while one screen pixel covers at least as many image pixels as one overview texel.
+            void tileTexture(std::shared_ptr<Veloxr::VeloxrBuffer> buffer, Veloxr::TileCompression compression = Veloxr::TileCompression::None,
+                    const std::function<glm::vec4()>& focus = {}, bool overview = false);
+            // tileTexture() in steps, so several textures tile at once and share upload waves. prepareTiles() is the
+            // CPU work (tiling, block compression) and may run on a worker thread, after destroy() on the render thread.
+            // createTiles() makes the images. uploadWave() fills the next wave of every texture passed, closest to each
+            // one's focus as asked right then, so waves spread over frames follow the camera. An array joins
+            // getBaseInstances() once its last layer lands. Returns whether getBaseInstances() changed.
+            // uploadTiles() runs waves until none of the textures is uploading.
+            void prepareTiles(std::shared_ptr<Veloxr::VeloxrBuffer> buffer, Veloxr::TileCompression compression, bool overview);
+            void createTiles(const std::function<glm::vec4()>& focus);
+            static bool uploadWave(const std::vector<VVTexture*>& textures);
+            static void uploadTiles(const std::vector<VVTexture*>& textures);
+            // From prepareTiles() until the last wave. Tiles must not be evicted, released or cropped meanwhile.
+            inline bool isUploading() const { return _pending != nullptr; }
+            // Most slots tileTexture() takes for buffer: one array per tile at worst, plus the overview.
+            static uint32_t getMaxSlotCount(const Veloxr::VeloxrBuffer& buffer, bool overview);
+            // Slots held by every texture, they all draw from one pool.
+            static inline size_t getUsedSlotCount() { return _tileManager.getUsedSlotCount(); }
+
+            // Registers the buffer with the virtual texture cache and builds one quad over the whole image.
+            // Pages are streamed in while drawing, nothing is uploaded here.
+            void createVirtualTexture(std::shared_ptr<Veloxr::VeloxrBuffer> buffer);
+
+            // Marks tiles intersecting region (entity space) as drawn in frame. Returns whether any of them is evicted.
+            bool markVisible(const glm::vec4& region, uint64_t frame);
+            // Uploads evicted tiles drawn in frame again. The caller makes sure the GPU is idle.
+            void reloadVisible(uint64_t frame);
+            // Frees the tile's image and points its slot at the placeholder. Returns the freed bytes.
+            // Only tiles that canReload() can be evicted, the caller makes sure the GPU is idle.
+            VkDeviceSize evictTile(size_t index);
+            // Host layers kept, or the pixels can be produced again from the pixel source.
+            bool canReload(const Veloxr::VVTileData& tile) const;
+
+            // Drops the buffer and the tile host layers once uploaded, tiles are filled from source whenever they
+            // are uploaded again. Block compressed layers are only dropped with a tile cache to get them back from.
+            // Not for virtual textures (the cache streams from the buffer) or after updateRegion() (the edits are
+            // only in the buffer) or while uploading. Returns whether the texture now depends on source.
+            bool releaseHostPixels(Veloxr::PixelSource source);
+
+            // Releases every tile array with no layer inside region (entity space) and drops its instances from
+            // getBaseInstances(). Tiles that canReload() are only evicted, the rest are freed. Returns the freed bytes.
+            // The caller makes sure the GPU is idle.
+            VkDeviceSize releaseOutside(const glm::vec4& region);
+            // Brings released tiles back. Returns false when some cannot be reloaded and the texture has to be tiled again.
+            bool restoreCropped();
+
+            // Writes rect (x, y, width, height in buffer pixels, before the EXIF orientation) of pixels into the buffer
+            // the texture was built from, pitch 0 is tightly packed rows of the buffer's channel count.
+            // Safe from any thread, the GPU copy happens in the next uploadRegions().
+            void updateRegion(const glm::uvec4& rect, const unsigned char* pixels, size_t pitch = 0);
+            // Copies the rects queued since the last call into the affected tiles (and host layers, the overview and
+            // virtual texture pages). Returns whether there was anything. The caller makes sure the GPU is idle.
+            // Regions stay queued while the texture is uploading.
+            bool uploadRegions();
+            bool hasPendingRegions();
 
             // Very exposed. This might as well be a Struct.
             const std::vector<Veloxr::VVTileData>& getTiledResult() const { return _tiledResult; }
 
-            // Vertices are in base coordinates. Spawning at 0,0 and spanning width / height
-            [[nodiscard]] std::vector<Veloxr::Vertex>& getBaseVertices() { return _vertices; };
+            // One instance per tile quad, in base coordinates. Spawning at 0,0 and spanning width / height
+            [[nodiscard]] std::vector<Veloxr::TileInstance>& getBaseInstances() { return _instances; };
             const glm::vec4& getBoundingBox() const { return _currentBoundingBox; }
+            // Unique across textures, changes whenever a tile image view is created. Descriptors written before
+            // refer to views that may be gone, even when a new view got the same handle.
+            inline uint64_t getGeneration() const { return _generation; }
 
             void destroy();
             ~VVTexture();
@@ -43,24 +127,84 @@ namespace Veloxr {
             static Veloxr::TileManager _tileManager;
 
             std::shared_ptr<VVDataPacket> _data;
-            std::vector<Veloxr::Vertex> _vertices;
+            std::vector<Veloxr::TileInstance> _instances;
+            std::vector<Veloxr::TileInstance> _croppedInstances;
             std::vector<Veloxr::VVTileData> _tiledResult{};
 
             glm::vec4 _currentBoundingBox;
-
-
-            void createImage(uint32_t width, uint32_t height, VkFormat format,
-                    VkImageTiling tiling, VkImageUsageFlags usage,
-                    VkMemoryPropertyFlags properties,
-                    VkImage& image, VkDeviceMemory& imageMemory) ;
-
-            void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-
-            void copyBufferToImage(VkBuffer buffer, VkImage image,
-                    uint32_t width, uint32_t height);
-
-            VkSampler createTextureSampler();
-            VkImageView createTextureImageView(VkImage textureImage);
-            VkImageView createImageView(VkImage image, VkFormat format);
+            int _virtualTextureId{-1};
+            inline static std::atomic<uint64_t> _nextGeneration{0};
+            uint64_t _generation{0};
+
+            // updateRegion() writes into the buffer from other threads, uploadRegions() reads it on the render thread.
+            std::shared_ptr<Veloxr::VeloxrBuffer> _buffer;
+            std::mutex _regionMutex;
+            std::vector<glm::uvec4> _pendingRegions;
+            bool _edited{false}; // The buffer differs from the source, it is kept.
+
+            // Set by releaseHostPixels(). The last buffer produced is reused while someone else still holds it.
+            Veloxr::PixelSource _source;
+            std::weak_ptr<Veloxr::VeloxrBuffer> _releasedBuffer;
+
+            // From prepareTiles() until the last upload wave of the texture.
+            struct PendingTiles {
+                std::shared_ptr<Veloxr::VeloxrBuffer> buffer;
+                Veloxr::TileCompression compression{Veloxr::TileCompression::None};
+                bool packedRGB{false};
+                bool overview{false};
+                Veloxr::TiledResult tiles;
+                std::vector<std::vector<int>> arrayTiles; // Base tile index per layer, per _tiledResult entry
+                std::vector<uint32_t> layersLeft; // Per _tiledResult entry, its view is created when the last one lands.
+                std::vector<Veloxr::VVTileUpload> uploads;
+                std::vector<glm::vec4> uploadBounds;
+                std::vector<size_t> uploadArrays; // Index into _tiledResult
+                std::vector<size_t> uploadsLeft; // Index into uploads, in the order of the last wave
+                std::vector<std::vector<Veloxr::TileInstance>> arrayInstances; // Per _tiledResult entry
+                size_t publishedInstances{0}; // Appended to _instances as their arrays landed
+                std::function<glm::vec4()> focus;
+                long long timeToTileMs{0};
+                std::chrono::high_resolution_clock::time_point uploadStart;
+            };
+            std::unique_ptr<PendingTiles> _pending;
+
+            // Keeps a single array allocation reasonable, 8k RGBA tiles pack four to an image.
+            static constexpr VkDeviceSize MAX_ARRAY_BYTES = 1024ull * 1024 * 1024;
+            // Bytes per focus ordered upload wave (at least one tile per hardware thread), one wave a frame while
+            // streaming.
+            static constexpr VkDeviceSize UPLOAD_WAVE_BYTES = 256ull * 1024 * 1024;
+            static constexpr uint64_t OVERVIEW_MAX_EDGE = 4096;
+            // TODO: Calculate best time case for maxResolution. 4096 will be 200% faster that maxresolution, but not sure if they will have enough sampelrs
+            static constexpr uint32_t MAX_TILE_DIMENSION = 8192;
+
+
+            void createImage(uint32_t width, uint32_t height, uint32_t layers, VkFormat format,
+                    const Veloxr::VVTileImageDesc& desc,
+                    VkImage& image, Veloxr::VVAllocation& imageMemory) ;
+
+            VkImageView createTextureImageView(const Veloxr::VVTileData& tile);
+            VkImageView createImageView(VkImage image, VkFormat format, uint32_t layers = 1, VkComponentMapping components = {});
+            void updateBoundingBox(const std::vector<Veloxr::TileInstance>& instances);
+            bool canEvictTiles() const;
+            void createOverview(const Veloxr::VeloxrBuffer& buffer, std::vector<Veloxr::Vertex>& tileVertices);
+            // Fills texels (x, y, width, height) of a tile at origin as channels bytes each, rows dstPitch apart.
+            // scale > 1 box filters into RGBA.
+            static void fillTexels(const Veloxr::VeloxrBuffer& buffer, const glm::uvec2& origin, uint32_t scale,
+                    const glm::uvec4& texels, uint32_t channels, unsigned char* dst, size_t dstPitch);
+            // Tiles without host layers are filled from buffer, produced on first need and kept for the caller's next tiles.
+            void uploadTile(Veloxr::VVTileData& tile, std::shared_ptr<Veloxr::VeloxrBuffer>& buffer);
+            // The buffer, or the pixels produced again from the source. Call with _regionMutex held.
+            std::shared_ptr<Veloxr::VeloxrBuffer> acquireBuffer();
+            // Upload ready bytes of every layer, as the tiler and block encoder made them.
+            std::vector<Veloxr::PixelBuffer> materializeLayers(const Veloxr::VVTileData& tile, const Veloxr::VeloxrBuffer& buffer);
+            uint32_t getMaxArrayLayers(VkDeviceSize layerSize) const;
+            // Keeps the host layers, builds the overview and the final instances once every tile is uploaded.
+            void finishTiles();
+            static std::pair<float, float> getFocusPriority(const glm::vec4& tile, const glm::vec4& region);
+
+            bool isSampledFormatSupported(VkFormat format) const;
+            bool isCompressionSupported(Veloxr::TileCompression compression) const;
+            void compressTile(Veloxr::TextureData& tile, Veloxr::TileCompression compression);
+            static VkFormat getTileFormat(uint32_t channels, Veloxr::ChannelOrder order);
+            static VkComponentMapping getTileSwizzle(uint32_t channels, Veloxr::ChannelOrder order);
     };
 }
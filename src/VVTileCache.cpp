@@ -0,0 +1,165 @@
+#include "VVTileCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace Veloxr {
+
+    VVTileCache::VVTileCache(const std::filesystem::path& directory, uint64_t maxBytes): _directory(directory), _maxBytes(maxBytes) {
+        std::error_code error;
+        std::filesystem::create_directories(_directory, error);
+        _enabled = !error && std::filesystem::is_directory(_directory, error);
+        if (!_enabled) {
+            console.warn("Could not create tile cache directory ", _directory.string(), ", compressed tiles will not be cached.");
+            return;
+        }
+
+        _totalBytes = scanSize();
+        console.log("Compressed tile cache at ", _directory.string(), ", ", _totalBytes / 1024 / 1024, " MB used.");
+        if (_maxBytes && _totalBytes > _maxBytes) prune();
+    }
+
+    VVTileCache::Key VVTileCache::makeKey(const unsigned char* pixels, size_t size, uint32_t width, uint32_t height, Veloxr::TileCompression compression) {
+        // Two word at a time multiply / rotate mixes with unrelated constants in one pass. Not cryptographic, only
+        // needs to be fast over hundreds of MB. The first names the file, the second is checked against the header.
+        const uint64_t seed = static_cast<uint64_t>(width) << 32 | height;
+        uint64_t hash = 0x9E3779B97F4A7C15ull ^ seed ^ (static_cast<uint64_t>(compression) << 56);
+        uint64_t check = 0x2545F4914F6CDD1Dull ^ (seed * 0xD6E8FEB86659FD93ull) ^ static_cast<uint64_t>(compression);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, pixels + i, 8);
+            hash ^= word * 0x9E3779B97F4A7C15ull;
+            hash = ((hash << 31) | (hash >> 33)) * 0xBF58476D1CE4E5B9ull;
+            check += word ^ 0xC2B2AE3D27D4EB4Full;
+            check = ((check << 27) | (check >> 37)) * 0x94D049BB133111EBull;
+        }
+        for (; i < size; i++) {
+            hash ^= pixels[i];
+            hash *= 0x100000001B3ull;
+            check = (check + pixels[i]) * 0xC6A4A7935BD1E995ull;
+        }
+        hash ^= size;
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        check ^= size;
+        check ^= check >> 31;
+        check *= 0xC4CEB9FE1A85EC53ull;
+        check ^= check >> 29;
+        return { hash, check, width, height, compression };
+    }
+
+    std::filesystem::path VVTileCache::getPath(uint64_t hash) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx%s", static_cast<unsigned long long>(hash), FILE_EXTENSION);
+        return _directory / name;
+    }
+
+    uint64_t VVTileCache::scanSize() const {
+        uint64_t total = 0;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(_directory, error)) {
+            if (entry.path().extension() != FILE_EXTENSION || !entry.is_regular_file(error)) continue;
+            const auto size = entry.file_size(error);
+            if (!error) total += size;
+        }
+        return total;
+    }
+
+    void VVTileCache::prune() {
+        struct Entry {
+            std::filesystem::file_time_type time;
+            uint64_t size;
+            std::filesystem::path path;
+        };
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(_directory, error)) {
+            if (entry.path().extension() != FILE_EXTENSION || !entry.is_regular_file(error)) continue;
+            const auto size = entry.file_size(error);
+            if (error) continue;
+            const auto time = entry.last_write_time(error);
+            if (error) continue;
+            entries.push_back({ time, size, entry.path() });
+            total += size;
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+
+        // Down to 90% so the next few stores do not walk the directory again.
+        const uint64_t target = _maxBytes - _maxBytes / 10;
+        size_t removed = 0;
+        for (const auto& entry : entries) {
+            if (total <= target) break;
+            if (std::filesystem::remove(entry.path, error)) {
+                total -= entry.size;
+                removed++;
+            }
+        }
+        _totalBytes = total;
+        console.log("Pruned ", removed, " tile cache entries, ", total / 1024 / 1024, " MB left.");
+    }
+
+    bool VVTileCache::load(const Key& key, size_t expectedSize, Veloxr::PixelBuffer& out) {
+        if (!_enabled) return false;
+
+        const auto path = getPath(key.hash);
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+
+        FileHeader header{};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || header.magic != FILE_MAGIC || header.hash != key.hash || header.check != key.check ||
+                header.width != key.width || header.height != key.height ||
+                header.compression != static_cast<uint32_t>(key.compression) || header.size != expectedSize) {
+            console.warn("Ignoring stale tile cache entry ", path.string());
+            return false;
+        }
+
+        out.resize(expectedSize);
+        file.read(reinterpret_cast<char*>(out.data()), expectedSize);
+        if (!file) return false;
+
+        // Last write time doubles as the last use for pruning.
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        return true;
+    }
+
+    void VVTileCache::store(const Key& key, const Veloxr::PixelBuffer& data) {
+        if (!_enabled) return;
+
+        // Write to a temporary name first so a crash never leaves a truncated entry behind.
+        const auto path = getPath(key.hash);
+        auto tempPath = path;
+        tempPath += ".tmp";
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                console.warn("Could not write tile cache entry ", path.string());
+                return;
+            }
+            const FileHeader header{FILE_MAGIC, static_cast<uint32_t>(key.compression), key.hash, key.check, key.width, key.height, data.size()};
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(data.data()), data.size());
+            if (!file) {
+                console.warn("Could not write tile cache entry ", path.string());
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error) {
+            std::filesystem::remove(tempPath, error);
+            return;
+        }
+        _totalBytes += sizeof(FileHeader) + data.size();
+        if (_maxBytes && _totalBytes > _maxBytes) prune();
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+
+#include "DataUtils.h"
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    /**
+     * On disk cache for block compressed tiles, so reopening an image skips the encoder.
+     * Entries are named by a hash of the source tile pixels, its size and the compression mode.
+     * Every file carries a header with a second independent hash, the source size and the format that is checked
+     * on load, a mismatch is treated as a miss. The directory is kept under a size cap, least recently used first.
+     */
+    class VVTileCache {
+        public:
+            struct Key {
+                uint64_t hash;
+                uint64_t check;
+                uint32_t width;
+                uint32_t height;
+                Veloxr::TileCompression compression;
+            };
+
+            VVTileCache(const std::filesystem::path& directory, uint64_t maxBytes);
+
+            static Key makeKey(const unsigned char* pixels, size_t size, uint32_t width, uint32_t height, Veloxr::TileCompression compression);
+
+            bool load(const Key& key, size_t expectedSize, Veloxr::PixelBuffer& out);
+            void store(const Key& key, const Veloxr::PixelBuffer& data);
+
+            inline bool isEnabled() const { return _enabled; }
+            inline const std::filesystem::path& getDirectory() const { return _directory; }
+
+        private:
+            inline static LLogger console{"[Veloxr][VVTileCache] "};
+            static constexpr uint32_t FILE_MAGIC = 0x56544332; // "VTC2"
+            static constexpr const char* FILE_EXTENSION = ".vtc";
+
+            struct FileHeader {
+                uint32_t magic;
+                uint32_t compression;
+                uint64_t hash;
+                uint64_t check;
+                uint32_t width;
+                uint32_t height;
+                uint64_t size;
+            };
+
+            std::filesystem::path _directory;
+            bool _enabled{false};
+            uint64_t _maxBytes{0};
+            uint64_t _totalBytes{0};
+            std::mutex _mutex;
+
+            std::filesystem::path getPath(uint64_t hash) const;
+            uint64_t scanSize() const;
+            // Drops the least recently used entries until the cache is below 90% of its cap. Called under _mutex.
+            void prune();
+    };
+}
@@ -0,0 +1,158 @@
+#include "VVTileIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace Veloxr {
+
+    namespace {
+        inline bool intersects(const glm::vec4& a, const glm::vec4& b) {
+            return a.x <= b.z && a.z >= b.x && a.y <= b.w && a.w >= b.y;
+        }
+
+        inline uint32_t cellOf(float offset, float size, uint32_t cells) {
+            return static_cast<uint32_t>(std::clamp(std::floor(offset / size), 0.0f, static_cast<float>(cells - 1)));
+        }
+    }
+
+    void VVTileIndex::clear() {
+        _quads.clear();
+        _grids.clear();
+    }
+
+    void VVTileIndex::build(const std::vector<Veloxr::TileInstance>& instances) {
+        clear();
+        if (instances.empty()) return;
+
+        std::map<int, std::vector<uint32_t>> quadsByEntity;
+        _quads.reserve(instances.size());
+        for (const auto& instance : instances) {
+            Quad quad{};
+            quad.bounds = instance.rect;
+            quad.renderUID = instance.renderUID;
+            quad.overviewScale = instance.overviewScale;
+            quadsByEntity[quad.renderUID].push_back(static_cast<uint32_t>(_quads.size()));
+            _quads.push_back(quad);
+        }
+
+        for (const auto& [renderUID, quads] : quadsByEntity) {
+            Grid grid{};
+            grid.renderUID = renderUID;
+            grid.bounds = _quads[quads.front()].bounds;
+            // Cells are as large as the largest tile, aligned tiles then land in a single cell each.
+            glm::vec2 tileSize(0.0f);
+            for (uint32_t id : quads) {
+                const auto& bounds = _quads[id].bounds;
+                grid.bounds = { std::min(grid.bounds.x, bounds.x), std::min(grid.bounds.y, bounds.y),
+                                std::max(grid.bounds.z, bounds.z), std::max(grid.bounds.w, bounds.w) };
+                if (_quads[id].overviewScale > 0.0f) continue;
+                tileSize = glm::max(tileSize, glm::vec2(bounds.z - bounds.x, bounds.w - bounds.y));
+            }
+            const glm::vec2 extent(grid.bounds.z - grid.bounds.x, grid.bounds.w - grid.bounds.y);
+            grid.cellSize = glm::max(glm::max(tileSize, extent / static_cast<float>(MAX_CELLS_PER_SIDE)), glm::vec2(1.0f));
+            grid.cellsX = std::max(1u, static_cast<uint32_t>(std::ceil(extent.x / grid.cellSize.x)));
+            grid.cellsY = std::max(1u, static_cast<uint32_t>(std::ceil(extent.y / grid.cellSize.y)));
+
+            auto cellRange = [&](const glm::vec4& bounds, uint32_t& x0, uint32_t& y0, uint32_t& x1, uint32_t& y1) {
+                x0 = cellOf(bounds.x - grid.bounds.x, grid.cellSize.x, grid.cellsX);
+                x1 = cellOf(bounds.z - grid.bounds.x, grid.cellSize.x, grid.cellsX);
+                y0 = cellOf(bounds.y - grid.bounds.y, grid.cellSize.y, grid.cellsY);
+                y1 = cellOf(bounds.w - grid.bounds.y, grid.cellSize.y, grid.cellsY);
+            };
+
+            // Count, then fill, a tile on a cell border is listed in every cell it touches.
+            grid.cellStart.assign(grid.cellsX * grid.cellsY + 1, 0);
+            for (uint32_t id : quads) {
+                if (_quads[id].overviewScale > 0.0f) continue;
+                uint32_t x0, y0, x1, y1;
+                cellRange(_quads[id].bounds, x0, y0, x1, y1);
+                for (uint32_t y = y0; y <= y1; y++) {
+                    for (uint32_t x = x0; x <= x1; x++) grid.cellStart[y * grid.cellsX + x + 1]++;
+                }
+            }
+            for (size_t i = 1; i < grid.cellStart.size(); i++) grid.cellStart[i] += grid.cellStart[i - 1];
+
+            grid.cellQuads.resize(grid.cellStart.back());
+            std::vector<uint32_t> fill(grid.cellStart.begin(), grid.cellStart.end() - 1);
+            for (uint32_t id : quads) {
+                if (_quads[id].overviewScale > 0.0f) {
+                    grid.overviews.push_back(id);
+                    continue;
+                }
+                uint32_t x0, y0, x1, y1;
+                cellRange(_quads[id].bounds, x0, y0, x1, y1);
+                for (uint32_t y = y0; y <= y1; y++) {
+                    for (uint32_t x = x0; x <= x1; x++) grid.cellQuads[fill[y * grid.cellsX + x]++] = id;
+                }
+            }
+            console.logc2("Entity ", renderUID, ": ", quads.size(), " quads in ", grid.cellsX, "x", grid.cellsY, " cells.");
+            _grids.push_back(std::move(grid));
+        }
+    }
+
+    bool VVTileIndex::isDrawn(const Quad& quad, const glm::vec4& bounds, float worldPerPixel) const {
+        if (!intersects(quad.bounds, bounds)) return false;
+        // Same pick as the vertex shader: the overview while it is at least screen resolution, the tiles otherwise.
+        if (quad.overviewScale != 0.0f) {
+            const bool useOverview = worldPerPixel >= std::abs(quad.overviewScale);
+            if (useOverview != (quad.overviewScale > 0.0f)) return false;
+        }
+        return true;
+    }
+
+    void VVTileIndex::cull(const glm::vec4& bounds, const glm::vec4& roi, const std::vector<Veloxr::EntityData>& entities,
+            float worldPerPixel, std::vector<VkDrawIndirectCommand>& commands) const {
+        commands.clear();
+        if (_quads.empty()) return;
+
+        glm::vec4 worldQuery = bounds;
+        if (roi != glm::vec4(0.0f)) {
+            worldQuery = { std::max(worldQuery.x, roi.x), std::max(worldQuery.y, roi.y), std::min(worldQuery.z, roi.z), std::min(worldQuery.w, roi.w) };
+        }
+        if (worldQuery.x > worldQuery.z || worldQuery.y > worldQuery.w) return;
+
+        std::vector<uint32_t> visible;
+        for (const auto& grid : _grids) {
+            const bool known = grid.renderUID >= 0 && static_cast<size_t>(grid.renderUID) < entities.size();
+            const Veloxr::EntityData entity = known ? entities[grid.renderUID] : Veloxr::EntityData{};
+            if (entity.isHidden()) continue;
+
+            glm::vec4 query = entity.toLocal(worldQuery);
+            if (entity.crop != glm::vec4(0.0f)) {
+                query = { std::max(query.x, entity.crop.x), std::max(query.y, entity.crop.y), std::min(query.z, entity.crop.z), std::min(query.w, entity.crop.w) };
+            }
+            if (query.x > query.z || query.y > query.w) continue;
+            if (!intersects(grid.bounds, query)) continue;
+            // The overview pick is in the entity's own pixels.
+            const float localPerPixel = worldPerPixel / std::abs(entity.transform.z);
+
+            for (uint32_t id : grid.overviews) {
+                if (isDrawn(_quads[id], query, localPerPixel)) visible.push_back(id);
+            }
+            const uint32_t x0 = cellOf(query.x - grid.bounds.x, grid.cellSize.x, grid.cellsX);
+            const uint32_t x1 = cellOf(query.z - grid.bounds.x, grid.cellSize.x, grid.cellsX);
+            const uint32_t y0 = cellOf(query.y - grid.bounds.y, grid.cellSize.y, grid.cellsY);
+            const uint32_t y1 = cellOf(query.w - grid.bounds.y, grid.cellSize.y, grid.cellsY);
+            for (uint32_t y = y0; y <= y1; y++) {
+                for (uint32_t x = x0; x <= x1; x++) {
+                    const uint32_t index = y * grid.cellsX + x;
+                    for (uint32_t i = grid.cellStart[index]; i < grid.cellStart[index + 1]; i++) {
+                        const uint32_t id = grid.cellQuads[i];
+                        if (isDrawn(_quads[id], query, localPerPixel)) visible.push_back(id);
+                    }
+                }
+            }
+        }
+
+        // Tiles on cell borders come up more than once.
+        std::sort(visible.begin(), visible.end());
+        visible.erase(std::unique(visible.begin(), visible.end()), visible.end());
+        for (uint32_t id : visible) {
+            if (!commands.empty() && commands.back().firstInstance + commands.back().instanceCount == id) {
+                commands.back().instanceCount++;
+            } else {
+                commands.push_back({ Veloxr::TileInstance::VERTEX_COUNT, 1, 0, id });
+            }
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_core.h>
+
+#include "Common.h"
+#include "Vertex.h"
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    /**
+     * Spatial index over the tile instances of the shared instance buffer, for culling them on the CPU.
+     *
+     * The quads of each entity (renderUID) go into a uniform grid sized by its tiles, overview quads are kept aside
+     * and tested on their own. cull() returns the instance ranges of the quads the vertex shader would not throw
+     * away, so the draw scales with what is visible rather than with the tile count.
+     */
+    class VVTileIndex {
+        public:
+            void build(const std::vector<Veloxr::TileInstance>& instances);
+            void clear();
+
+            // Quads intersecting bounds and roi (world space minX, minY, maxX, maxY, an all zero roi is no crop),
+            // without hidden entities and the overview or tile quads worldPerPixel does not pick. The quads are in
+            // entity space, entities (indexed by renderUID) places and crops them like the vertex shader does.
+            // Neighbouring quads merge into one command. Ordered by instance, like the unculled draw.
+            void cull(const glm::vec4& bounds, const glm::vec4& roi, const std::vector<Veloxr::EntityData>& entities,
+                    float worldPerPixel, std::vector<VkDrawIndirectCommand>& commands) const;
+
+            inline uint32_t getQuadCount() const { return static_cast<uint32_t>(_quads.size()); }
+
+        private:
+            inline static LLogger console{"[Veloxr][VVTileIndex] "};
+            static constexpr uint32_t MAX_CELLS_PER_SIDE = 256;
+
+            struct Quad {
+                glm::vec4 bounds;
+                int renderUID;
+                float overviewScale;
+            };
+
+            // Compressed rows: the quads of cell i are cellQuads[cellStart[i], cellStart[i + 1]).
+            struct Grid {
+                int renderUID;
+                glm::vec4 bounds;
+                glm::vec2 cellSize;
+                uint32_t cellsX, cellsY;
+                std::vector<uint32_t> cellStart;
+                std::vector<uint32_t> cellQuads;
+                std::vector<uint32_t> overviews;
+            };
+
+            std::vector<Quad> _quads;
+            std::vector<Grid> _grids;
+
+            bool isDrawn(const Quad& quad, const glm::vec4& bounds, float worldPerPixel) const;
+    };
+}
@@ -0,0 +1,396 @@
+#include "VVTileUploader.h"
+#include "CommandUtils.h"
+#include "DataUtils.h"
+#include "VVBlockEncoder.h"
+#include "VVUtils.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace Veloxr {
+
+    static inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+    }
+
+    std::shared_ptr<VVTileUploader> VVTileUploader::create(std::shared_ptr<Veloxr::VVDataPacket> data) {
+        std::shared_ptr<VVTileUploader> uploader;
+#ifdef VK_EXT_host_image_copy
+        if (data->features.hostImageCopy) {
+            auto hostImageCopy = std::make_shared<VVHostImageCopyTileUploader>(data);
+            if (hostImageCopy->isValid()) uploader = hostImageCopy;
+        }
+#endif
+        if (!uploader) uploader = std::make_shared<VVStagingTileUploader>(data);
+        if (data->features.unifiedMemory && data->settings.linearTilesOnUnifiedMemory) {
+            uploader = std::make_shared<VVLinearTileUploader>(data, uploader);
+        }
+        return uploader;
+    }
+
+    /* Staging */
+
+    VVStagingTileUploader::VVStagingTileUploader(std::shared_ptr<Veloxr::VVDataPacket> data): _data(data) {
+        if (_data->settings.gpuExpandRGB) {
+            _expander = std::make_unique<Veloxr::VVRGBExpander>(_data);
+            if (!_expander->isValid()) _expander.reset();
+        }
+    }
+
+    Veloxr::VVTileImageDesc VVStagingTileUploader::getImageDesc(VkFormat /*format*/, uint32_t /*width*/, uint32_t /*height*/, uint32_t /*layers*/, bool packedRGB) {
+        Veloxr::VVTileImageDesc desc{};
+        if (packedRGB) {
+            desc.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+            desc.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+            desc.imageFormat = Veloxr::VVRGBExpander::IMAGE_FORMAT;
+        }
+        return desc;
+    }
+
+    bool VVStagingTileUploader::supportsPackedRGB(uint32_t width, uint32_t height) {
+        return _expander && _expander->supportsExtent(width, height);
+    }
+
+    bool VVStagingTileUploader::importPixels(const Veloxr::VVTileUpload& upload, VkBufferUsageFlags usage, VkBuffer& buffer, Veloxr::VVAllocation& memory) {
+#ifdef VK_EXT_external_memory_host
+        const auto alignment = _data->features.minImportedHostPointerAlignment;
+        if (!_data->settings.importHostMemory || !_data->features.externalMemoryHost || !upload.hostImportable) return false;
+        if (alignment == 0 || alignment > PIXEL_BUFFER_ALIGNMENT || reinterpret_cast<uintptr_t>(upload.pixels) % alignment != 0) return false;
+
+        // PixelBuffer pads to whole pages, so rounding the size up stays inside the allocation.
+        VkDeviceSize importSize = alignUp(upload.size, alignment);
+
+        VkExternalMemoryBufferCreateInfo externalInfo{};
+        externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+        externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.pNext = &externalInfo;
+        bufferInfo.size = importSize;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(_data->device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) return false;
+
+        memory = _data->allocator->importHostPointer(const_cast<unsigned char*>(upload.pixels), importSize);
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(_data->device, buffer, &memRequirements);
+        if (!memory.isValid() || !(memRequirements.memoryTypeBits & (1u << memory.memoryTypeIndex))) {
+            VVUtils::destroyBuffer(_data, buffer, memory);
+            return false;
+        }
+
+        vkBindBufferMemory(_data->device, buffer, memory.memory, 0);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void VVStagingTileUploader::recordLayoutTransition(VkCommandBuffer commandBuffer, VkImage image, uint32_t layer, VkImageLayout oldLayout, VkImageLayout newLayout) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = layer;
+        barrier.subresourceRange.layerCount = 1;
+
+        VkPipelineStageFlags sourceStage;
+        VkPipelineStageFlags destinationStage;
+
+        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        } else if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+            barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_HOST_BIT;
+            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        } else {
+            throw std::invalid_argument("unsupported layout transition!");
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    void VVStagingTileUploader::upload(std::vector<Veloxr::VVTileUpload>& uploads) {
+        console.logc1(__func__, " ", uploads.size(), " tiles");
+
+        size_t next = 0;
+        while (next < uploads.size()) {
+            std::vector<VkBuffer> stagingBuffers;
+            std::vector<Veloxr::VVAllocation> stagingMemory;
+            VkDeviceSize batchBytes = 0;
+            uint32_t importedCount = 0;
+
+            VkCommandBuffer commandBuffer = CommandUtils::beginSingleTimeCommands(_data->device, _data->commandPool);
+
+            // Always take at least one tile, even if it alone is bigger than the batch.
+            while (next < uploads.size() && (batchBytes == 0 || batchBytes + uploads[next].size <= MAX_BATCH_BYTES) && !(_expander && _expander->isFull())) {
+                auto& upload = uploads[next++];
+                const bool expand = upload.packedRGB && _expander;
+                if (upload.packedRGB && !expand) {
+                    throw std::runtime_error("packed RGB tile without GPU expansion!");
+                }
+                const VkBufferUsageFlags usage = expand ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+                VkBuffer stagingBuffer;
+                Veloxr::VVAllocation stagingBufferMemory;
+                if (importPixels(upload, usage, stagingBuffer, stagingBufferMemory)) {
+                    importedCount++;
+                } else {
+                    // The expand shader reads whole words, round up so the last pixel stays in bounds.
+                    VVUtils::createBuffer(_data, alignUp(upload.size, 4), usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+                    memcpy(stagingBufferMemory.mapped, upload.pixels, static_cast<size_t>(upload.size));
+                }
+
+                batchBytes += upload.size;
+                stagingBuffers.push_back(stagingBuffer);
+                stagingMemory.push_back(stagingBufferMemory);
+
+                if (expand) {
+                    _expander->record(commandBuffer, stagingBuffer, upload.image, upload.layer, upload.width, upload.height);
+                    upload.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                    continue;
+                }
+
+                recordLayoutTransition(commandBuffer, upload.image, upload.layer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+                VkBufferImageCopy region{};
+                region.bufferOffset = 0;
+                region.bufferRowLength = 0;
+                region.bufferImageHeight = 0;
+                region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                region.imageSubresource.mipLevel = 0;
+                region.imageSubresource.baseArrayLayer = upload.layer;
+                region.imageSubresource.layerCount = 1;
+                region.imageOffset = {0, 0, 0};
+                region.imageExtent = { upload.width, upload.height, 1 };
+                vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+                recordLayoutTransition(commandBuffer, upload.image, upload.layer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                upload.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            }
+
+            CommandUtils::endSingleTimeCommands(_data->device, commandBuffer, _data->commandPool, _data->graphicsQueue);
+            if (_expander) _expander->reset();
+
+            for (size_t i = 0; i < stagingBuffers.size(); i++) {
+                VVUtils::destroyBuffer(_data, stagingBuffers[i], stagingMemory[i]);
+            }
+            console.logc1("Flushed ", stagingBuffers.size(), " tiles (", importedCount, " imported), ", (batchBytes / 1024.0 / 1024.0), " MB");
+        }
+    }
+
+    /* Linear, unified memory */
+
+    VVLinearTileUploader::VVLinearTileUploader(std::shared_ptr<Veloxr::VVDataPacket> data, std::shared_ptr<VVTileUploader> fallback): _data(data), _fallback(fallback) {
+        console.log("Writing tiles into linear host visible images, fallback: ", _fallback->getName());
+    }
+
+    bool VVLinearTileUploader::supportsLinear(VkFormat format, uint32_t width, uint32_t height) {
+        std::lock_guard<std::mutex> lock(_formatMutex);
+        auto findIt = _formatSupport.find(format);
+        if (findIt == _formatSupport.end()) {
+            VkImageFormatProperties properties{};
+            VkResult result = vkGetPhysicalDeviceImageFormatProperties(_data->physicalDevice, format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_LINEAR,
+                    VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 0, &properties);
+            if (result != VK_SUCCESS) {
+                console.warn("Format ", format, " cannot be sampled with linear tiling.");
+                properties = {};
+            }
+            findIt = _formatSupport.emplace(format, properties).first;
+        }
+        return width <= findIt->second.maxExtent.width && height <= findIt->second.maxExtent.height;
+    }
+
+    bool VVLinearTileUploader::supportsPackedRGB(uint32_t width, uint32_t height) {
+        return _fallback->supportsPackedRGB(width, height);
+    }
+
+    Veloxr::VVTileImageDesc VVLinearTileUploader::getImageDesc(VkFormat format, uint32_t width, uint32_t height, uint32_t layers, bool packedRGB) {
+        if (packedRGB || layers > 1 || VVBlockEncoder::isBlockCompressed(format) || !supportsLinear(format, width, height)) {
+            return _fallback->getImageDesc(format, width, height, layers, packedRGB);
+        }
+
+        Veloxr::VVTileImageDesc desc{};
+        desc.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+        desc.tiling = VK_IMAGE_TILING_LINEAR;
+        desc.memoryProperties = LINEAR_MEMORY_PROPERTIES;
+        desc.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+        return desc;
+    }
+
+    void VVLinearTileUploader::writeTile(Veloxr::VVTileUpload& upload) {
+        VkImageSubresource subresource{};
+        subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresource.mipLevel = 0;
+        subresource.arrayLayer = 0;
+
+        VkSubresourceLayout layout;
+        vkGetImageSubresourceLayout(_data->device, upload.image, &subresource, &layout);
+
+        const VkDeviceSize rowBytes = upload.size / upload.height;
+        auto* dst = static_cast<unsigned char*>(upload.mapped) + layout.offset;
+        if (layout.rowPitch == rowBytes) {
+            memcpy(dst, upload.pixels, static_cast<size_t>(upload.size));
+            return;
+        }
+        for (uint32_t y = 0; y < upload.height; y++) {
+            memcpy(dst + y * layout.rowPitch, upload.pixels + y * rowBytes, static_cast<size_t>(rowBytes));
+        }
+    }
+
+    void VVLinearTileUploader::upload(std::vector<Veloxr::VVTileUpload>& uploads) {
+        console.logc1(__func__, " ", uploads.size(), " tiles");
+
+        std::vector<Veloxr::VVTileUpload*> linear;
+        std::vector<Veloxr::VVTileUpload> other;
+        std::vector<size_t> otherIndices;
+        for (size_t i = 0; i < uploads.size(); i++) {
+            if (uploads[i].tiling == VK_IMAGE_TILING_LINEAR && uploads[i].mapped && !uploads[i].packedRGB) {
+                linear.push_back(&uploads[i]);
+            } else {
+                other.push_back(uploads[i]);
+                otherIndices.push_back(i);
+            }
+        }
+
+        if (!linear.empty()) {
+            VVUtils::parallelFor(linear.size(), [&](size_t i) { writeTile(*linear[i]); });
+
+            // Memory is coherent, submission makes the writes visible. The layout still has to leave PREINITIALIZED.
+            VkCommandBuffer commandBuffer = CommandUtils::beginSingleTimeCommands(_data->device, _data->commandPool);
+            for (auto* upload : linear) {
+                VVStagingTileUploader::recordLayoutTransition(commandBuffer, upload->image, upload->layer, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                upload->finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            }
+            CommandUtils::endSingleTimeCommands(_data->device, commandBuffer, _data->commandPool, _data->graphicsQueue);
+        }
+
+        if (!other.empty()) {
+            _fallback->upload(other);
+            for (size_t i = 0; i < other.size(); i++) uploads[otherIndices[i]].finalLayout = other[i].finalLayout;
+        }
+    }
+
+#ifdef VK_EXT_host_image_copy
+    /* Host image copy */
+
+    VVHostImageCopyTileUploader::VVHostImageCopyTileUploader(std::shared_ptr<Veloxr::VVDataPacket> data): _data(data), _fallback(data) {
+        _copyMemoryToImage = (PFN_vkCopyMemoryToImageEXT) vkGetDeviceProcAddr(_data->device, "vkCopyMemoryToImageEXT");
+        _transitionImageLayout = (PFN_vkTransitionImageLayoutEXT) vkGetDeviceProcAddr(_data->device, "vkTransitionImageLayoutEXT");
+        _dstLayout = _data->features.hostImageCopyToShaderReadOnly ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        if (!isValid()) console.warn("VK_EXT_host_image_copy enabled but entry points are missing.");
+        else console.log("Using host image copy, destination layout ", _dstLayout);
+    }
+
+    bool VVHostImageCopyTileUploader::supportsFormat(VkFormat format) {
+        std::lock_guard<std::mutex> lock(_formatMutex);
+        auto findIt = _formatSupport.find(format);
+        if (findIt != _formatSupport.end()) return findIt->second;
+
+        VkImageFormatProperties properties{};
+        VkResult result = vkGetPhysicalDeviceImageFormatProperties(_data->physicalDevice, format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 0, &properties);
+        bool supported = result == VK_SUCCESS;
+        if (!supported) console.warn("Format ", format, " cannot be host copied, falling back to staging.");
+        _formatSupport[format] = supported;
+        return supported;
+    }
+
+    bool VVHostImageCopyTileUploader::supportsPackedRGB(uint32_t width, uint32_t height) {
+        return _fallback.supportsPackedRGB(width, height);
+    }
+
+    Veloxr::VVTileImageDesc VVHostImageCopyTileUploader::getImageDesc(VkFormat format, uint32_t width, uint32_t height, uint32_t layers, bool packedRGB) {
+        if (packedRGB || !supportsFormat(format)) return _fallback.getImageDesc(format, width, height, layers, packedRGB);
+        Veloxr::VVTileImageDesc desc{};
+        desc.usage = VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        return desc;
+    }
+
+    void VVHostImageCopyTileUploader::uploadOne(Veloxr::VVTileUpload& upload) {
+        VkHostImageLayoutTransitionInfoEXT transition{};
+        transition.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT;
+        transition.image = upload.image;
+        transition.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        transition.newLayout = _dstLayout;
+        transition.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        transition.subresourceRange.baseMipLevel = 0;
+        transition.subresourceRange.levelCount = 1;
+        transition.subresourceRange.baseArrayLayer = upload.layer;
+        transition.subresourceRange.layerCount = 1;
+
+        if (_transitionImageLayout(_data->device, 1, &transition) != VK_SUCCESS) {
+            throw std::runtime_error("failed to transition image layout on host!");
+        }
+
+        VkMemoryToImageCopyEXT region{};
+        region.sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT;
+        region.pHostPointer = upload.pixels;
+        region.memoryRowLength = 0;
+        region.memoryImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = upload.layer;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = { upload.width, upload.height, 1 };
+
+        VkCopyMemoryToImageInfoEXT copyInfo{};
+        copyInfo.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT;
+        copyInfo.dstImage = upload.image;
+        copyInfo.dstImageLayout = _dstLayout;
+        copyInfo.regionCount = 1;
+        copyInfo.pRegions = &region;
+
+        if (_copyMemoryToImage(_data->device, &copyInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to copy memory to image!");
+        }
+        upload.finalLayout = _dstLayout;
+    }
+
+    void VVHostImageCopyTileUploader::upload(std::vector<Veloxr::VVTileUpload>& uploads) {
+        console.logc1(__func__, " ", uploads.size(), " tiles");
+
+        std::vector<Veloxr::VVTileUpload*> hostCopies;
+        std::vector<Veloxr::VVTileUpload> staged;
+        std::vector<size_t> stagedIndices;
+        for (size_t i = 0; i < uploads.size(); i++) {
+            if (!uploads[i].packedRGB && supportsFormat(uploads[i].format)) {
+                hostCopies.push_back(&uploads[i]);
+            } else {
+                staged.push_back(uploads[i]);
+                stagedIndices.push_back(i);
+            }
+        }
+
+        // Every tile owns its image layer, so the copies need no synchronisation between workers.
+        VVUtils::parallelFor(hostCopies.size(), [&](size_t i) { uploadOne(*hostCopies[i]); });
+
+        if (!staged.empty()) {
+            _fallback.upload(staged);
+            for (size_t i = 0; i < staged.size(); i++) uploads[stagedIndices[i]].finalLayout = staged[i].finalLayout;
+        }
+    }
+#endif
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "Common.h"
+#include "VLogger.h"
+#include "VVRGBExpander.h"
+
+namespace Veloxr {
+
+    // How a tile image has to be created for the uploader that will fill it.
+    struct VVTileImageDesc {
+        VkImageUsageFlags usage{VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT};
+        VkImageTiling tiling{VK_IMAGE_TILING_OPTIMAL};
+        VkMemoryPropertyFlags memoryProperties{VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT};
+        VkImageLayout initialLayout{VK_IMAGE_LAYOUT_UNDEFINED};
+        VkImageCreateFlags flags{0};
+        // When set the image is created in this format, views keep the tile format.
+        VkFormat imageFormat{VK_FORMAT_UNDEFINED};
+    };
+
+    // One tile worth of pixels going into an already created and bound VkImage.
+    struct VVTileUpload {
+        const unsigned char* pixels{nullptr};
+        VkDeviceSize size{0};
+        bool hostImportable{false}; // pixels live in a Veloxr::PixelBuffer (aligned and padded).
+        uint32_t width{0}, height{0};
+        VkFormat format{VK_FORMAT_R8G8B8A8_SRGB};
+        VkImage image{VK_NULL_HANDLE};
+        uint32_t layer{0}; // Array layer of image this tile goes into.
+        VkImageTiling tiling{VK_IMAGE_TILING_OPTIMAL};
+        void* mapped{nullptr}; // Image memory, only set for host visible linear images.
+        bool packedRGB{false}; // pixels are 3 channel RGB, expanded into the RGBA image by the uploader.
+
+        // Written by the uploader. The layout the image is left in, used for the descriptor.
+        VkImageLayout finalLayout{VK_IMAGE_LAYOUT_UNDEFINED};
+    };
+
+    /**
+     * Moves tile pixels from host memory into sampled images.
+     * Tiles create their images from getImageDesc() so the backend can pick its own transfer path.
+     * An image can be a 2D array shared by several tiles, every upload fills and transitions only its own layer.
+     */
+    class VVTileUploader {
+        public:
+            virtual ~VVTileUploader() = default;
+
+            virtual const char* getName() const = 0;
+            virtual Veloxr::VVTileImageDesc getImageDesc(VkFormat format, uint32_t width, uint32_t height, uint32_t layers, bool packedRGB) = 0;
+            virtual void upload(std::vector<Veloxr::VVTileUpload>& uploads) = 0;
+
+            // Whether tiles of this size can be handed over as packed RGB (VVTileUpload::packedRGB).
+            virtual bool supportsPackedRGB(uint32_t /*width*/, uint32_t /*height*/) { return false; }
+
+            // Picks the fastest backend the device supports.
+            static std::shared_ptr<VVTileUploader> create(std::shared_ptr<Veloxr::VVDataPacket> data);
+    };
+
+    /**
+     * Classic path: host -> staging buffer -> vkCmdCopyBufferToImage on the graphics queue.
+     * All tiles of a call are recorded into one command buffer, flushed every MAX_BATCH_BYTES of staging.
+     * With VK_EXT_external_memory_host the tile's own PixelBuffer is imported as the staging buffer, skipping the memcpy.
+     * Packed RGB tiles are expanded into their RGBA image by VVRGBExpander instead of a buffer to image copy.
+     */
+    class VVStagingTileUploader : public VVTileUploader {
+        public:
+            VVStagingTileUploader(std::shared_ptr<Veloxr::VVDataPacket> data);
+
+            const char* getName() const override { return "staging"; }
+            Veloxr::VVTileImageDesc getImageDesc(VkFormat format, uint32_t width, uint32_t height, uint32_t layers, bool packedRGB) override;
+            void upload(std::vector<Veloxr::VVTileUpload>& uploads) override;
+            bool supportsPackedRGB(uint32_t width, uint32_t height) override;
+
+            static void recordLayoutTransition(VkCommandBuffer commandBuffer, VkImage image, uint32_t layer, VkImageLayout oldLayout, VkImageLayout newLayout);
+
+        private:
+            inline static LLogger console{"[Veloxr][VVStagingTileUploader] "};
+            static constexpr VkDeviceSize MAX_BATCH_BYTES = 256ull * 1024 * 1024;
+
+            std::shared_ptr<Veloxr::VVDataPacket> _data;
+            std::unique_ptr<Veloxr::VVRGBExpander> _expander;
+
+            bool importPixels(const Veloxr::VVTileUpload& upload, VkBufferUsageFlags usage, VkBuffer& buffer, Veloxr::VVAllocation& memory);
+    };
+
+    /**
+     * Unified memory path (integrated GPUs, lavapipe): tiles are host visible linear images that are written in place
+     * from worker threads. The only GPU work left is one PREINITIALIZED -> SHADER_READ_ONLY transition per tile.
+     * Tiles the device cannot create linearly, and array images (linear tiling is only guaranteed for one layer), go to the wrapped uploader.
+     */
+    class VVLinearTileUploader : public VVTileUploader {
+        public:
+            VVLinearTileUploader(std::shared_ptr<Veloxr::VVDataPacket> data, std::shared_ptr<VVTileUploader> fallback);
+
+            const char* getName() const override { return "linear"; }
+            Veloxr::VVTileImageDesc getImageDesc(VkFormat format, uint32_t width, uint32_t height, uint32_t layers, bool packedRGB) override;
+            void upload(std::vector<Veloxr::VVTileUpload>& uploads) override;
+            bool supportsPackedRGB(uint32_t width, uint32_t height) override;
+
+        private:
+            inline static LLogger console{"[Veloxr][VVLinearTileUploader] "};
+            static constexpr VkMemoryPropertyFlags LINEAR_MEMORY_PROPERTIES =
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+            std::shared_ptr<Veloxr::VVDataPacket> _data;
+            std::shared_ptr<VVTileUploader> _fallback;
+
+            std::mutex _formatMutex;
+            std::map<VkFormat, VkImageFormatProperties> _formatSupport;
+
+            bool supportsLinear(VkFormat format, uint32_t width, uint32_t height);
+            void writeTile(Veloxr::VVTileUpload& upload);
+    };
+
+#ifdef VK_EXT_host_image_copy
+    /**
+     * VK_EXT_host_image_copy path: the driver copies straight from the tile's host memory into the image.
+     * No staging buffer, no command buffer and no queue submission, so tiles are spread over worker threads.
+     * Formats the device cannot host-copy fall back to the staging path.
+     */
+    class VVHostImageCopyTileUploader : public VVTileUploader {
+        public:
+            VVHostImageCopyTileUploader(std::shared_ptr<Veloxr::VVDataPacket> data);
+
+            const char* getName() const override { return "host_image_copy"; }
+            Veloxr::VVTileImageDesc getImageDesc(VkFormat format, uint32_t width, uint32_t height, uint32_t layers, bool packedRGB) override;
+            void upload(std::vector<Veloxr::VVTileUpload>& uploads) override;
+            bool supportsPackedRGB(uint32_t width, uint32_t height) override;
+
+            inline bool isValid() const { return _copyMemoryToImage && _transitionImageLayout; }
+
+        private:
+            inline static LLogger console{"[Veloxr][VVHostImageCopyTileUploader] "};
+
+            std::shared_ptr<Veloxr::VVDataPacket> _data;
+            VVStagingTileUploader _fallback;
+            VkImageLayout _dstLayout{VK_IMAGE_LAYOUT_GENERAL};
+
+            PFN_vkCopyMemoryToImageEXT _copyMemoryToImage{nullptr};
+            PFN_vkTransitionImageLayoutEXT _transitionImageLayout{nullptr};
+
+            std::mutex _formatMutex;
+            std::map<VkFormat, bool> _formatSupport;
+
+            bool supportsFormat(VkFormat format);
+            void uploadOne(Veloxr::VVTileUpload& upload);
+    };
+#endif
+}
@@ -1,9 +1,12 @@
 #include "VVUtils.h"
+#include "VVTaskScheduler.h"
+#include <fstream>
+#include <vector>
 
 namespace Veloxr {
 
 
-    void VVUtils::createBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+    void VVUtils::createBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Veloxr::VVAllocation& bufferMemory) {
         console.logc1(__func__);
         auto device = data->device;
         VkBufferCreateInfo bufferInfo{};
@@ -19,40 +22,49 @@ namespace Veloxr {
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = VVUtils::findMemoryType(data, memRequirements.memoryTypeBits, properties);
+        bufferMemory = data->allocator->allocate(memRequirements, properties, true);
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
-        }
+        vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
+    }
 
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    void VVUtils::destroyBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkBuffer& buffer, Veloxr::VVAllocation& bufferMemory) {
+        if (buffer) vkDestroyBuffer(data->device, buffer, nullptr);
+        data->allocator->free(bufferMemory);
+        buffer = VK_NULL_HANDLE;
     }
 
 
     uint32_t VVUtils::findMemoryType(std::shared_ptr<Veloxr::VVDataPacket> data, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
         console.logc1(__func__);
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(data->physicalDevice, &memProperties);
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
-            }
-        }
-
-        throw std::runtime_error("failed to find suitable memory type!");
+        return data->allocator->findMemoryType(typeFilter, properties);
     }
 
-    void VVUtils::copyBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+    void VVUtils::copyBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset) {
         console.logc1(__func__);
         VkCommandBuffer commandBuffer = CommandUtils::beginSingleTimeCommands(data->device, data->commandPool);
 
         VkBufferCopy copyRegion{};
+        copyRegion.dstOffset = dstOffset;
         copyRegion.size = size;
         vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
         CommandUtils::endSingleTimeCommands(data->device, commandBuffer, data->commandPool, data->graphicsQueue);
     }
+
+    std::vector<char> VVUtils::readFile(const std::string& filename) {
+        console.logc1(__func__, " ", filename);
+        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open file!");
+        }
+        size_t fileSize = (size_t) file.tellg();
+        std::vector<char> buffer(fileSize);
+        file.seekg(0);
+        file.read(buffer.data(), fileSize);
+        return buffer;
+    }
+
+    void VVUtils::parallelFor(size_t count, const std::function<void(size_t)>& fn, size_t maxThreads) {
+        Veloxr::VVTaskScheduler::get().parallelFor(count, fn, maxThreads);
+    }
 }
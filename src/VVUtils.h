@@ -1,5 +1,8 @@
 #pragma once
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 #include <vulkan/vulkan_core.h>
 
 #include "Common.h"
@@ -16,9 +19,15 @@ namespace Veloxr {
             inline static LLogger console{"[Veloxr][VVUtils] "}; 
         public:
 
-            static void createBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+            static void createBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Veloxr::VVAllocation& bufferMemory);
+            static void destroyBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkBuffer& buffer, Veloxr::VVAllocation& bufferMemory);
             static uint32_t findMemoryType(std::shared_ptr<Veloxr::VVDataPacket> data, uint32_t typeFilter, VkMemoryPropertyFlags properties);
-            static void copyBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+            static void copyBuffer(std::shared_ptr<Veloxr::VVDataPacket> data, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+            static std::vector<char> readFile(const std::string& filename);
+
+            // Runs fn(0..count-1) over up to maxThreads workers of the shared VVTaskScheduler, the calling thread
+            // included. Rethrows the first failure. Safe to nest.
+            static void parallelFor(size_t count, const std::function<void(size_t)>& fn, size_t maxThreads = 16);
     };
 
 }
@@ -0,0 +1,466 @@
+#include "VVVirtualTextureCache.h"
+#include "CommandUtils.h"
+#include "VVUtils.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace Veloxr {
+
+    VVVirtualTextureCache::VVVirtualTextureCache(std::shared_ptr<Veloxr::VVDataPacket> data, uint32_t cacheSize): _data(data) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(_data->physicalDevice, &properties);
+
+        // At least one page per possible texture for the pinned coarse levels, plus room to stream.
+        cacheSize = std::clamp(cacheSize, 16 * PAGE_SIZE, properties.limits.maxImageDimension2D);
+        _cachePagesPerSide = cacheSize / PAGE_SIZE;
+        _slots.resize(static_cast<size_t>(_cachePagesPerSide) * _cachePagesPerSide);
+        _freeEntries[0] = PAGE_TABLE_ENTRIES;
+
+        createCacheImage(_cachePagesPerSide * PAGE_SIZE);
+        createBuffers();
+        createDescriptorSet();
+        console.log("Virtual texture cache of ", _slots.size(), " pages (", _cachePagesPerSide * PAGE_SIZE, "^2).");
+    }
+
+    void VVVirtualTextureCache::createCacheImage(uint32_t cacheSize) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = cacheSize;
+        imageInfo.extent.height = cacheSize;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = CACHE_FORMAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(_data->device, &imageInfo, nullptr, &_cacheImage) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create virtual texture cache image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(_data->device, _cacheImage, &memRequirements);
+        _cacheMemory = _data->allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+        vkBindImageMemory(_data->device, _cacheImage, _cacheMemory.memory, _cacheMemory.offset);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = _cacheImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = CACHE_FORMAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(_data->device, &viewInfo, nullptr, &_cacheView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create virtual texture cache image view!");
+        }
+
+        // Slots are only sampled once the page table points at them, the contents can stay undefined until then.
+        VkCommandBuffer commandBuffer = CommandUtils::beginSingleTimeCommands(_data->device, _data->commandPool);
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = _cacheImage;
+        barrier.subresourceRange = viewInfo.subresourceRange;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        CommandUtils::endSingleTimeCommands(_data->device, commandBuffer, _data->commandPool, _data->graphicsQueue);
+    }
+
+    void VVVirtualTextureCache::createBuffers() {
+        const VkMemoryPropertyFlags hostFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        const VkDeviceSize tableSize = PAGE_TABLE_ENTRIES * sizeof(uint32_t);
+
+        VVUtils::createBuffer(_data, tableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostFlags, _pageTableBuffer, _pageTableMemory);
+        VVUtils::createBuffer(_data, MAX_TEXTURES * sizeof(TextureInfo), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostFlags, _infoBuffer, _infoMemory);
+
+        // The CPU scans feedback every frame, cached memory makes those reads cheap where the device offers it.
+        VkMemoryPropertyFlags feedbackFlags = hostFlags;
+        const auto& memoryProperties = _data->allocator->getMemoryProperties();
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            const VkMemoryPropertyFlags cached = hostFlags | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            if ((memoryProperties.memoryTypes[i].propertyFlags & cached) == cached) {
+                feedbackFlags = cached;
+                break;
+            }
+        }
+        VVUtils::createBuffer(_data, tableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, feedbackFlags, _feedbackBuffer, _feedbackMemory);
+
+        if (!_pageTableMemory.mapped || !_infoMemory.mapped || !_feedbackMemory.mapped) {
+            throw std::runtime_error("failed to map virtual texture buffers!");
+        }
+        std::memset(pageTable(), 0, tableSize);
+        std::memset(feedback(), 0, tableSize);
+        std::memset(_infoMemory.mapped, 0, MAX_TEXTURES * sizeof(TextureInfo));
+    }
+
+    void VVVirtualTextureCache::createDescriptorSet() {
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(_data->device, &layoutInfo, nullptr, &_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create virtual texture descriptor set layout!");
+        }
+
+        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        poolSizes[0].descriptorCount = 1;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[1].descriptorCount = 3;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = 1;
+        if (vkCreateDescriptorPool(_data->device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create virtual texture descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = _descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &_descriptorSetLayout;
+        if (vkAllocateDescriptorSets(_data->device, &allocInfo, &_descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate virtual texture descriptor set!");
+        }
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageView = _cacheView;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+        bufferInfos[0] = { _pageTableBuffer, 0, VK_WHOLE_SIZE };
+        bufferInfos[1] = { _infoBuffer, 0, VK_WHOLE_SIZE };
+        bufferInfos[2] = { _feedbackBuffer, 0, VK_WHOLE_SIZE };
+
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = _descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = bindings[i].descriptorType;
+            if (i == 0) writes[i].pImageInfo = &imageInfo;
+            else writes[i].pBufferInfo = &bufferInfos[i - 1];
+        }
+        vkUpdateDescriptorSets(_data->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    uint32_t VVVirtualTextureCache::registerTexture(std::shared_ptr<Veloxr::VeloxrBuffer> buffer) {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        uint32_t id = 0;
+        while (id < MAX_TEXTURES && _textures.count(id)) id++;
+        if (id == MAX_TEXTURES) {
+            throw std::runtime_error("too many virtual textures!");
+        }
+
+        VirtualTexture texture{};
+        texture.buffer = buffer;
+        texture.info.width = static_cast<uint32_t>(buffer->width);
+        texture.info.height = static_cast<uint32_t>(buffer->height);
+        texture.info.cachePagesPerSide = _cachePagesPerSide;
+
+        // Halve until the whole image fits one page.
+        uint32_t entryCount = 0;
+        uint32_t level = 0;
+        for (; level < MAX_LEVELS; level++) {
+            const uint64_t pageExtent = static_cast<uint64_t>(PAGE_SIZE) << level;
+            texture.info.levelPagesX[level] = static_cast<uint32_t>((buffer->width + pageExtent - 1) / pageExtent);
+            texture.levelPagesY[level] = static_cast<uint32_t>((buffer->height + pageExtent - 1) / pageExtent);
+            texture.info.levelOffset[level] = entryCount;
+            entryCount += texture.info.levelPagesX[level] * texture.levelPagesY[level];
+            if (texture.info.levelPagesX[level] == 1 && texture.levelPagesY[level] == 1) break;
+        }
+        if (level == MAX_LEVELS) {
+            throw std::runtime_error("image too large for a virtual texture!");
+        }
+        texture.info.levelCount = level + 1;
+
+        texture.firstEntry = allocateEntries(entryCount);
+        texture.entryCount = entryCount;
+        for (uint32_t l = 0; l < texture.info.levelCount; l++) texture.info.levelOffset[l] += texture.firstEntry;
+
+        std::memset(pageTable() + texture.firstEntry, 0, entryCount * sizeof(uint32_t));
+        std::memset(feedback() + texture.firstEntry, 0, entryCount * sizeof(uint32_t));
+        std::memcpy(static_cast<TextureInfo*>(_infoMemory.mapped) + id, &texture.info, sizeof(TextureInfo));
+
+        const uint32_t coarsest = texture.info.levelCount - 1;
+        _textures[id] = std::move(texture);
+        streamPages({ PageRequest{ id, coarsest, 0, 0, _textures[id].info.levelOffset[coarsest] } }, true);
+
+        console.log("Virtual texture ", id, ": ", buffer->width, "x", buffer->height, ", ", coarsest + 1, " levels, ", entryCount, " pages.");
+        return id;
+    }
+
+    void VVVirtualTextureCache::unregisterTexture(uint32_t id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _textures.find(id);
+        if (it == _textures.end()) return;
+
+        for (auto& slot : _slots) {
+            if (slot.used && slot.texture == id) slot = CacheSlot{};
+        }
+        std::memset(pageTable() + it->second.firstEntry, 0, it->second.entryCount * sizeof(uint32_t));
+        freeEntries(it->second.firstEntry, it->second.entryCount);
+        _textures.erase(it);
+    }
+
+    void VVVirtualTextureCache::invalidateRegion(uint32_t id, const glm::uvec4& rect) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _textures.find(id);
+        if (it == _textures.end() || !rect.z || !rect.w) return;
+        const auto& texture = it->second;
+
+        // Resident pages under rect are loaded again from the buffer, into whatever slot frees up first.
+        std::vector<PageRequest> pinnedRequests, requests;
+        for (uint32_t level = 0; level < texture.info.levelCount; level++) {
+            const uint64_t pageExtent = static_cast<uint64_t>(PAGE_SIZE) << level;
+            const uint32_t pagesX = texture.info.levelPagesX[level];
+            const uint32_t lastX = std::min<uint32_t>(static_cast<uint32_t>((uint64_t(rect.x) + rect.z - 1) / pageExtent), pagesX - 1);
+            const uint32_t lastY = std::min<uint32_t>(static_cast<uint32_t>((uint64_t(rect.y) + rect.w - 1) / pageExtent), texture.levelPagesY[level] - 1);
+            for (uint32_t pageY = static_cast<uint32_t>(rect.y / pageExtent); pageY <= lastY; pageY++) {
+                for (uint32_t pageX = static_cast<uint32_t>(rect.x / pageExtent); pageX <= lastX; pageX++) {
+                    const uint32_t entry = texture.info.levelOffset[level] + pageY * pagesX + pageX;
+                    const uint32_t value = pageTable()[entry];
+                    if (!(value & RESIDENT_BIT)) continue;
+
+                    auto& slot = _slots[value & ~RESIDENT_BIT];
+                    (slot.pinned ? pinnedRequests : requests).push_back({ id, level, pageX, pageY, entry });
+                    slot = CacheSlot{};
+                    pageTable()[entry] = 0;
+                }
+            }
+        }
+        if (!pinnedRequests.empty()) streamPages(pinnedRequests, true);
+        if (!requests.empty()) streamPages(requests, false);
+    }
+
+    uint32_t VVVirtualTextureCache::allocateEntries(uint32_t count) {
+        for (auto it = _freeEntries.begin(); it != _freeEntries.end(); ++it) {
+            if (it->second < count) continue;
+            const uint32_t first = it->first;
+            const uint32_t remaining = it->second - count;
+            _freeEntries.erase(it);
+            if (remaining) _freeEntries[first + count] = remaining;
+            return first;
+        }
+        throw std::runtime_error("virtual texture page table is full!");
+    }
+
+    void VVVirtualTextureCache::freeEntries(uint32_t first, uint32_t count) {
+        auto next = _freeEntries.lower_bound(first);
+        if (next != _freeEntries.end() && first + count == next->first) {
+            count += next->second;
+            next = _freeEntries.erase(next);
+        }
+        if (next != _freeEntries.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == first) {
+                previous->second += count;
+                return;
+            }
+        }
+        _freeEntries[first] = count;
+    }
+
+    uint32_t VVVirtualTextureCache::acquireSlot() {
+        // Free slot first, then the least recently used one that was not touched this frame.
+        uint32_t victim = NO_SLOT;
+        for (uint32_t i = 0; i < _slots.size(); i++) {
+            const auto& slot = _slots[i];
+            if (!slot.used) return i;
+            if (slot.pinned || slot.lastUsed >= _frame) continue;
+            if (victim == NO_SLOT || slot.lastUsed < _slots[victim].lastUsed) victim = i;
+        }
+        if (victim != NO_SLOT) pageTable()[_slots[victim].entry] = 0;
+        return victim;
+    }
+
+    bool VVVirtualTextureCache::update() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _frame++;
+
+        // A frame still in flight may be writing feedback while we clear it, a lost request is simply made again.
+        std::vector<PageRequest> requests;
+        uint32_t* requested = feedback();
+        for (const auto& [id, texture] : _textures) {
+            for (uint32_t level = 0; level < texture.info.levelCount; level++) {
+                const uint32_t pagesX = texture.info.levelPagesX[level];
+                for (uint32_t pageY = 0; pageY < texture.levelPagesY[level]; pageY++) {
+                    for (uint32_t pageX = 0; pageX < pagesX; pageX++) {
+                        const uint32_t entry = texture.info.levelOffset[level] + pageY * pagesX + pageX;
+                        if (!requested[entry]) continue;
+                        requested[entry] = 0;
+
+                        const uint32_t value = pageTable()[entry];
+                        if (value & RESIDENT_BIT) _slots[value & ~RESIDENT_BIT].lastUsed = _frame;
+                        else requests.push_back({ id, level, pageX, pageY, entry });
+                    }
+                }
+            }
+        }
+        if (requests.empty()) return false;
+
+        // Coarse pages cover more of the screen and make the finer ones fall back gracefully.
+        std::stable_sort(requests.begin(), requests.end(), [](const PageRequest& a, const PageRequest& b) {
+            return a.level > b.level;
+        });
+        if (requests.size() > MAX_PAGES_PER_UPDATE) requests.resize(MAX_PAGES_PER_UPDATE);
+        return streamPages(requests, false) > 0;
+    }
+
+    size_t VVVirtualTextureCache::streamPages(const std::vector<PageRequest>& requests, bool pinned) {
+        // The other frame in flight may still sample slots we are about to replace.
+        vkQueueWaitIdle(_data->graphicsQueue);
+
+        std::vector<PageRequest> loads;
+        std::vector<uint32_t> slots;
+        for (const auto& request : requests) {
+            const uint32_t slot = acquireSlot();
+            if (slot == NO_SLOT) {
+                console.warn("Virtual texture cache is full, ", requests.size() - loads.size(), " pages not loaded.");
+                break;
+            }
+            _slots[slot] = CacheSlot{ true, pinned, request.texture, request.entry, _frame };
+            loads.push_back(request);
+            slots.push_back(slot);
+        }
+        if (loads.empty()) return 0;
+
+        const VkDeviceSize pageBytes = static_cast<VkDeviceSize>(PAGE_SIZE) * PAGE_SIZE * 4;
+        VkBuffer stagingBuffer;
+        Veloxr::VVAllocation stagingMemory;
+        VVUtils::createBuffer(_data, pageBytes * loads.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
+
+        auto* staging = static_cast<unsigned char*>(stagingMemory.mapped);
+        VVUtils::parallelFor(loads.size(), [&](size_t i) {
+            extractPage(_textures.at(loads[i].texture), loads[i], staging + pageBytes * i);
+        });
+
+        std::vector<VkBufferImageCopy> regions(loads.size());
+        for (size_t i = 0; i < loads.size(); i++) {
+            regions[i].bufferOffset = pageBytes * i;
+            regions[i].bufferRowLength = 0;
+            regions[i].bufferImageHeight = 0;
+            regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[i].imageSubresource.mipLevel = 0;
+            regions[i].imageSubresource.baseArrayLayer = 0;
+            regions[i].imageSubresource.layerCount = 1;
+            regions[i].imageOffset = { static_cast<int32_t>(slots[i] % _cachePagesPerSide * PAGE_SIZE),
+                                       static_cast<int32_t>(slots[i] / _cachePagesPerSide * PAGE_SIZE), 0 };
+            regions[i].imageExtent = { PAGE_SIZE, PAGE_SIZE, 1 };
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = _cacheImage;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        // Resident slots keep their contents, the transition starts from SHADER_READ_ONLY rather than UNDEFINED.
+        VkCommandBuffer commandBuffer = CommandUtils::beginSingleTimeCommands(_data->device, _data->commandPool);
+        barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, _cacheImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                static_cast<uint32_t>(regions.size()), regions.data());
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        CommandUtils::endSingleTimeCommands(_data->device, commandBuffer, _data->commandPool, _data->graphicsQueue);
+
+        VVUtils::destroyBuffer(_data, stagingBuffer, stagingMemory);
+
+        // Only point at the slots once the copy is done.
+        for (size_t i = 0; i < loads.size(); i++) {
+            pageTable()[loads[i].entry] = RESIDENT_BIT | slots[i];
+        }
+        console.logc1("Streamed ", loads.size(), " virtual texture pages.");
+        return loads.size();
+    }
+
+    void VVVirtualTextureCache::extractPage(const VirtualTexture& texture, const PageRequest& request, unsigned char* out) const {
+        // Point sampled, matching the nearest sampler the tiles use. Edge pages repeat the last row / column.
+        const auto& buffer = *texture.buffer;
+        const uint64_t channels = buffer.numChannels;
+        const bool bgra = buffer.channelOrder == Veloxr::ChannelOrder::BGRA && channels >= 3;
+        const uint64_t step = 1ull << request.level;
+        const uint64_t originX = static_cast<uint64_t>(request.pageX) * PAGE_SIZE;
+        const uint64_t originY = static_cast<uint64_t>(request.pageY) * PAGE_SIZE;
+
+        for (uint32_t y = 0; y < PAGE_SIZE; y++) {
+            const uint64_t sourceY = std::min((originY + y) * step, buffer.height - 1);
+            const unsigned char* row = buffer.data.data() + sourceY * buffer.width * channels;
+            unsigned char* dst = out + static_cast<size_t>(y) * PAGE_SIZE * 4;
+            for (uint32_t x = 0; x < PAGE_SIZE; x++, dst += 4) {
+                const unsigned char* src = row + std::min((originX + x) * step, buffer.width - 1) * channels;
+                switch (channels) {
+                    case 1: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255; break;
+                    case 2: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+                    case 3: dst[0] = src[bgra ? 2 : 0]; dst[1] = src[1]; dst[2] = src[bgra ? 0 : 2]; dst[3] = 255; break;
+                    default: dst[0] = src[bgra ? 2 : 0]; dst[1] = src[1]; dst[2] = src[bgra ? 0 : 2]; dst[3] = src[3]; break;
+                }
+            }
+        }
+    }
+
+    void VVVirtualTextureCache::destroy() {
+        if (!_data || !_data->device) return;
+        if (_descriptorPool) vkDestroyDescriptorPool(_data->device, _descriptorPool, nullptr);
+        if (_descriptorSetLayout) vkDestroyDescriptorSetLayout(_data->device, _descriptorSetLayout, nullptr);
+        if (_cacheView) vkDestroyImageView(_data->device, _cacheView, nullptr);
+        if (_cacheImage) vkDestroyImage(_data->device, _cacheImage, nullptr);
+        if (_cacheMemory.isValid()) _data->allocator->free(_cacheMemory);
+        if (_pageTableBuffer) VVUtils::destroyBuffer(_data, _pageTableBuffer, _pageTableMemory);
+        if (_infoBuffer) VVUtils::destroyBuffer(_data, _infoBuffer, _infoMemory);
+        if (_feedbackBuffer) VVUtils::destroyBuffer(_data, _feedbackBuffer, _feedbackMemory);
+        _descriptorPool = VK_NULL_HANDLE;
+        _descriptorSetLayout = VK_NULL_HANDLE;
+        _descriptorSet = VK_NULL_HANDLE;
+        _cacheView = VK_NULL_HANDLE;
+        _cacheImage = VK_NULL_HANDLE;
+        _pageTableBuffer = VK_NULL_HANDLE;
+        _infoBuffer = VK_NULL_HANDLE;
+        _feedbackBuffer = VK_NULL_HANDLE;
+        _textures.clear();
+    }
+
+    VVVirtualTextureCache::~VVVirtualTextureCache() { destroy(); }
+}
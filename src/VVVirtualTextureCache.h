@@ -0,0 +1,133 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "Common.h"
+#include "DataUtils.h"
+#include "VLogger.h"
+
+namespace Veloxr {
+
+    /**
+     * Virtual texture streaming (descriptor set 2, spirv/frag_virtual.spv).
+     *
+     * Each registered image is cut into PAGE_SIZE pages over a mip chain (level n samples every 2^n-th texel).
+     * A host visible page table maps every page to a slot of one fixed size physical cache texture, the fragment
+     * shader draws with the finest resident level and marks the page it wanted in a feedback buffer.
+     * update() reads that feedback once per frame and streams the missing pages in from the host pixels, coarse
+     * levels first, replacing the least recently used slots. The coarsest page of each image is pinned so
+     * something is always on screen.
+     */
+    class VVVirtualTextureCache {
+        public:
+            static constexpr uint32_t PAGE_SIZE = 256;
+            static constexpr uint32_t MAX_LEVELS = 16;
+            static constexpr uint32_t MAX_TEXTURES = 64;
+            static constexpr uint32_t PAGE_TABLE_ENTRIES = 1u << 20;
+            static constexpr uint32_t RESIDENT_BIT = 0x80000000u;
+            static constexpr VkFormat CACHE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+            // cacheSize is the edge of the physical cache texture in texels, rounded down to whole pages.
+            VVVirtualTextureCache(std::shared_ptr<Veloxr::VVDataPacket> data, uint32_t cacheSize);
+            ~VVVirtualTextureCache();
+
+            inline bool isValid() const { return _descriptorSet != VK_NULL_HANDLE; }
+            inline VkDescriptorSetLayout getDescriptorSetLayout() const { return _descriptorSetLayout; }
+            inline VkDescriptorSet getDescriptorSet() const { return _descriptorSet; }
+
+            // The buffer is kept alive until unregisterTexture. Returns the id the vertices carry as -(id + 1).
+            uint32_t registerTexture(std::shared_ptr<Veloxr::VeloxrBuffer> buffer);
+            void unregisterTexture(uint32_t id);
+            // Loads the resident pages under rect (x, y, width, height in buffer pixels) again after the buffer changed.
+            void invalidateRegion(uint32_t id, const glm::uvec4& rect);
+
+            // Reads the feedback written by the frames so far and streams missing pages in.
+            // Call from the render thread once the frame fence has been waited on. Returns whether pages were streamed.
+            bool update();
+
+            void destroy();
+
+        private:
+            inline static LLogger console{"[Veloxr][VVVirtualTextureCache] "};
+            static constexpr uint32_t MAX_PAGES_PER_UPDATE = 32;
+            static constexpr uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+            // std430 mirror of VirtualTextureInfo in passthrough_virtual.frag.
+            struct TextureInfo {
+                uint32_t width;
+                uint32_t height;
+                uint32_t levelCount;
+                uint32_t cachePagesPerSide;
+                uint32_t levelOffset[MAX_LEVELS];
+                uint32_t levelPagesX[MAX_LEVELS];
+            };
+
+            struct VirtualTexture {
+                std::shared_ptr<Veloxr::VeloxrBuffer> buffer;
+                TextureInfo info{};
+                uint32_t levelPagesY[MAX_LEVELS]{};
+                uint32_t firstEntry{0};
+                uint32_t entryCount{0};
+            };
+
+            struct PageRequest {
+                uint32_t texture;
+                uint32_t level;
+                uint32_t pageX, pageY;
+                uint32_t entry;
+            };
+
+            struct CacheSlot {
+                bool used{false};
+                bool pinned{false};
+                uint32_t texture{0};
+                uint32_t entry{0};
+                uint64_t lastUsed{0};
+            };
+
+            std::shared_ptr<Veloxr::VVDataPacket> _data;
+            std::mutex _mutex;
+            uint64_t _frame{0};
+
+            uint32_t _cachePagesPerSide{0};
+            std::vector<CacheSlot> _slots;
+            std::map<uint32_t, VirtualTexture> _textures;
+            // First entry -> count, coalesced on free.
+            std::map<uint32_t, uint32_t> _freeEntries;
+
+            VkImage _cacheImage{VK_NULL_HANDLE};
+            Veloxr::VVAllocation _cacheMemory{};
+            VkImageView _cacheView{VK_NULL_HANDLE};
+
+            // Host visible and persistently mapped, the CPU owns the page table and info, the GPU writes feedback.
+            VkBuffer _pageTableBuffer{VK_NULL_HANDLE};
+            Veloxr::VVAllocation _pageTableMemory{};
+            VkBuffer _infoBuffer{VK_NULL_HANDLE};
+            Veloxr::VVAllocation _infoMemory{};
+            VkBuffer _feedbackBuffer{VK_NULL_HANDLE};
+            Veloxr::VVAllocation _feedbackMemory{};
+
+            VkDescriptorSetLayout _descriptorSetLayout{VK_NULL_HANDLE};
+            VkDescriptorPool _descriptorPool{VK_NULL_HANDLE};
+            VkDescriptorSet _descriptorSet{VK_NULL_HANDLE};
+
+            void createCacheImage(uint32_t cacheSize);
+            void createBuffers();
+            void createDescriptorSet();
+
+            uint32_t allocateEntries(uint32_t count);
+            void freeEntries(uint32_t first, uint32_t count);
+            uint32_t acquireSlot();
+
+            // Returns the number of pages loaded, less than requested when the cache is full.
+            size_t streamPages(const std::vector<PageRequest>& requests, bool pinned);
+            void extractPage(const VirtualTexture& texture, const PageRequest& request, unsigned char* out) const;
+
+            inline uint32_t* pageTable() const { return static_cast<uint32_t*>(_pageTableMemory.mapped); }
+            inline uint32_t* feedback() const { return static_cast<uint32_t*>(_feedbackMemory.mapped); }
+    };
+}
@@ -2,7 +2,12 @@
 
 #include <glm/glm.hpp>
 #include <vulkan/vulkan.h>
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
 namespace Veloxr {
 
 
@@ -11,6 +16,10 @@ namespace Veloxr {
         glm::vec4 texCoord;
         int textureUnit;
         int renderUID;
+        int textureLayer{0}; // Layer inside the texture array bound at textureUnit.
+        // Entities with an overview: > 0 on the overview quad, < 0 on the tiles, the magnitude is the overview's
+        // downsampling factor. 0 is always drawn.
+        float overviewScale{0.0f};
 
         static VkVertexInputBindingDescription getBindingDescription() {
             VkVertexInputBindingDescription bindingDescription{};
@@ -20,8 +29,8 @@ namespace Veloxr {
 
             return bindingDescription;
         }
-        static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions() {
-            std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions{};
+        static std::array<VkVertexInputAttributeDescription, 6> getAttributeDescriptions() {
+            std::array<VkVertexInputAttributeDescription, 6> attributeDescriptions{};
 
             int descriptionIndex = 0;
             attributeDescriptions[descriptionIndex].binding = 0;
@@ -44,6 +53,125 @@ namespace Veloxr {
             attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32_SINT;
             attributeDescriptions[descriptionIndex++].offset = offsetof(Vertex, renderUID);
 
+            attributeDescriptions[descriptionIndex].binding = 0;
+            attributeDescriptions[descriptionIndex].location = descriptionIndex;
+            attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32_SINT;
+            attributeDescriptions[descriptionIndex++].offset = offsetof(Vertex, textureLayer);
+
+            attributeDescriptions[descriptionIndex].binding = 0;
+            attributeDescriptions[descriptionIndex].location = descriptionIndex;
+            attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32_SFLOAT;
+            attributeDescriptions[descriptionIndex++].offset = offsetof(Vertex, overviewScale);
+
+            return attributeDescriptions;
+        }
+    };
+
+    // One drawn quad, instanced: the vertex shader builds its corners from gl_VertexIndex. TextureTiling still
+    // emits Vertex quads, the textures keep them as instances from there on.
+    struct TileInstance {
+        static constexpr uint32_t VERTEX_COUNT = 6;
+        // u follows y and v follows x, the quad of an image rotated by its EXIF orientation.
+        static constexpr uint32_t UV_SWAPPED = 1u;
+
+        glm::vec4 rect;   // minX, minY, maxX, maxY
+        glm::vec4 uvRect; // UV at (minX, minY), UV at (maxX, maxY)
+        int textureUnit;
+        int renderUID;
+        int textureLayer{0};
+        float overviewScale{0.0f}; // See Vertex::overviewScale.
+        uint32_t flags{0};
+
+        // quad holds VERTEX_COUNT vertices spanning an axis aligned rect.
+        static TileInstance fromQuad(const Vertex* quad) {
+            TileInstance instance{};
+            instance.rect = { quad[0].pos.x, quad[0].pos.y, quad[0].pos.x, quad[0].pos.y };
+            for (uint32_t i = 1; i < VERTEX_COUNT; i++) {
+                instance.rect = { std::min(instance.rect.x, quad[i].pos.x), std::min(instance.rect.y, quad[i].pos.y),
+                                  std::max(instance.rect.z, quad[i].pos.x), std::max(instance.rect.w, quad[i].pos.y) };
+            }
+            auto uvAt = [&](float x, float y) {
+                uint32_t nearest = 0;
+                float nearestDistance = std::numeric_limits<float>::max();
+                for (uint32_t i = 0; i < VERTEX_COUNT; i++) {
+                    const float distance = std::abs(quad[i].pos.x - x) + std::abs(quad[i].pos.y - y);
+                    if (distance < nearestDistance) {
+                        nearest = i;
+                        nearestDistance = distance;
+                    }
+                }
+                return glm::vec2(quad[nearest].texCoord.x, quad[nearest].texCoord.y);
+            };
+            const glm::vec2 uvMin = uvAt(instance.rect.x, instance.rect.y);
+            const glm::vec2 uvMax = uvAt(instance.rect.z, instance.rect.w);
+            const glm::vec2 uvRight = uvAt(instance.rect.z, instance.rect.y);
+            instance.uvRect = { uvMin.x, uvMin.y, uvMax.x, uvMax.y };
+            const glm::vec2 swappedRight(uvMin.x, uvMax.y), straightRight(uvMax.x, uvMin.y);
+            if (glm::length(uvRight - swappedRight) < glm::length(uvRight - straightRight)) instance.flags |= UV_SWAPPED;
+
+            instance.textureUnit = quad[0].textureUnit;
+            instance.renderUID = quad[0].renderUID;
+            instance.textureLayer = quad[0].textureLayer;
+            instance.overviewScale = quad[0].overviewScale;
+            return instance;
+        }
+
+        static std::vector<TileInstance> fromQuads(const std::vector<Vertex>& vertices) {
+            std::vector<TileInstance> instances;
+            instances.reserve(vertices.size() / VERTEX_COUNT);
+            for (size_t first = 0; first + VERTEX_COUNT <= vertices.size(); first += VERTEX_COUNT) {
+                instances.push_back(fromQuad(vertices.data() + first));
+            }
+            return instances;
+        }
+
+        static VkVertexInputBindingDescription getBindingDescription() {
+            VkVertexInputBindingDescription bindingDescription{};
+            bindingDescription.binding = 0;
+            bindingDescription.stride = sizeof(TileInstance);
+            bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+            return bindingDescription;
+        }
+        static std::array<VkVertexInputAttributeDescription, 7> getAttributeDescriptions() {
+            std::array<VkVertexInputAttributeDescription, 7> attributeDescriptions{};
+
+            int descriptionIndex = 0;
+            attributeDescriptions[descriptionIndex].binding = 0;
+            attributeDescriptions[descriptionIndex].location = descriptionIndex;
+            attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[descriptionIndex++].offset = offsetof(TileInstance, rect);
+
+            attributeDescriptions[descriptionIndex].binding = 0;
+            attributeDescriptions[descriptionIndex].location = descriptionIndex;
+            attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[descriptionIndex++].offset = offsetof(TileInstance, uvRect);
+
+            attributeDescriptions[descriptionIndex].binding = 0;
+            attributeDescriptions[descriptionIndex].location = descriptionIndex;
+            attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32_SINT;
+            attributeDescriptions[descriptionIndex++].offset = offsetof(TileInstance, textureUnit);
+
+            attributeDescriptions[descriptionIndex].binding = 0;
+            attributeDescriptions[descriptionIndex].location = descriptionIndex;
+            attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32_SINT;
+            attributeDescriptions[descriptionIndex++].offset = offsetof(TileInstance, renderUID);
+
+            attributeDescriptions[descriptionIndex].binding = 0;
+            attributeDescriptions[descriptionIndex].location = descriptionIndex;
+            attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32_SINT;
+            attributeDescriptions[descriptionIndex++].offset = offsetof(TileInstance, textureLayer);
+
+            attributeDescriptions[descriptionIndex].binding = 0;
+            attributeDescriptions[descriptionIndex].location = descriptionIndex;
+            attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32_SFLOAT;
+            attributeDescriptions[descriptionIndex++].offset = offsetof(TileInstance, overviewScale);
+
+            attributeDescriptions[descriptionIndex].binding = 0;
+            attributeDescriptions[descriptionIndex].location = descriptionIndex;
+            attributeDescriptions[descriptionIndex].format = VK_FORMAT_R32_UINT;
+            attributeDescriptions[descriptionIndex++].offset = offsetof(TileInstance, flags);
+
             return attributeDescriptions;
         }
     };
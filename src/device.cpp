@@ -1,9 +1,11 @@
 #include "device.h"
+#include <algorithm>
+#include <cstring>
 #include <map>
 
 using namespace Veloxr;
 
-Device::Device(VkInstance instance, VkSurfaceKHR surface, bool enableValidationLayers): _instance(instance), _surface(surface), _enableValidationLayers(enableValidationLayers) {
+Device::Device(VkInstance instance, VkSurfaceKHR surface, bool enableValidationLayers, uint32_t instanceApiVersion): _instance(instance), _surface(surface), _enableValidationLayers(enableValidationLayers), _instanceApiVersion(instanceApiVersion) {
 
 }
 
@@ -16,6 +18,7 @@ void Device::create() {
 void Device::_createLogicalDevice() {
 
     QueueFamilyIndices indices = findQueueFamilies(_physicalDevice);
+    _queueFamilies = indices;
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
@@ -39,13 +42,188 @@ void Device::_createLogicalDevice() {
 
     deviceFeatures.shaderClipDistance = VK_TRUE;
 
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+    _features = {};
+    _features.apiVersion = std::min(_instanceApiVersion, deviceProperties.apiVersion);
+
+    if (supported.textureCompressionBC) {
+        deviceFeatures.textureCompressionBC = VK_TRUE;
+        _features.textureCompressionBC = true;
+    }
+    console.log("[Veloxr] BC texture compression: ", _features.textureCompressionBC);
+
+    if (supported.fragmentStoresAndAtomics) {
+        deviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
+        _features.fragmentStoresAndAtomics = true;
+    }
+
+    if (supported.multiDrawIndirect) {
+        deviceFeatures.multiDrawIndirect = VK_TRUE;
+        _features.multiDrawIndirect = true;
+        _features.maxDrawIndirectCount = deviceProperties.limits.maxDrawIndirectCount;
+    }
+
+    std::vector<const char*> enabledExtensions = deviceExtensions;
+
+#ifdef VK_KHR_draw_indirect_count
+    if (_features.multiDrawIndirect && _isExtensionSupported(_physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+        enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        _features.drawIndirectCount = true;
+    }
+#endif
+    console.log("[Veloxr] Multi draw indirect: ", _features.multiDrawIndirect, ", draw indirect count: ", _features.drawIndirectCount);
+
+    // Optional features are chained behind VkPhysicalDeviceFeatures2 when the device is 1.1+.
+    VkPhysicalDeviceFeatures2 deviceFeatures2{};
+    deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    deviceFeatures2.features = deviceFeatures;
+    void** featureChainTail = &deviceFeatures2.pNext;
+    const bool hasFeatures2 = _features.apiVersion >= VK_API_VERSION_1_1;
+
+#ifdef VK_EXT_host_image_copy
+    VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures{};
+    hostImageCopyFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+    if (hasFeatures2 && _isExtensionSupported(_physicalDevice, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME)) {
+        // Dependencies are core in 1.3.
+        bool needsDependencies = _features.apiVersion < VK_API_VERSION_1_3;
+        bool dependenciesMet = !needsDependencies ||
+            (_isExtensionSupported(_physicalDevice, VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME) &&
+             _isExtensionSupported(_physicalDevice, VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME));
+
+        VkPhysicalDeviceFeatures2 query{};
+        query.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        query.pNext = &hostImageCopyFeatures;
+        vkGetPhysicalDeviceFeatures2(_physicalDevice, &query);
+
+        if (dependenciesMet && hostImageCopyFeatures.hostImageCopy) {
+            enabledExtensions.push_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+            if (needsDependencies) {
+                enabledExtensions.push_back(VK_KHR_COPY_COMMANDS_2_EXTENSION_NAME);
+                enabledExtensions.push_back(VK_KHR_FORMAT_FEATURE_FLAGS_2_EXTENSION_NAME);
+            }
+            hostImageCopyFeatures.pNext = nullptr;
+            *featureChainTail = &hostImageCopyFeatures;
+            featureChainTail = &hostImageCopyFeatures.pNext;
+            _features.hostImageCopy = true;
+
+            // Copying straight into SHADER_READ_ONLY_OPTIMAL saves a host side transition, but is optional.
+            VkPhysicalDeviceHostImageCopyPropertiesEXT hostImageCopyProperties{};
+            hostImageCopyProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT;
+            VkPhysicalDeviceProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &hostImageCopyProperties;
+            vkGetPhysicalDeviceProperties2(_physicalDevice, &properties2);
+
+            std::vector<VkImageLayout> dstLayouts(hostImageCopyProperties.copyDstLayoutCount);
+            hostImageCopyProperties.pCopyDstLayouts = dstLayouts.data();
+            hostImageCopyProperties.copySrcLayoutCount = 0;
+            vkGetPhysicalDeviceProperties2(_physicalDevice, &properties2);
+            for (auto layout : dstLayouts) {
+                if (layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) _features.hostImageCopyToShaderReadOnly = true;
+            }
+            console.log("[Veloxr] VK_EXT_host_image_copy enabled. Copy into SHADER_READ_ONLY_OPTIMAL: ", _features.hostImageCopyToShaderReadOnly);
+        }
+    }
+#endif
+
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures{};
+    descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    {
+        // Core in 1.2, the extension needs VK_KHR_maintenance3 before that.
+        const bool descriptorIndexingCore = _features.apiVersion >= VK_API_VERSION_1_2;
+        const bool descriptorIndexingExtension = !descriptorIndexingCore &&
+            _isExtensionSupported(_physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+            _isExtensionSupported(_physicalDevice, VK_KHR_MAINTENANCE_3_EXTENSION_NAME);
+
+        if (hasFeatures2 && (descriptorIndexingCore || descriptorIndexingExtension)) {
+            VkPhysicalDeviceDescriptorIndexingFeatures supportedIndexing{};
+            supportedIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+            VkPhysicalDeviceFeatures2 query{};
+            query.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            query.pNext = &supportedIndexing;
+            vkGetPhysicalDeviceFeatures2(_physicalDevice, &query);
+
+            if (supportedIndexing.runtimeDescriptorArray &&
+                    supportedIndexing.shaderSampledImageArrayNonUniformIndexing &&
+                    supportedIndexing.descriptorBindingSampledImageUpdateAfterBind &&
+                    supportedIndexing.descriptorBindingUpdateUnusedWhilePending &&
+                    supportedIndexing.descriptorBindingPartiallyBound &&
+                    supportedIndexing.descriptorBindingVariableDescriptorCount) {
+                // Only enable what the bindless heap uses.
+                descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+                descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+                descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+                descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+                descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+                descriptorIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+                *featureChainTail = &descriptorIndexingFeatures;
+                featureChainTail = &descriptorIndexingFeatures.pNext;
+
+                if (descriptorIndexingExtension) {
+                    enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+                    enabledExtensions.push_back(VK_KHR_MAINTENANCE_3_EXTENSION_NAME);
+                }
+                _features.descriptorIndexing = true;
+            }
+        }
+        console.log("[Veloxr] Descriptor indexing: ", _features.descriptorIndexing);
+    }
+
+#ifdef VK_EXT_memory_budget
+    if (hasFeatures2 && _isExtensionSupported(_physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+        enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        _features.memoryBudget = true;
+    }
+    console.log("[Veloxr] VK_EXT_memory_budget: ", _features.memoryBudget);
+#endif
+
+#ifdef VK_EXT_external_memory_host
+    if (hasFeatures2 && _isExtensionSupported(_physicalDevice, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+        VkPhysicalDeviceExternalMemoryHostPropertiesEXT externalMemoryHostProperties{};
+        externalMemoryHostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &externalMemoryHostProperties;
+        vkGetPhysicalDeviceProperties2(_physicalDevice, &properties2);
+
+        enabledExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        _features.externalMemoryHost = true;
+        _features.minImportedHostPointerAlignment = externalMemoryHostProperties.minImportedHostPointerAlignment;
+        console.log("[Veloxr] VK_EXT_external_memory_host enabled. Import alignment: ", _features.minImportedHostPointerAlignment);
+    }
+#endif
+
+    if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU || deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memoryProperties);
+        const VkMemoryPropertyFlags unified = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((memoryProperties.memoryTypes[i].propertyFlags & unified) == unified) _features.unifiedMemory = true;
+        }
+        console.log("[Veloxr] Unified memory device: ", _features.unifiedMemory);
+    }
+
+    {
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, queueFamilies.data());
+        _features.graphicsQueueCompute = queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT;
+    }
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-    createInfo.pEnabledFeatures = &deviceFeatures;
+    if (hasFeatures2) {
+        createInfo.pNext = &deviceFeatures2;
+        createInfo.pEnabledFeatures = nullptr;
+    } else {
+        createInfo.pEnabledFeatures = &deviceFeatures;
+    }
 
     // Backwards compatability with older vulkan
     if (_enableValidationLayers) {
@@ -55,8 +233,8 @@ void Device::_createLogicalDevice() {
         createInfo.enabledLayerCount = 0;
     }
 
-    createInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    createInfo.enabledExtensionCount = (uint32_t)enabledExtensions.size();
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 
     if (vkCreateDevice(_physicalDevice, &createInfo, nullptr, &_logicalDevice) != VK_SUCCESS) {
@@ -195,29 +373,53 @@ bool Device::_checkDeviceExtensionSupport(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
+bool Device::_isExtensionSupported(VkPhysicalDevice device, const char* extensionName) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, extensionName) == 0) return true;
+    }
+    return false;
+}
+
 SwapChainSupportDetails Device::querySwapChainSupport(VkPhysicalDevice device) const {
+    return querySwapChainSupport(device, _surface);
+}
+
+SwapChainSupportDetails Device::querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface) const {
     SwapChainSupportDetails details;
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, _surface, &details.capabilities);
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
 
     uint32_t formatCount;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, nullptr);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
 
     if (formatCount != 0) {
         details.formats.resize(formatCount);
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, details.formats.data());
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
     }
 
     uint32_t presentModeCount;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, nullptr);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
 
     if (presentModeCount != 0) {
         details.presentModes.resize(presentModeCount);
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, details.presentModes.data());
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
     }
 
     return details;
 }
 
+bool Device::isPresentSupported(VkSurfaceKHR surface) const {
+    if (!_queueFamilies.presentFamily.has_value()) return false;
+    VkBool32 presentSupport = false;
+    vkGetPhysicalDeviceSurfaceSupportKHR(_physicalDevice, _queueFamilies.presentFamily.value(), surface, &presentSupport);
+    return presentSupport;
+}
+
 void Device::_pickPhysicalDevice() {
     uint32_t deviceCount = 0;
 
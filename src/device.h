@@ -8,6 +8,7 @@
 #define GLFW_INCLUDE_VULKAN
 #include <vulkan/vulkan.h>
 #include "VLogger.h"
+#include "Common.h"
 
 namespace Veloxr {
 
@@ -36,7 +37,10 @@ class Device {
         VkPhysicalDevice _physicalDevice;
         VkDevice _logicalDevice;
         VkQueue _graphicsQueue, _presentQueue;
+        QueueFamilyIndices _queueFamilies;
         bool _enableValidationLayers;
+        uint32_t _instanceApiVersion;
+        Veloxr::VVDeviceFeatures _features{};
         uint32_t _maxTextureResolution;
         uint32_t _maxSamplers;
 
@@ -54,16 +58,23 @@ class Device {
         void _createLogicalDevice();
         int _calculateDeviceScore(VkPhysicalDevice device);
         bool _checkDeviceExtensionSupport(VkPhysicalDevice device);
+        bool _isExtensionSupported(VkPhysicalDevice device, const char* extensionName);
 
 
 
     public:
-        Device(VkInstance instance, VkSurfaceKHR surface, bool enableValidationLayers = false);
+        Device(VkInstance instance, VkSurfaceKHR surface, bool enableValidationLayers = false, uint32_t instanceApiVersion = VK_API_VERSION_1_0);
 
         void create();
 
         QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) const ;
         SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) const ;
+        // Any surface, e.g. the ones of further viewports sharing this device.
+        SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface) const ;
+        // Whether the present queue picked at create() can present to surface.
+        bool isPresentSupported(VkSurfaceKHR surface) const ;
+        // Picked at create(), stays valid after the surface it was picked for is gone.
+        inline const QueueFamilyIndices& getQueueFamilies() const { return _queueFamilies; }
 
         [[nodiscard]] inline VkPhysicalDevice getPhysicalDevice() const { return _physicalDevice; }
         [[nodiscard]] inline VkDevice getLogicalDevice() const { return _logicalDevice; }
@@ -71,5 +82,6 @@ class Device {
         [[nodiscard]] inline VkQueue getPresentationQueue() const { return _presentQueue; }
         inline uint32_t getMaxTextureResolution() const { return _maxTextureResolution; }
         inline uint32_t getMaxSamplersPerStage() const { return _maxSamplers; }
+        inline const Veloxr::VVDeviceFeatures& getFeatures() const { return _features; }
 }; 
 }
@@ -44,7 +44,7 @@ int main(int argc, char* argv[]) {
             auto entityHandle = em->createEntity("main");
 
             Veloxr::VeloxrBuffer buf;
-            buf.data = texture.load(texturePath);
+            buf.data = texture.load(texturePath, false);
             buf.width = texture.getResolution().x;
             buf.height = texture.getResolution().y;
             buf.numChannels = texture.getNumChannels();
@@ -59,7 +59,7 @@ int main(int argc, char* argv[]) {
             Veloxr::OIIOTexture texture("C:/Users/ljuek/Downloads/fox_after.jpeg");
 
             Veloxr::VeloxrBuffer buf;
-            buf.data = texture.load();
+            buf.data = texture.load("", false);
             buf.width = texture.getResolution().x;
             buf.height = texture.getResolution().y;
             buf.numChannels = texture.getNumChannels();
@@ -2,7 +2,12 @@
 #include "Common.h"
 #include "DataUtils.h"
 #include "EntityManager.h"
+#include "VVVirtualTextureCache.h"
+#include "VVMemoryBudget.h"
+#include "VVImagePrefetcher.h"
+#include "VVRenderContext.h"
 #include <chrono>
+#include <cstring>
 #include <memory>
 #include <stdexcept>
 #include <vulkan/vulkan_core.h>
@@ -32,6 +37,10 @@ void RendererCore::setWindowDimensions(int width, int height) {
 }
 
 void RendererCore::init(void* windowHandle) {
+    init(windowHandle, nullptr);
+}
+
+void RendererCore::init(void* windowHandle, std::shared_ptr<Veloxr::VVRenderContext> context) {
     console.logc1(__func__);
     destroy();
     auto now = std::chrono::high_resolution_clock::now();
@@ -45,28 +54,53 @@ void RendererCore::init(void* windowHandle) {
 
     auto timeElapsed = std::chrono::high_resolution_clock::now() - now;
     console.log("Init glfw: ", std::chrono::duration_cast<std::chrono::milliseconds>(timeElapsed).count(), "ms\t", std::chrono::duration_cast<std::chrono::microseconds>(timeElapsed).count(), "microseconds.\n");
-    createVulkanInstance();
-    setupDebugMessenger();
+    if (context) {
+        instance = context->getInstance();
+    } else {
+        createVulkanInstance();
+        setupDebugMessenger();
+    }
     if(noClientWindow) createSurface();
     else createSurfaceFromWindowHandle(windowHandle);
 
-    _deviceUtils = std::make_shared<Veloxr::Device>(instance, surface, enableValidationLayers);
-    _dataPacket = std::make_shared<Veloxr::VVDataPacket>();
-    _deviceUtils->create();
+    if (!context) {
+        context = std::make_shared<Veloxr::VVRenderContext>(instance, enableValidationLayers ? debugMessenger : VK_NULL_HANDLE, surface,
+                _settings, enableValidationLayers, instanceApiVersion, findShaderPath().string());
+    } else if (!context->isValid()) {
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+        throw std::runtime_error("failed to share render context, it went with its last viewport!");
+    } else if (!context->getDevice()->isPresentSupported(surface)) {
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+        throw std::runtime_error("failed to share render context, its device cannot present to this surface!");
+    } else {
+        console.log("Joining a shared render context.");
+    }
+    _context = context;
+
+    _deviceUtils = _context->getDevice();
+    _dataPacket = _context->getDataPacket();
     device = _deviceUtils->getLogicalDevice();
     physicalDevice = _deviceUtils->getPhysicalDevice();
     graphicsQueue = _deviceUtils->getGraphicsQueue();
     presentQueue = _deviceUtils->getPresentationQueue();
-    _dataPacket->device = _deviceUtils->getLogicalDevice();
-    _dataPacket->physicalDevice = _deviceUtils->getPhysicalDevice();
-    _dataPacket->graphicsQueue = graphicsQueue;
-    _dataPacket->presentQueue = presentQueue;
+    if (_memoryPressureCallback) _dataPacket->memoryBudget->setPressureCallback(_memoryPressureCallback);
+#ifdef VK_KHR_draw_indirect_count
+    if (_dataPacket->features.drawIndirectCount) {
+        _cmdDrawIndirectCount = (PFN_vkCmdDrawIndirectCountKHR) vkGetDeviceProcAddr(device, "vkCmdDrawIndirectCountKHR");
+    }
+#endif
 
     createCommandPool();
     createCommandBuffer();
 
-    _dataPacket->commandPool = commandPool;
-    _entityManager = std::make_shared<Veloxr::EntityManager>(_dataPacket);
+    _entityManager = _context->getEntityManager();
+    _viewId = _entityManager->getShaderStageData()->createView();
+    _context->attachViewport(_viewId);
+    _entityManager->setFocusProvider([this]() { return _cam.getVisibleBounds(); }, _viewId);
+    // The view starts with unwritten uniforms.
+    _frameVersion.fill(0);
+    requestRedraw();
+    _imagePrefetcher = _context->getImagePrefetcher();
     console.log("[Veloxr] [Debug] init called and completed. Setting up texture passes from state\n");
 
     createSwapChain();
@@ -76,6 +110,7 @@ void RendererCore::init(void* windowHandle) {
 }
 
 void RendererCore::setupGraphics() {
+    freeRecordedCommandBuffers(); // Recorded against the old pipeline.
     createGraphicsPipeline(); // Relies on _entityManager being initialized.
     createFramebuffers();
     createSyncObjects();
@@ -140,11 +175,13 @@ void RendererCore::recreateSwapChain() {
     createSwapChain();
     createImageViews();
     createFramebuffers();
+    requestRedraw();
 }
 
 void RendererCore::cleanupSwapChain() {
     console.logc1(__func__);
     if(device) {
+        freeRecordedCommandBuffers();
         console.log("[Veloxr] [Debug] Destroying frame buffers\n");
         for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
             vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
@@ -186,28 +223,39 @@ void RendererCore::createSyncObjects() {
     }
 }
 
-// TODO: Just using a dirty bit on camera works for a single image_view. Not all of them. So we need the dirty bit for all imageViews. (triple buffer)
-void RendererCore::updateUniformBuffers(uint32_t currentImage) {
-
-    float time = 1;
+void RendererCore::updateFrameState() {
     ubo.view = _cam.getViewMatrix();
     ubo.proj = _cam.getProjectionMatrix();
     ubo.model = glm::mat4(1.0f);
     ubo.roi = _roi;
-    ubo.hiddenMask = 100;
-
-    uint32_t mask = 0;
-
-    for(auto& e : _entityManager->getEntityHandles()) {
-        if (e->isHidden() ) {
-            auto slot = e->getUID();
-            mask |= (1u << slot);
-        }
-    }
-    ubo.hiddenMask = mask;
     ubo.nSplitVal = _splitVal;
+    // Picks overview or tiles per entity in the vertex shader.
+    ubo.worldPerPixel = swapChainExtent.width ? std::abs(_cam.getWidth()) / swapChainExtent.width : 0.0f;
+
+    // Crop and split end up in the uniforms, entity moves and toggles in the entity version. The camera dirty bit alone would miss them.
+    const uint64_t entityVersion = _entityManager->getVersion();
+    bool redrawRequested = false;
+    {
+        std::lock_guard<std::mutex> lock(_redrawMutex);
+        std::swap(redrawRequested, _redrawRequested);
+    }
+    if (redrawRequested || _cam.getDirty() || entityVersion != _drawnEntityVersion ||
+            std::memcmp(&ubo, &_drawnUbo, sizeof(ubo)) != 0) {
+        _stateVersion++;
+        _drawnUbo = ubo;
+        _drawnEntityVersion = entityVersion;
+        _cam.resetDirty();
+    }
+}
 
-    _entityManager->updateUniformBuffers(currentImage, ubo);
+// Each frame in flight has uniforms of its own, only the ones behind the current state are written.
+void RendererCore::updateUniformBuffers(uint32_t currentImage) {
+    if (_frameVersion[currentImage] == _stateVersion) return;
+    _entityManager->updateUniformBuffers(_viewId, currentImage, ubo);
+    // Same state as the uniforms: the camera, crop and the entities' placement and visibility decide which tiles are drawn at all.
+    _entityManager->getShaderStageData()->updateDrawCommands(_viewId, currentImage, _cam.getVisibleBounds(), ubo.roi,
+            _entityManager->getEntityData(), ubo.worldPerPixel);
+    _frameVersion[currentImage] = _stateVersion;
 }
 
 void RendererCore::destroyTextureData() {
@@ -239,31 +287,65 @@ void RendererCore::destroy() {
 
     vkDestroyCommandPool(device, commandPool, nullptr);
 
-    _entityManager->destroy();
+    // Only this view goes, the tiles stay with the context for the other viewports.
+    _entityManager->setFocusProvider(nullptr, _viewId);
+    _entityManager->getShaderStageData()->destroyView(_viewId);
+    _entityManager.reset();
+    _imagePrefetcher.reset();
+    _dataPacket.reset();
+    _deviceUtils.reset();
 
-    vkDestroyDevice(device, nullptr);
+    vkDestroySurfaceKHR(instance, surface, nullptr);
 
-    if (enableValidationLayers) {
-        DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
-    }
+    // The last viewport takes the device, debug messenger and instance with it, whoever else holds the context.
+    const bool lastViewport = _context->detachViewport(_viewId);
+    if (lastViewport) _context->destroy();
+    _context.reset();
+    device = VK_NULL_HANDLE;
+    instance = VK_NULL_HANDLE;
+    debugMessenger = VK_NULL_HANDLE;
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
-    vkDestroyInstance(instance, nullptr);
+    if (noClientWindow) glfwDestroyWindow(window);
 
-    glfwDestroyWindow(window);
+    if (lastViewport) glfwTerminate();
+}
+
+void RendererCore::setImageList(std::vector<std::string> paths) {
+    _imagePrefetcher->setImages(std::move(paths));
+}
 
-    glfwTerminate();
+bool RendererCore::showImage(size_t index, const std::string& entityName) {
+    auto entity = _entityManager->getEntity(entityName);
+    if (!entity) entity = _entityManager->createEntity(entityName);
+    _imagePrefetcher->setTileOptions(entity->getTileCompression(), entity->hasOverviewTexture());
+    // The texture the entity shows now may go into the prefetch cache, complete.
+    _entityManager->finishUploads();
+    const bool prefetched = _imagePrefetcher->show(index, *entity);
+    _entityManager->rebuildDrawList();
+    return prefetched;
 }
 
-void RendererCore::drawFrame() {
+bool RendererCore::drawFrame() {
     vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    _context->update(_viewId);
 
     uint32_t imageIndex;
     if (frameBufferResized) {
         console.log("Resizing swapchain\n");
         frameBufferResized = false;
         recreateSwapChain();
-        return;
+        return true;
+    }
+
+    updateFrameState();
+    if (_renderOnDemand && _presentedVersion == _stateVersion) {
+        if (!_settleFrames) return false;
+        // The last frames may still write virtual texture feedback, read it once they are done.
+        _settleFrames--;
+        vkWaitForFences(device, static_cast<uint32_t>(inFlightFences.size()), inFlightFences.data(), VK_TRUE, UINT64_MAX);
+        _context->update(_viewId);
+        updateFrameState();
+        if (_presentedVersion == _stateVersion) return true;
     }
 
     VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -272,21 +354,25 @@ void RendererCore::drawFrame() {
         console.log("Resizing swapchain\n");
         frameBufferResized = false;
         recreateSwapChain();
-        return;
+        return true;
     } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("failed to acquire swap chain image!");
     }
 
     vkResetFences(device, 1, &inFlightFences[currentFrame]);
-    vkResetCommandBuffer(commandBuffers[currentFrame],  0);
 
     updateUniformBuffers(currentFrame);
 
-    recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+    if (_reuseCommandBuffers) {
+        commandBuffer = getRecordedCommandBuffer(imageIndex);
+    } else {
+        vkResetCommandBuffer(commandBuffer, 0);
+        recordCommandBuffer(commandBuffer, imageIndex);
+    }
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
     VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
@@ -294,7 +380,7 @@ void RendererCore::drawFrame() {
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+    submitInfo.pCommandBuffers = &commandBuffer;
 
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
     submitInfo.signalSemaphoreCount = 1;
@@ -319,4 +405,7 @@ void RendererCore::drawFrame() {
 
     vkQueuePresentKHR(presentQueue, &presentInfo);
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    _presentedVersion = _stateVersion;
+    _settleFrames = MAX_FRAMES_IN_FLIGHT;
+    return true;
 }
@@ -3,14 +3,21 @@
 #include "Common.h"
 #include "RenderEntity.h"
 #include "VVTexture.h"
+#include "VVDescriptorHeap.h"
+#include "VVVirtualTextureCache.h"
+#include "VVMemoryBudget.h"
+#include "VVImagePrefetcher.h"
+#include "VVRenderContext.h"
 #include <memory>
 #include <string>
 #include <unordered_map>
 #define CV_IO_MAX_IMAGE_PIXELS 40536870912
 #include <array>
 #include <chrono>
+#include <condition_variable>
 #include <glm/ext/matrix_transform.hpp>
 #include <map>
+#include <mutex>
 #include <optional>
 #include <queue>
 #include <set>
@@ -184,11 +191,24 @@ public:
 
     // Initialize the renderer, given a window pointer to render into.
     void init(void* windowHandle = nullptr); 
+    // Another viewport on the tiles of an initialized renderer (getRenderContext()): only the surface, swapchain,
+    // pipeline, command buffers and camera are its own. The context's settings apply, the ones set here before
+    // init() do not. All viewports of a context must draw from the same thread.
+    void init(void* windowHandle, std::shared_ptr<Veloxr::VVRenderContext> context);
     void setupGraphics(); 
 
+    // Device, entities and uploaded tiles, shared with the viewports initialized on it.
+    std::shared_ptr<Veloxr::VVRenderContext> getRenderContext() const { return _context; }
+
     // Main introduction to entity handles.
     std::shared_ptr<Veloxr::EntityManager> getEntityManager() { return _entityManager; }
 
+    // Per-heap device memory usage of everything Veloxr allocated.
+    std::vector<Veloxr::VVHeapStats> getMemoryStats() const {
+        if (!_dataPacket || !_dataPacket->allocator) return {};
+        return _dataPacket->allocator->getHeapStats();
+    }
+
     // Camera API. Use this object to access camera movement related data, zoom, pan, etc.
     Veloxr::OrthographicCamera& getCamera() {
         return _cam;
@@ -206,18 +226,122 @@ public:
     glm::vec4 _roi {0, 0, 0, 0};
     void resetCrop() {
         _roi = {0, 0, 0, 0};
+        restoreCrop();
     }
     void setCrop(glm::vec4 roi) {
+        // A new crop may need tiles the committed one released.
+        restoreCrop();
         _roi = roi;
     }
+    // Releases the tiles outside the current crop and drops them from the draw list until the crop changes.
+    // Only evicted to the host store with tile eviction on, so resetCrop() brings them back without tiling again.
+    void commitCrop() {
+        if (_roi == glm::vec4(0.0f) || !_entityManager) return;
+        _entityManager->commitCrop(_roi);
+        _cropCommitted = true;
+    }
     
     // Make drawFrame accessible to external code
-    void drawFrame();
+    // Returns whether the caller should call again soon: a frame went out or the frames in flight still settle
+    // (virtual texture feedback, tiles coming back). False when nothing changed in render on demand mode.
+    bool drawFrame();
+
+    // Only record and submit a frame when the camera, crop, split, entities or tiles changed. render() then sleeps
+    // in glfwWaitEvents instead of running at 144 fps. Client windows call drawFrame from their own paint events.
+    void setRenderOnDemand(bool onDemand) {
+        _renderOnDemand = onDemand;
+        requestRedraw();
+    }
+    // Record the scene once per frame in flight and swapchain image and submit it again as is. Only the uniforms
+    // change with the camera, the buffers are recorded again when the draw list or the swapchain changes.
+    void setReuseCommandBuffers(bool reuse) {
+        _reuseCommandBuffers = reuse;
+    }
+    // For changes drawFrame cannot see, e.g. the window was exposed. Thread safe, wakes render() and waitForRedraw.
+    void requestRedraw() {
+        {
+            std::lock_guard<std::mutex> lock(_redrawMutex);
+            _redrawRequested = true;
+        }
+        _redrawCondition.notify_all();
+        if (noClientWindow) glfwPostEmptyEvent();
+    }
+    // Blocks a client render thread until requestRedraw or the timeout. Returns whether a redraw was requested.
+    bool waitForRedraw(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(_redrawMutex);
+        return _redrawCondition.wait_for(lock, timeout, [this]() { return _redrawRequested; });
+    }
     void setValidationLayersEnabled(bool validationEnabled) {
         enableValidationLayers = validationEnabled;
 
     }
 
+    // Upload path tuning, must be set before init().
+    void setImportHostMemory(bool importHostMemory) {
+        _settings.importHostMemory = importHostMemory;
+    }
+    void setLinearTilesOnUnifiedMemory(bool linearTiles) {
+        _settings.linearTilesOnUnifiedMemory = linearTiles;
+    }
+    void setGpuExpandRGB(bool gpuExpandRGB) {
+        _settings.gpuExpandRGB = gpuExpandRGB;
+    }
+    void setPackTileArrays(bool packTileArrays) {
+        _settings.packTileArrays = packTileArrays;
+    }
+    void setBindlessDescriptors(bool bindless) {
+        _settings.bindlessDescriptors = bindless;
+    }
+    // Entities still opt in with RenderEntity::setVirtualTexture.
+    void setVirtualTextures(bool enabled, uint32_t cacheSize = 4096) {
+        _settings.virtualTextures = enabled;
+        _settings.virtualTextureCacheSize = cacheSize;
+    }
+    void setTileCacheDirectory(const std::string& directory, uint64_t maxBytes = 4ull * 1024 * 1024 * 1024) {
+        _settings.tileCacheDirectory = directory;
+        _settings.tileCacheMaxBytes = maxBytes;
+    }
+    void setTileEviction(bool tileEviction) {
+        _settings.tileEviction = tileEviction;
+    }
+    // Drop decoded pixels after upload for entities with a source (RenderEntity::setSourcePath), applies to the
+    // entities initialized from then on.
+    void setReleaseHostPixels(bool release) {
+        _settings.releaseHostPixels = release;
+        if (_dataPacket) _dataPacket->settings.releaseHostPixels = release;
+    }
+
+    // Image list stepping (VVImagePrefetcher), the images around the shown one are decoded and tiled in the background.
+    void setImageList(std::vector<std::string> paths);
+    // Shows paths[index] on the named entity, created when missing. Returns whether it was prefetched, which makes the
+    // switch a texture swap and a vertex buffer rebuild.
+    bool showImage(size_t index, const std::string& entityName = "main");
+    void setPrefetchRadius(uint32_t radius) {
+        _settings.prefetchRadius = radius;
+        if (_dataPacket) _dataPacket->settings.prefetchRadius = radius;
+    }
+    void setPrefetchBudget(VkDeviceSize hostBytes, VkDeviceSize deviceBytes) {
+        _settings.prefetchHostBudget = hostBytes;
+        _settings.prefetchDeviceBudget = deviceBytes;
+        if (_dataPacket) {
+            _dataPacket->settings.prefetchHostBudget = hostBytes;
+            _dataPacket->settings.prefetchDeviceBudget = deviceBytes;
+        }
+    }
+
+    // Device memory budget, these can also be changed after init(), e.g. when another GPU process needs room.
+    void setDeviceMemoryBudget(VkDeviceSize bytes) {
+        _settings.deviceMemoryBudget = bytes;
+        if (_dataPacket && _dataPacket->memoryBudget) _dataPacket->memoryBudget->setCap(bytes);
+    }
+    void setMemoryPressureCallback(std::function<void(const Veloxr::VVMemoryBudgetStats&)> callback) {
+        _memoryPressureCallback = std::move(callback);
+        if (_dataPacket && _dataPacket->memoryBudget) _dataPacket->memoryBudget->setPressureCallback(_memoryPressureCallback);
+    }
+    Veloxr::VVMemoryBudgetStats getMemoryBudgetStats() const {
+        return _dataPacket && _dataPacket->memoryBudget ? _dataPacket->memoryBudget->getStats() : Veloxr::VVMemoryBudgetStats{};
+    }
+
 
     //glm::vec2 getMainEntityPosition()  { }
 
@@ -236,9 +360,10 @@ private: // No client -- internal
 
 
     VkInstance instance;
+    uint32_t instanceApiVersion{VK_API_VERSION_1_0};
     bool noClientWindow = false;
 
-    VkDebugUtilsMessengerEXT debugMessenger;
+    VkDebugUtilsMessengerEXT debugMessenger{VK_NULL_HANDLE};
 
 #ifdef VALIDATION_LAYERS_VALUE
     bool enableValidationLayers = VALIDATION_LAYERS_VALUE;
@@ -256,12 +381,24 @@ private: // No client -- internal
     };
 
 
+    std::shared_ptr<Veloxr::VVRenderContext> _context;
+    uint32_t _viewId{0}; // Our uniforms in the shared VVShaderStageData.
     std::shared_ptr<Veloxr::Device> _deviceUtils;
     std::shared_ptr<Veloxr::VVDataPacket> _dataPacket;
+    Veloxr::VVRenderSettings _settings{};
+    std::function<void(const Veloxr::VVMemoryBudgetStats&)> _memoryPressureCallback;
+    std::shared_ptr<Veloxr::VVImagePrefetcher> _imagePrefetcher;
+    bool _cropCommitted{false};
+
+    void restoreCrop() {
+        if (!_cropCommitted) return;
+        _cropCommitted = false;
+        if (_entityManager) _entityManager->restoreCrop();
+    }
 
     // VK
     VkSurfaceKHR surface;
-    VkDevice device;
+    VkDevice device{VK_NULL_HANDLE};
     VkPhysicalDevice physicalDevice;
     VkQueue graphicsQueue, presentQueue;
     VkSwapchainKHR swapChain;
@@ -279,6 +416,13 @@ private: // No client -- internal
     std::vector<VkCommandBuffer> commandBuffers;
     uint32_t currentFrame = 0;
 
+    // Reused command buffers, frame in flight major, with the stage data and draw versions each was recorded against.
+    bool _reuseCommandBuffers{false};
+    std::vector<VkCommandBuffer> _recordedCommandBuffers;
+    std::vector<uint64_t> _recordedVersions;
+    std::vector<uint64_t> _recordedDrawVersions;
+    PFN_vkCmdDrawIndirectCountKHR _cmdDrawIndirectCount{nullptr};
+
     // Structure for holding the VRAM data
     struct VkVirtualTexture {
         VkImage textureImage;
@@ -306,6 +450,19 @@ private: // No client -- internal
     std::vector<VkFence> inFlightFences;
     bool frameBufferResized = false;
 
+    // Render on demand. Every change of what we draw bumps _stateVersion, a frame in flight only gets its uniforms
+    // written again when it is behind and a frame only goes out when the presented one is behind.
+    bool _renderOnDemand{false};
+    std::mutex _redrawMutex;
+    std::condition_variable _redrawCondition;
+    bool _redrawRequested{true};
+    Veloxr::UniformBufferObject _drawnUbo{};
+    uint64_t _drawnEntityVersion{0};
+    uint64_t _stateVersion{1};
+    uint64_t _presentedVersion{0};
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> _frameVersion{};
+    uint32_t _settleFrames{0};
+
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
             VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
             VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -323,6 +480,11 @@ private: // No client -- internal
 
     }
 
+    static void windowRefreshCallback(GLFWwindow* window) {
+        auto app = reinterpret_cast<RendererCore*>(glfwGetWindowUserPointer(window));
+        app->requestRedraw();
+    }
+
     void* getWindowHandleFromRaw(void* rawHandle) {
 #ifdef __APPLE__
         return GetMetalLayerForNSView(rawHandle);
@@ -364,6 +526,7 @@ private: // No client -- internal
         window = glfwCreateWindow(_windowWidth, _windowHeight, "Vulkan", nullptr, nullptr);
         glfwSetWindowUserPointer(window, this);
         glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        glfwSetWindowRefreshCallback(window, windowRefreshCallback);
         glfwSetMouseButtonCallback(window, mouse_button_callback);
         glfwSetCursorPosCallback(window, cursor_position_callback);
         glfwSetScrollCallback(window, scroll_callback);
@@ -439,6 +602,8 @@ private:
     void recreateSwapChain();
     void cleanupSwapChain();
     void createSyncObjects();
+    // Builds ubo and bumps _stateVersion when it or the entities changed since the last call.
+    void updateFrameState();
     void updateUniformBuffers(uint32_t currentImage);
 
     void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
@@ -483,10 +648,31 @@ private:
         VkBuffer vertexBuffers[] = {p_shaderStage->getVertexBuffer()};
         VkDeviceSize offsets[] = {0};
         vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &p_shaderStage->getDescriptorSets()[currentFrame], 0, nullptr);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &p_shaderStage->getDescriptorSets(_viewId)[currentFrame], 0, nullptr);
+        if (_dataPacket->descriptorHeap) {
+            VkDescriptorSet heapSet = _dataPacket->descriptorHeap->getDescriptorSet();
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &heapSet, 0, nullptr);
+        }
+        if (_dataPacket->virtualTextures) {
+            VkDescriptorSet virtualSet = _dataPacket->virtualTextures->getDescriptorSet();
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &virtualSet, 0, nullptr);
+        }
 
-        uint32_t vertCount = static_cast<uint32_t>(_entityManager->getVertices().size());
-        vkCmdDraw(commandBuffer, vertCount, 1, 0, 0);
+        // Only the tiles updateDrawCommands kept, see updateUniformBuffers.
+        const VkBuffer drawBuffer = p_shaderStage->getDrawBuffer(_viewId, currentFrame);
+        const uint32_t drawCount = p_shaderStage->getDrawCount(_viewId, currentFrame);
+        const auto& features = _dataPacket->features;
+        if (usesDrawIndirectCount()) {
+            _cmdDrawIndirectCount(commandBuffer, drawBuffer, Veloxr::VVShaderStageData::DRAW_COMMANDS_OFFSET, drawBuffer, 0,
+                    p_shaderStage->getMaxDrawCount(), sizeof(VkDrawIndirectCommand));
+        } else if (features.multiDrawIndirect && drawCount <= features.maxDrawIndirectCount) {
+            vkCmdDrawIndirect(commandBuffer, drawBuffer, Veloxr::VVShaderStageData::DRAW_COMMANDS_OFFSET, drawCount, sizeof(VkDrawIndirectCommand));
+        } else {
+            const VkDrawIndirectCommand* commands = p_shaderStage->getDrawCommands(_viewId, currentFrame);
+            for (uint32_t i = 0; i < drawCount; i++) {
+                vkCmdDraw(commandBuffer, commands[i].vertexCount, commands[i].instanceCount, commands[i].firstVertex, commands[i].firstInstance);
+            }
+        }
         vkCmdEndRenderPass(commandBuffer);
 
 
@@ -498,6 +684,53 @@ private:
 
     }
 
+    // The buffer for currentFrame and imageIndex, recorded again only when the stage data changed. It was last
+    // submitted with inFlightFences[currentFrame], which drawFrame has waited on.
+    VkCommandBuffer getRecordedCommandBuffer(uint32_t imageIndex) {
+        const size_t imageCount = swapChainImages.size();
+        if (_recordedCommandBuffers.empty()) {
+            _recordedCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT * imageCount);
+            _recordedVersions.assign(_recordedCommandBuffers.size(), 0);
+            _recordedDrawVersions.assign(_recordedCommandBuffers.size(), 0);
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = static_cast<uint32_t>(_recordedCommandBuffers.size());
+            if (vkAllocateCommandBuffers(device, &allocInfo, _recordedCommandBuffers.data()) != VK_SUCCESS) {
+                _recordedCommandBuffers.clear();
+                throw std::runtime_error("failed to allocate command buffers!");
+            }
+        }
+
+        // Without an indirect count the culled draws are baked into the buffer as well.
+        const size_t index = currentFrame * imageCount + imageIndex;
+        auto p_shaderStage = _entityManager->getShaderStageData();
+        const uint64_t version = p_shaderStage->getVersion();
+        const uint64_t drawVersion = usesDrawIndirectCount() ? 0 : p_shaderStage->getDrawVersion(_viewId, currentFrame);
+        if (_recordedVersions[index] != version || _recordedDrawVersions[index] != drawVersion) {
+            vkResetCommandBuffer(_recordedCommandBuffers[index], 0);
+            recordCommandBuffer(_recordedCommandBuffers[index], imageIndex);
+            _recordedVersions[index] = version;
+            _recordedDrawVersions[index] = drawVersion;
+        }
+        return _recordedCommandBuffers[index];
+    }
+
+    // Framebuffers and extent are baked into them, the swapchain takes them along.
+    void freeRecordedCommandBuffers() {
+        if (_recordedCommandBuffers.empty()) return;
+        vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(_recordedCommandBuffers.size()), _recordedCommandBuffers.data());
+        _recordedCommandBuffers.clear();
+        _recordedVersions.clear();
+        _recordedDrawVersions.clear();
+    }
+
+    inline bool usesDrawIndirectCount() const {
+        return _cmdDrawIndirectCount && _entityManager->getShaderStageData()->getMaxDrawCount() <= _dataPacket->features.maxDrawIndirectCount;
+    }
+
     void createCommandBuffer() {
         std::cout << "[Veloxr] Creating command buffers\n";
         commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
@@ -515,7 +748,7 @@ private:
     }
 
     void createCommandPool() {
-        Veloxr::QueueFamilyIndices queueFamilyIndices = _deviceUtils->findQueueFamilies(physicalDevice);
+        const Veloxr::QueueFamilyIndices& queueFamilyIndices = _deviceUtils->getQueueFamilies();
 
         VkCommandPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -618,11 +851,12 @@ private:
 
         auto vertShaderCode = readFile((spirvDir / "vert.spv").string());
         
-        // Load platform-specific fragment shader
+        // Load platform-specific fragment shader, bindless indexes the descriptor heap instead of a fixed array.
+        // The virtual texture shader is the bindless one plus the page table lookup.
 #ifdef __APPLE__
-        auto fragShaderCode = readFile((spirvDir / "frag_mac.spv").string());
+        auto fragShaderCode = readFile((spirvDir / (_dataPacket->virtualTextures ? "frag_virtual.spv" : _dataPacket->descriptorHeap ? "frag_bindless.spv" : "frag_mac.spv")).string());
 #else
-        auto fragShaderCode = readFile((spirvDir / "frag.spv").string());
+        auto fragShaderCode = readFile((spirvDir / (_dataPacket->virtualTextures ? "frag_virtual.spv" : _dataPacket->descriptorHeap ? "frag_bindless.spv" : "frag.spv")).string());
 #endif
 
         VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
@@ -644,8 +878,8 @@ private:
 
         VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
-        auto bindingDescription = Veloxr::Vertex::getBindingDescription();
-        auto attributeDescriptions = Veloxr::Vertex::getAttributeDescriptions();
+        auto bindingDescription = Veloxr::TileInstance::getBindingDescription();
+        auto attributeDescriptions = Veloxr::TileInstance::getAttributeDescriptions();
 
 
         // Hardcoded in shader for now :D
@@ -740,9 +974,13 @@ private:
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
+        // Set 0: uniforms, sampler (and tile images without bindless). Set 1: the bindless descriptor heap. Set 2: virtual textures.
+        std::vector<VkDescriptorSetLayout> setLayouts = { _entityManager->getShaderStageData()->getDescriptorSetLayout() };
+        if (_dataPacket->descriptorHeap) setLayouts.push_back(_dataPacket->descriptorHeap->getDescriptorSetLayout());
+        if (_dataPacket->virtualTextures) setLayouts.push_back(_dataPacket->virtualTextures->getDescriptorSetLayout());
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
         console.debug("!");
-        pipelineLayoutInfo.pSetLayouts = &_entityManager->getShaderStageData()->getDescriptorSetLayout();
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
         console.debug("!!");
 
         if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
@@ -792,7 +1030,7 @@ private:
     }
 
     void createSwapChain() {
-        Veloxr::SwapChainSupportDetails swapChainSupport = _deviceUtils->querySwapChainSupport(physicalDevice);
+        Veloxr::SwapChainSupportDetails swapChainSupport = _deviceUtils->querySwapChainSupport(physicalDevice, surface);
 
         VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
         VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
@@ -821,7 +1059,7 @@ private:
         createInfo.imageExtent = extent;
         createInfo.imageArrayLayers = 1; //stereoscopic, ignore.
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-        Veloxr::QueueFamilyIndices indices = _deviceUtils->findQueueFamilies(physicalDevice);
+        Veloxr::QueueFamilyIndices indices = _deviceUtils->getQueueFamilies();
         uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
         // Store member meta data for swapchain
         swapChainImageFormat = surfaceFormat.format;
@@ -921,6 +1159,7 @@ private:
         int frames = 0;
         constexpr auto frameBudget = std::chrono::duration<float>(1.f / 144.0f);
         auto last = clock::now();
+        bool busy = true;
         while (!glfwWindowShouldClose(window)) {
             auto now = clock::now();
             auto delta = now - last;
@@ -929,6 +1168,14 @@ private:
             float dt = std::chrono::duration<float>(delta).count();
             deltaMs = dt;
 
+            if (_renderOnDemand) {
+                // Prefetching and settling frames still need update() at frame pace, otherwise sleep until input.
+                if (busy || _context->hasPendingWork()) glfwWaitEventsTimeout(frameBudget.count());
+                else glfwWaitEvents();
+                busy = drawFrame();
+                continue;
+            }
+
             glfwPollEvents();
             drawFrame();
 
@@ -1070,7 +1317,12 @@ private:
         appInfo.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
         appInfo.pEngineName = "Cast";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 1);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        // Ask for the newest version we know how to use, optional device features depend on it.
+        instanceApiVersion = VK_API_VERSION_1_0;
+        auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+        if (enumerateInstanceVersion) enumerateInstanceVersion(&instanceApiVersion);
+        instanceApiVersion = std::min(instanceApiVersion, (uint32_t)VK_API_VERSION_1_3);
+        appInfo.apiVersion = instanceApiVersion;
 
         VkInstanceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -1259,7 +1511,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         Veloxr::OIIOTexture texture(filepath);
         Veloxr::VeloxrBuffer buf;
         std::cout << "Moving data...";
-        buf.data = texture.load(filepath);
+        buf.data = texture.load(filepath, false);
         std::cout << "... done!\n";
         buf.width = texture.getResolution().x;
         buf.height = texture.getResolution().y;
@@ -1320,11 +1572,9 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     // TODO, setPosition of camera instead.
     if (key == GLFW_KEY_D && action == GLFW_PRESS) {
         e->setPosition(e->getPosition().x + 1000 * app->deltaMs, e->getPosition().y);
-        em->initialize();
     }
     if (key == GLFW_KEY_A && action == GLFW_PRESS) {
         e->setPosition(e->getPosition().x - 1000 * app->deltaMs, e->getPosition().y);
-        em->initialize();
     }
 
 
@@ -2,17 +2,22 @@
 
 layout(location = 0) in vec4 fragTexCoord;
 layout(location = 1) in flat int texUnit;
+layout(location = 2) in flat int texLayer;
+layout(location = 3) in flat float entityOpacity;
 
 layout(location = 0) out vec4 outColor;
 
-// Use 128 samplers for Windows (original large array size)
-layout(binding = 1) uniform sampler2D texSamplers[128];
+// Use 128 texture arrays for Windows (original large array size)
+// Each entry is a 2D array of equal sized tiles, texLayer picks the tile.
+layout(binding = 1) uniform sampler texSampler;
+// VVShaderStageData::SHADER_IMAGE_COUNT, change together.
+layout(binding = 2) uniform texture2DArray texImages[128];
 
 void main() {
-    outColor = texture(texSamplers[texUnit], fragTexCoord.xy);
-    // outColor.a = 0.5;
+    outColor = texture(sampler2DArray(texImages[texUnit], texSampler), vec3(fragTexCoord.xy, texLayer));
+    outColor.a *= entityOpacity;
     // blend for testing :D
-    //outColor = 0.5 * texture(texSamplers[0], fragTexCoord.xy) + 0.5 * texture(texSamplers[1], fragTexCoord.xy);
+    //outColor = 0.5 * texture(sampler2DArray(texImages[0], texSampler), vec3(fragTexCoord.xy, 0)) + 0.5 * texture(sampler2DArray(texImages[1], texSampler), vec3(fragTexCoord.xy, 0));
 
     return;
     //Debug code
@@ -29,7 +34,7 @@ void main() {
         outColor = vec4(0.0, 1.0, 0.0, 1.0);
     }
     else {
-        outColor = texture(texSamplers[texUnit], fragTexCoord.xy);
+        outColor = texture(sampler2DArray(texImages[texUnit], texSampler), vec3(fragTexCoord.xy, texLayer));
     }
-    outColor.r = float(texUnit) / float(texSamplers.length());
+    outColor.r = float(texUnit) / float(texImages.length());
 }
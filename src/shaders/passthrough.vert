@@ -1,51 +1,99 @@
 #version 450
 
-layout(location = 0) in vec4 inPosition;
-layout(location = 1) in vec4 inTexCoord;
+// Per instance, one tile quad (Veloxr::TileInstance).
+layout(location = 0) in vec4 inRect;   // minX, minY, maxX, maxY
+layout(location = 1) in vec4 inUVRect; // UV at (minX, minY), UV at (maxX, maxY)
 layout(location = 2) in int inTextureUnit;
 layout(location = 3) in int inRenderID;
+layout(location = 4) in int inTextureLayer;
+layout(location = 5) in float inOverviewScale;
+layout(location = 6) in uint inFlags;
 
 layout(location = 0) out vec4 fragTexCoord;
 layout(location = 1) out flat int texUnit;
+layout(location = 2) out flat int texLayer;
+layout(location = 3) out flat float entityOpacity;
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
     vec4 roi;
-    uint hiddenMask;
     float nSplitVal;
+    float worldPerPixel; // World units (image pixels) covered by one screen pixel.
 } ubo;
 
+// Veloxr::EntityData, indexed by renderUID.
+const uint ENTITY_HIDDEN = 1u;
+struct EntityData {
+    vec4 transform; // Offset x, y and scale x, y: world = offset + local * scale.
+    vec4 crop;      // Entity space minX, minY, maxX, maxY, all zero is no crop.
+    float opacity;
+    uint flags;
+};
+
+layout(std430, binding = 3) readonly buffer Entities {
+    EntityData entities[];
+};
+
+const float NO_CLIP = 1e30;
+
 out gl_PerVertex {
     vec4  gl_Position;
     float gl_ClipDistance[4];
 };
 
+const uint UV_SWAPPED = 1u;
+
+// Same winding as TextureTiling: left top, left bottom, right bottom, left top, right bottom, right top.
+const vec2 CORNERS[6] = vec2[](vec2(0.0, 0.0), vec2(0.0, 1.0), vec2(1.0, 1.0),
+                               vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(1.0, 0.0));
+
 void main() {
 
-    vec4 world = vec4(inPosition.x, inPosition.y, 0.0, 1.0);
+    EntityData entity = entities[inRenderID];
+
+    vec2 corner = CORNERS[gl_VertexIndex % 6];
+    vec2 position = mix(inRect.xy, inRect.zw, corner);
+    vec2 uv = mix(inUVRect.xy, inUVRect.zw, (inFlags & UV_SWAPPED) != 0u ? corner.yx : corner);
+
+    vec4 world = vec4(entity.transform.xy + position * entity.transform.zw, 0.0, 1.0);
 
+    // The view's crop and the entity's, both in world space.
+    vec4 clip = vec4(-NO_CLIP, -NO_CLIP, NO_CLIP, NO_CLIP);
     if(any(notEqual(ubo.roi, vec4(0.0)))) {
-        gl_ClipDistance[0] =  world.x - ubo.roi.x;
-        gl_ClipDistance[1] =  ubo.roi.z - world.x;
-        gl_ClipDistance[2] =  world.y - ubo.roi.y;
-        gl_ClipDistance[3] =  ubo.roi.w - world.y;
-    } else {
-        gl_ClipDistance[0] = gl_ClipDistance[1] = gl_ClipDistance[2] = gl_ClipDistance[3] = 1.0;
+        clip = ubo.roi;
     }
+    if(any(notEqual(entity.crop, vec4(0.0)))) {
+        vec2 cropMin = entity.transform.xy + entity.crop.xy * entity.transform.zw;
+        vec2 cropMax = entity.transform.xy + entity.crop.zw * entity.transform.zw;
+        clip = vec4(max(clip.xy, min(cropMin, cropMax)), min(clip.zw, max(cropMin, cropMax)));
+    }
+    gl_ClipDistance[0] =  world.x - clip.x;
+    gl_ClipDistance[1] =  clip.z - world.x;
+    gl_ClipDistance[2] =  world.y - clip.y;
+    gl_ClipDistance[3] =  clip.w - world.y;
 
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition.xy, 0.0, 1.0);
+    gl_Position = ubo.proj * ubo.view * ubo.model * world;
 
-    int renderIdInt = int(round(inRenderID));
-    bool isHidden = (ubo.hiddenMask & (1u << renderIdInt)) != 0u;
-    // hack
-    if(isHidden) {
+    if((entity.flags & ENTITY_HIDDEN) != 0u) {
         gl_Position = vec4(0);
         gl_ClipDistance[0] = -1;
     }
 
-    fragTexCoord = inTexCoord;
+    // Overview quad while zoomed out far enough that it is at least screen resolution, the tiles otherwise.
+    // Both are measured in the entity's own pixels.
+    if(inOverviewScale != 0.0) {
+        bool useOverview = ubo.worldPerPixel / abs(entity.transform.z) >= abs(inOverviewScale);
+        if(useOverview != (inOverviewScale > 0.0)) {
+            gl_Position = vec4(0);
+            gl_ClipDistance[0] = -1;
+        }
+    }
+
+    fragTexCoord = vec4(uv, 0.0, 0.0);
     texUnit = inTextureUnit;
+    texLayer = inTextureLayer;
+    entityOpacity = entity.opacity;
 }
 
@@ -0,0 +1,18 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec4 fragTexCoord;
+layout(location = 1) in flat int texUnit;
+layout(location = 2) in flat int texLayer;
+layout(location = 3) in flat float entityOpacity;
+
+layout(location = 0) out vec4 outColor;
+
+// Every tile array lives in the persistent descriptor heap (set 1), texUnit is its TileManager slot.
+layout(set = 0, binding = 1) uniform sampler texSampler;
+layout(set = 1, binding = 0) uniform texture2DArray texImages[];
+
+void main() {
+    outColor = texture(sampler2DArray(texImages[nonuniformEXT(texUnit)], texSampler), vec3(fragTexCoord.xy, texLayer));
+    outColor.a *= entityOpacity;
+}
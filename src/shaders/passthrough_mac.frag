@@ -2,14 +2,19 @@
 
 layout(location = 0) in vec4 fragTexCoord;
 layout(location = 1) in flat int texUnit;
+layout(location = 2) in flat int texLayer;
+layout(location = 3) in flat float entityOpacity;
 
 layout(location = 0) out vec4 outColor;
 
-// Use 16 samplers for macOS compatibility (M3 Pro hardware limit)
-layout(binding = 1) uniform sampler2D texSamplers[16];
+// Use 16 texture arrays for macOS compatibility (M3 Pro hardware limit)
+// Each entry is a 2D array of equal sized tiles, texLayer picks the tile.
+layout(binding = 1) uniform sampler texSampler;
+// VVShaderStageData::SHADER_IMAGE_COUNT, change together.
+layout(binding = 2) uniform texture2DArray texImages[16];
 
 void main() {
-    outColor = texture(texSamplers[texUnit], fragTexCoord.xy);
+    outColor = texture(sampler2DArray(texImages[texUnit], texSampler), vec3(fragTexCoord.xy, texLayer));
     
     // Debug code for edge detection
     float edgeThreshold = 0.005;
@@ -22,4 +27,5 @@ void main() {
     if (nearLeft || nearRight || nearBottom || nearTop) {
         outColor = vec4(0.0, 1.0, 0.0, 1.0);
     }
+    outColor.a *= entityOpacity;
 } 
\ No newline at end of file
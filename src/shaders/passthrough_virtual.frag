@@ -0,0 +1,73 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec4 fragTexCoord;
+layout(location = 1) in flat int texUnit;
+layout(location = 2) in flat int texLayer;
+layout(location = 3) in flat float entityOpacity;
+
+layout(location = 0) out vec4 outColor;
+
+// Every tile array lives in the persistent descriptor heap (set 1), texUnit is its TileManager slot.
+layout(set = 0, binding = 1) uniform sampler texSampler;
+layout(set = 1, binding = 0) uniform texture2DArray texImages[];
+
+// Virtual textures (set 2), see VVVirtualTextureCache. A negative texUnit is -(virtual texture id + 1).
+const uint PAGE_SIZE = 256u;
+const uint RESIDENT_BIT = 0x80000000u;
+
+struct VirtualTextureInfo {
+    uint width;
+    uint height;
+    uint levelCount;
+    uint cachePagesPerSide;
+    uint levelOffset[16];  // First page table entry of each level.
+    uint levelPagesX[16];
+};
+
+layout(set = 2, binding = 0) uniform texture2D pageCache;
+layout(std430, set = 2, binding = 1) readonly buffer PageTable { uint entries[]; } pageTable;
+layout(std430, set = 2, binding = 2) readonly buffer TextureInfos { VirtualTextureInfo infos[]; } textureInfos;
+layout(std430, set = 2, binding = 3) writeonly buffer Feedback { uint requested[]; } feedback;
+
+uint pageEntry(VirtualTextureInfo info, uvec2 texel, uint level) {
+    uvec2 page = texel / (PAGE_SIZE << level);
+    return info.levelOffset[level] + page.y * info.levelPagesX[level] + page.x;
+}
+
+vec4 sampleVirtual(uint id, vec2 uv, vec2 uvDx, vec2 uvDy) {
+    VirtualTextureInfo info = textureInfos.infos[id];
+    vec2 size = vec2(info.width, info.height);
+    vec2 texel = clamp(uv * size, vec2(0.0), size - 1.0);
+    uvec2 texelIndex = uvec2(texel);
+
+    // One texel per pixel: the level whose texels best match the screen footprint.
+    float footprint = max(length(uvDx * size), length(uvDy * size));
+    uint level = min(uint(max(0.0, log2(max(footprint, 1.0)))), info.levelCount - 1u);
+
+    // Ask for the page we want, then draw with the finest one already resident. The coarsest level is always resident.
+    feedback.requested[pageEntry(info, texelIndex, level)] = 1u;
+    for (uint l = level; l < info.levelCount; l++) {
+        uint entry = pageTable.entries[pageEntry(info, texelIndex, l)];
+        if ((entry & RESIDENT_BIT) == 0u) continue;
+
+        uint slot = entry & ~RESIDENT_BIT;
+        vec2 origin = vec2(slot % info.cachePagesPerSide, slot / info.cachePagesPerSide) * float(PAGE_SIZE);
+        vec2 inPage = mod(texel / float(1u << l), float(PAGE_SIZE));
+        return textureLod(sampler2D(pageCache, texSampler), (origin + inPage) / float(info.cachePagesPerSide * PAGE_SIZE), 0.0);
+    }
+    return vec4(0.0);
+}
+
+void main() {
+    // Derivatives before branching, neighbouring pixels may belong to a different entity.
+    vec2 uvDx = dFdx(fragTexCoord.xy);
+    vec2 uvDy = dFdy(fragTexCoord.xy);
+
+    if (texUnit < 0) {
+        outColor = sampleVirtual(uint(-texUnit - 1), fragTexCoord.xy, uvDx, uvDy);
+    } else {
+        outColor = texture(sampler2DArray(texImages[nonuniformEXT(texUnit)], texSampler), vec3(fragTexCoord.xy, texLayer));
+    }
+    outColor.a *= entityOpacity;
+}
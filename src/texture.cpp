@@ -1,5 +1,6 @@
 #include "texture.h"
 #include <OpenImageIO/imageio.h>
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 #include <vector>
@@ -31,10 +32,21 @@ void OIIOTexture::init(std::string filename) {
     _loaded = true;
 }
 
-std::vector<unsigned char> OIIOTexture::load(std::string filename) {
+std::shared_ptr<Veloxr::VeloxrBuffer> OIIOTexture::loadBuffer(const std::string& filename) {
+    OIIOTexture texture(filename);
+    auto buffer = std::make_shared<Veloxr::VeloxrBuffer>();
+    buffer->data = texture.load(filename, false);
+    buffer->width = texture.getResolution().x;
+    buffer->height = texture.getResolution().y;
+    buffer->numChannels = texture.getNumChannels();
+    buffer->orientation = texture.getOrientation();
+    return buffer;
+}
+
+Veloxr::PixelBuffer OIIOTexture::load(std::string filename, bool expandToRGBA) {
     if (filename.empty() && !_loaded) {
         std::cerr << "OIIOTexture not initialized properly\n";
-        static std::vector<unsigned char> err;
+        static Veloxr::PixelBuffer err;
         return err;
     } else if (filename.empty() && _loaded) filename = _filename;
     if (!_loaded) init(filename);
@@ -49,6 +61,20 @@ std::vector<unsigned char> OIIOTexture::load(std::string filename) {
     console.logc1("Done loading ", filename);
     console.logc1("Allocating buffer..", filename);
 
+    if (!expandToRGBA) {
+        // Native channels, straight into the pixel buffer. Anything past RGBA is dropped.
+        const uint64_t channels = std::min<uint64_t>(_numChannels, 4);
+        Veloxr::PixelBuffer pixelData(_resolution.x * _resolution.y * channels);
+        console.logc1("Reading image: ", channels, " channel ", pixelData.size() / 1024 / 1024, " mb.");
+        in->read_image(0, 0, 0, channels, OIIO::TypeDesc::UINT8, pixelData.data());
+        console.logc1("Done reading image.");
+        in->close();
+        in.reset();
+
+        _numChannels = channels;
+        return pixelData;
+    }
+
     std::vector<unsigned char> rawData(_resolution.x * _resolution.y * _numChannels);
 
     console.logc1("Reading image: ", _numChannels, " channel ", rawData.size() / 1024 / 1024, " mb.");
@@ -62,7 +88,7 @@ std::vector<unsigned char> OIIOTexture::load(std::string filename) {
     const uint64_t h = _resolution.y;
     const uint64_t pixels = w * h;
 
-    std::vector<unsigned char> pixelData(static_cast<size_t>(pixels * 4), 255);
+    Veloxr::PixelBuffer pixelData(static_cast<size_t>(pixels * 4), 255);
 
        for (uint64_t i = 0; i < pixels; ++i) {
         const uint64_t src = i * _numChannels;
@@ -1,10 +1,12 @@
 #pragma once
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "VLogger.h"
 #include "Common.h"
+#include "DataUtils.h"
 
 namespace Veloxr {
 
@@ -18,7 +20,10 @@ namespace Veloxr {
             inline const std::string& getFilename() const { return _filename; }
             inline const uint64_t& getNumChannels() const { return _numChannels; }
             inline const uint64_t& getOrientation() const { return _orientation; }
-            std::vector<unsigned char> load(std::string filename="");
+            // expandToRGBA=false keeps the file's channels (up to 4), the tiler picks a matching tile format.
+            Veloxr::PixelBuffer load(std::string filename="", bool expandToRGBA=true);
+            // The file's pixels in its own channels, with the resolution and orientation filled in.
+            static std::shared_ptr<Veloxr::VeloxrBuffer> loadBuffer(const std::string& filename);
             inline const bool isInitialized() const { return _loaded; }
 
         private: